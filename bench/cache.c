@@ -0,0 +1,100 @@
+/* Time to read a large source file as load does, from the source with mpc
+ * and the hand written reader, and from the cache of what it read before.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/cache.c mpc.c -ledit -lm -o cache-bench
+ * and run as ./cache-bench [megabytes], which writes a file of that size to
+ * cache-bench.jdl and its cache to cache-bench/, removing both afterwards */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#define BENCH_FILE "cache-bench.jdl"
+#define BENCH_CACHE "cache-bench"
+
+size_t bench_write(size_t size) {
+	/* Write roughly size bytes of typical source code */
+	FILE* f = fopen(BENCH_FILE, "wb");
+	if (!f) { perror(BENCH_FILE); exit(1); }
+	size_t n = 0;
+	for (int i = 0; n < size; i++) {
+		n += fprintf(f,
+			"; Definition number %i\n"
+			"(fun {f%i x y} {\n"
+			"  if (> x %i)\n"
+			"    {+ (* x %i.%i) (- y -%i)}\n"
+			"    {join {\"item %i\\n\" true false} (list x y (head {%i %i %i}))}\n"
+			"})\n",
+			i, i, i, i % 97, i % 13, i % 7, i, i, i + 1, i + 2);
+	}
+	fclose(f);
+	return n;
+}
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each input is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+double bench_mpc(void) {
+	double best = HUGE_VAL;
+	reader_mpc = 1;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		char* err;
+		lval* x = lval_read_file(BENCH_FILE, &err);
+		if (!x) { puts(err); exit(1); }
+		lval_del(x);
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	reader_mpc = 0;
+	return best;
+}
+
+double bench_read(int cache) {
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		lcache* c = cache ? lcache_open(BENCH_FILE) : NULL;
+		lstream* s = cache ? NULL : lstream_open(BENCH_FILE, 1);
+		char* err;
+		lval* x;
+		while ((x = cache ? lcache_next(c, &err) : lstream_next(s, &err))) { lval_del(x); }
+		if (cache) { lcache_close(c); } else { lstream_close(s); }
+		if (err) { puts(err); exit(1); }
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	return best;
+}
+
+int main(int argc, char** argv) {
+	size_t mb = argc > 1 ? atoi(argv[1]) : 2;
+	double size = (double)bench_write(mb << 20) / (1 << 20);
+
+	lispy_init();
+	mkdir(BENCH_CACHE, 0777);
+	cache_dir = BENCH_CACHE;
+
+	printf("%.1f MB of source\n", size);
+	printf("read by mpc:         %8.2f MB/s\n", size / bench_mpc());
+	printf("read from source:    %8.2f MB/s\n", size / bench_read(0));
+	printf("read from cache:     %8.2f MB/s\n", size / bench_read(1));
+	printf("cache hits %li, misses %li\n", cache_hits, cache_misses);
+
+	FILE* f = fopen(BENCH_FILE, "rb");
+	char* input = malloc((mb << 20) + 4096);
+	size_t n = fread(input, 1, (mb << 20) + 4096, f);
+	fclose(f);
+	char* path = lcache_path(input, n);
+	remove(path);
+	remove(BENCH_CACHE);
+	remove(BENCH_FILE);
+	free(path);
+	free(input);
+	lispy_cleanup();
+	return 0;
+}
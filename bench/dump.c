@@ -0,0 +1,112 @@
+/* Time to write a large value to a file and read it back, as printed text
+ * read by MPC and by the hand written reader, and with dump and undump.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/dump.c mpc.c -ledit -lm -o dump-bench
+ * and run as ./dump-bench [rows], which writes dump-bench.jdl and
+ * dump-bench.bin and removes them afterwards */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#include <time.h>
+
+#define BENCH_TEXT "dump-bench.jdl"
+#define BENCH_DUMP "dump-bench.bin"
+
+lval* bench_rows(int count) {
+	/* A result set of rows with a few fields of each type */
+	lval* v = lval_qexpr();
+	for (int i = 0; i < count; i++) {
+		char name[32];
+		sprintf(name, "item %i", i % 100);
+		lval* row = lval_qexpr();
+		lval_add(row, lval_num(i));
+		lval_add(row, lval_dec(i * 0.37));
+		lval_add(row, lval_str(name));
+		lval_add(row, lval_sym(i % 2 ? "odd" : "even"));
+		lval_add(v, row);
+	}
+	return v;
+}
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each path is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+void bench_text(lval* v, int mpc, double* write, double* read) {
+	*write = *read = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		FILE* f = fopen(BENCH_TEXT, "wb");
+		char buf[LOUT_SIZE];
+		lout o = lout_file(f, buf, sizeof(buf));
+		lval_write(&o, v);
+		lout_flush(&o);
+		fclose(f);
+		double t = bench_time(start);
+		if (t < *write) { *write = t; }
+
+		start = clock();
+		char* err;
+		reader_mpc = mpc;
+		lval* x = lval_read_file(BENCH_TEXT, &err);
+		if (!x) { puts(err); exit(1); }
+		t = bench_time(start);
+		if (t < *read) { *read = t; }
+		lval_del(x);
+	}
+}
+
+void bench_dump(lval* v, double* write, double* read) {
+	*write = *read = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		lval* x = image_dump(v, BENCH_DUMP);
+		if (x->type == LVAL_ERR) { lval_println(x); exit(1); }
+		lval_del(x);
+		double t = bench_time(start);
+		if (t < *write) { *write = t; }
+
+		start = clock();
+		x = image_undump(BENCH_DUMP);
+		if (x->type == LVAL_ERR) { lval_println(x); exit(1); }
+		t = bench_time(start);
+		if (t < *read) { *read = t; }
+		lval_del(x);
+	}
+}
+
+long bench_size(char* path) {
+	FILE* f = fopen(path, "rb");
+	fseek(f, 0, SEEK_END);
+	long n = ftell(f);
+	fclose(f);
+	return n;
+}
+
+int main(int argc, char** argv) {
+	int rows = argc > 1 ? atoi(argv[1]) : 250000;
+	lispy_init();
+	lval* v = bench_rows(rows);
+
+	double write, read;
+	bench_text(v, 1, &write, &read);
+	printf("text, mpc:     %6.1f MB, write %7.3f s, read %7.3f s\n",
+		bench_size(BENCH_TEXT) / 1048576.0, write, read);
+	bench_text(v, 0, &write, &read);
+	printf("text, reader:  %6.1f MB, write %7.3f s, read %7.3f s\n",
+		bench_size(BENCH_TEXT) / 1048576.0, write, read);
+	bench_dump(v, &write, &read);
+	printf("dump:          %6.1f MB, write %7.3f s, read %7.3f s\n",
+		bench_size(BENCH_DUMP) / 1048576.0, write, read);
+
+	remove(BENCH_TEXT);
+	remove(BENCH_DUMP);
+	lval_del(v);
+	lispy_cleanup();
+	return 0;
+}
@@ -0,0 +1,69 @@
+/* Time to set up the global environment by loading the standard library
+ * from its source and from a heap image saved from it, as done once at
+ * every start of the interpreter.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/image.c mpc.c -ledit -lm -o image-bench
+ * and run there as ./image-bench [iterations], which writes the image to
+ * image-bench.img and removes it afterwards */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#include <time.h>
+
+#define BENCH_FILE "image-bench.img"
+
+lenv* bench_source(void) {
+	lenv* e = lenv_new();
+	lenv_add_builtins(e);
+	lval_del(builtin_load(e, lval_add(lval_sexpr(), lval_str("stlib.jdl"))));
+	return e;
+}
+
+lenv* bench_image(void) {
+	lenv* e = lenv_new();
+	lval* v = image_load(e, BENCH_FILE);
+	if (v->type == LVAL_ERR) { lval_println(v); exit(1); }
+	lval_del(v);
+	return e;
+}
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each setting is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+double bench_load(lenv*(*load)(void), int n) {
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		for (int j = 0; j < n; j++) { lenv_del(load()); }
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	return best / n;
+}
+
+int main(int argc, char** argv) {
+	int n = argc > 1 ? atoi(argv[1]) : 1000;
+	lispy_init();
+
+	lenv* e = bench_source();
+	lval* v = image_save(e, BENCH_FILE);
+	if (v->type == LVAL_ERR) { lval_println(v); exit(1); }
+	lval_del(v);
+	lenv_del(e);
+
+	struct stat st;
+	stat(BENCH_FILE, &st);
+	printf("image of %i bytes\n", (int)st.st_size);
+	printf("stlib.jdl from source: %8.1f us\n", bench_load(bench_source, n) * 1e6);
+	printf("stlib.jdl from image:  %8.1f us\n", bench_load(bench_image, n) * 1e6);
+
+	remove(BENCH_FILE);
+	lispy_cleanup();
+	return 0;
+}
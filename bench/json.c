@@ -0,0 +1,101 @@
+/* Throughput of reading a large file of JSON records a value at a time,
+ * mapped and in chunks, and of writing them back out.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/json.c mpc.c -ledit -lm -o json-bench
+ * and run as ./json-bench [megabytes], which writes a file of that size to
+ * json-bench.json and removes it afterwards */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#include <time.h>
+
+#define BENCH_FILE "json-bench.json"
+#define BENCH_OUT "json-bench.out.json"
+
+size_t bench_write(size_t size) {
+	/* Write roughly size bytes of records, one to a line */
+	FILE* f = fopen(BENCH_FILE, "wb");
+	if (!f) { perror(BENCH_FILE); exit(1); }
+	size_t n = 0;
+	for (int i = 0; n < size; i++) {
+		n += fprintf(f,
+			"{\"id\": %i, \"name\": \"item %i\", \"price\": %i.%02i, "
+			"\"tags\": [\"red\", \"large\", \"sale \\u00e9\"], \"stock\": %s, "
+			"\"supplier\": {\"name\": \"Supplier\\t%i\", \"rating\": %i.5e-1}, \"note\": null}\n",
+			i, i % 1000, i % 500, i % 100, i % 3 ? "true" : "false", i % 50, i % 10);
+	}
+	fclose(f);
+	return n;
+}
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each input is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+double bench_read(int map) {
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		lstream* s = lstream_open(BENCH_FILE, map);
+		char* err;
+		lval* x;
+		while ((x = json_next(s, &err))) { lval_del(x); }
+		lstream_close(s);
+		if (err) { puts(err); exit(1); }
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	return best;
+}
+
+double bench_write_back(size_t* written) {
+	/* Read every record, then time writing them all out */
+	lstream* s = lstream_open(BENCH_FILE, 1);
+	lval* v = lval_qexpr();
+	char* err;
+	lval* x;
+	while ((x = json_next(s, &err))) { lval_add(v, x); }
+	lstream_close(s);
+
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		FILE* f = fopen(BENCH_OUT, "wb");
+		char buf[LOUT_SIZE];
+		lout o = lout_file(f, buf, sizeof(buf));
+		for (int j = 0; j < v->count; j++) {
+			json_write(&o, v->cell[j]);
+			lout_putc(&o, '\n');
+		}
+		lout_flush(&o);
+		*written = ftell(f);
+		fclose(f);
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	lval_del(v);
+	remove(BENCH_OUT);
+	return best;
+}
+
+int main(int argc, char** argv) {
+	size_t mb = argc > 1 ? atoi(argv[1]) : 16;
+	double size = (double)bench_write(mb << 20) / (1 << 20);
+
+	lispy_init();
+	printf("%.1f MB of JSON\n", size);
+	printf("json-read, chunks:  %8.2f MB/s\n", size / bench_read(0));
+	printf("json-read, mapped:  %8.2f MB/s\n", size / bench_read(1));
+	size_t written;
+	double t = bench_write_back(&written);
+	printf("json-write:         %8.2f MB/s\n", (double)written / (1 << 20) / t);
+
+	remove(BENCH_FILE);
+	lispy_cleanup();
+	return 0;
+}
@@ -0,0 +1,77 @@
+/* Time to take the first element and the sum of a map over a filter, with
+ * the standard library's map and filter, which build every list in full,
+ * and with lazy sequences, along with the most memory held by summing a
+ * long lazy pipeline.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/lazy.c mpc.c -ledit -lm -o lazy-bench
+ * and run there as ./lazy-bench [elements] [millions], the length of the
+ * list given to map and filter and of the long pipeline */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#include <time.h>
+#include <sys/resource.h>
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each program is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+double bench_eval(lenv* e, char* src) {
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		char* err;
+		lval* v = lval_read_string("<bench>", src, &err);
+		if (!v) { puts(err); exit(1); }
+		lval* x = lval_eval(e, lval_take(v, 0));
+		if (x->type == LVAL_ERR) { lval_println(x); exit(1); }
+		lval_del(x);
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	return best;
+}
+
+double bench_maxrss(void) {
+	struct rusage u;
+	getrusage(RUSAGE_SELF, &u);
+	return u.ru_maxrss / 1024.0;
+}
+
+int main(int argc, char** argv) {
+	int n = argc > 1 ? atoi(argv[1]) : 1000;
+	long m = (argc > 2 ? atol(argv[2]) : 5) * 1000000;
+
+	lispy_init();
+	lenv* e = lenv_new();
+	lenv_add_builtins(e);
+	lval_del(builtin_load(e, lval_add(lval_sexpr(), lval_str("stlib.jdl"))));
+
+	char src[256];
+	sprintf(src, "(def {l} (collect (range %i)))", n);
+	bench_eval(e, src);
+	bench_eval(e, "(def {sq} (\\ {x} {* x x}))");
+	bench_eval(e, "(def {big} (\\ {x} {> x 10}))");
+
+	/* The long pipeline runs first, so the most resident is its own */
+	sprintf(src, "(fold + 0 (lazy-map sq (lazy-filter big (range %li))))", m);
+	double t = bench_eval(e, src);
+	printf("%li element pipeline:     %8.3f s, %.2f MB most resident\n", m, t, bench_maxrss());
+
+	printf("%i elements              %8s %10s\n", n, "first", "sum");
+	printf("map and filter:          %8.3f s %8.3f s\n",
+		bench_eval(e, "(fst (map sq (filter big l)))"),
+		bench_eval(e, "(fold + 0 (map sq (filter big l)))"));
+	printf("lazy-map and lazy-filter:%8.3f s %8.3f s\n",
+		bench_eval(e, "(collect (lazy-take 1 (lazy-map sq (lazy-filter big l))))"),
+		bench_eval(e, "(fold + 0 (lazy-map sq (lazy-filter big l)))"));
+
+	lenv_del(e);
+	lispy_cleanup();
+	return 0;
+}
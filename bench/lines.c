@@ -0,0 +1,112 @@
+/* Throughput of reading a large log a line at a time, with stdio's fgets
+ * against file handles mapped and in chunks, and of folding over its lines
+ * in the interpreter, along with the most memory held while doing so.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/lines.c mpc.c -ledit -lm -o lines-bench
+ * and run as ./lines-bench [megabytes], which writes a log of that size to
+ * lines-bench.log and removes it afterwards */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#include <time.h>
+#include <sys/resource.h>
+
+#define BENCH_FILE "lines-bench.log"
+
+size_t bench_write(size_t size) {
+	/* Write roughly size bytes of log lines of varied length */
+	FILE* f = fopen(BENCH_FILE, "wb");
+	if (!f) { perror(BENCH_FILE); exit(1); }
+	size_t n = 0;
+	for (int i = 0; n < size; i++) {
+		n += fprintf(f, "2024-01-%02i 12:%02i:%02i %s request %i took %ims%s\n",
+			i % 28 + 1, i % 60, i / 60 % 60, i % 7 ? "INFO" : "WARN", i, i % 997,
+			i % 5 ? "" : " after retrying against the secondary upstream server");
+	}
+	fclose(f);
+	return n;
+}
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each reader is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+double bench_fgets(void) {
+	double best = HUGE_VAL;
+	long count = 0;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		FILE* f = fopen(BENCH_FILE, "rb");
+		char line[4096];
+		while (fgets(line, sizeof(line), f)) { count++; }
+		fclose(f);
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	if (count == 1) { puts(""); }
+	return best;
+}
+
+double bench_lines(int map) {
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		lfile* h = lfile_open(BENCH_FILE, "r");
+		if (!map) {
+			lstream_close(h->in);
+			h->in = lstream_open(BENCH_FILE, 0);
+		}
+		lval* x;
+		while ((x = lfile_line(h))) { lval_del(x); }
+		lfile_release(h);
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	return best;
+}
+
+double bench_fold(void) {
+	/* Count the lines with fold and a lambda, as a script would */
+	lenv* e = lenv_new();
+	lenv_add_builtins(e);
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		char* err;
+		lval* v = lval_read_string("<bench>",
+			"(fold (\\ {n l} {+ n 1}) 0 (lines \"" BENCH_FILE "\"))", &err);
+		if (!v) { puts(err); exit(1); }
+		lval* x = lval_eval(e, lval_take(v, 0));
+		if (x->type == LVAL_ERR) { lval_println(x); exit(1); }
+		lval_del(x);
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	lenv_del(e);
+	return best;
+}
+
+int main(int argc, char** argv) {
+	size_t mb = argc > 1 ? atoi(argv[1]) : 256;
+	double size = (double)bench_write(mb << 20) / (1 << 20);
+
+	lispy_init();
+	printf("%.1f MB of log\n", size);
+	printf("fgets:              %8.2f MB/s\n", size / bench_fgets());
+	printf("read-line, chunks:  %8.2f MB/s\n", size / bench_lines(0));
+	printf("read-line, mapped:  %8.2f MB/s\n", size / bench_lines(1));
+	printf("fold over lines:    %8.2f MB/s\n", size / bench_fold());
+
+	struct rusage u;
+	getrusage(RUSAGE_SELF, &u);
+	printf("most resident:      %8.2f MB\n", u.ru_maxrss / 1024.0);
+
+	remove(BENCH_FILE);
+	lispy_cleanup();
+	return 0;
+}
@@ -0,0 +1,88 @@
+/* Time to read a large source file through each kind of file input.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/load.c mpc.c -ledit -lm -o load-bench
+ * and run as ./load-bench [megabytes], which writes a file of that size to
+ * load-bench.jdl and removes it afterwards */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#include <time.h>
+
+#define BENCH_FILE "load-bench.jdl"
+
+size_t bench_write(size_t size) {
+	/* Write roughly size bytes of typical source code */
+	FILE* f = fopen(BENCH_FILE, "wb");
+	if (!f) { perror(BENCH_FILE); exit(1); }
+	size_t n = 0;
+	for (int i = 0; n < size; i++) {
+		n += fprintf(f,
+			"; Definition number %i\n"
+			"(fun {f%i x y} {\n"
+			"  if (> x %i)\n"
+			"    {+ (* x %i.%i) (- y -%i)}\n"
+			"    {join {\"item %i\\n\" true false} (list x y (head {%i %i %i}))}\n"
+			"})\n",
+			i, i, i, i % 97, i % 13, i % 7, i, i, i + 1, i + 2);
+	}
+	fclose(f);
+	return n;
+}
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each input is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+double bench_mpc(int map) {
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		FILE* f = fopen(BENCH_FILE, "rb");
+		mpc_result_t r;
+		int ok = map ? mpc_parse_mmap(BENCH_FILE, f, Lispy, &r)
+			: mpc_parse_file(BENCH_FILE, f, Lispy, &r);
+		fclose(f);
+		if (!ok) { mpc_err_print(r.error); exit(1); }
+		mpc_ast_delete(r.output);
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	return best;
+}
+
+double bench_stream(int map) {
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		lstream* s = lstream_open(BENCH_FILE, map);
+		char* err;
+		lval* x;
+		while ((x = lstream_next(s, &err))) { lval_del(x); }
+		lstream_close(s);
+		if (err) { puts(err); exit(1); }
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	return best;
+}
+
+int main(int argc, char** argv) {
+	size_t mb = argc > 1 ? atoi(argv[1]) : 2;
+	double size = (double)bench_write(mb << 20) / (1 << 20);
+
+	lispy_init();
+	printf("%.1f MB of source\n", size);
+	printf("mpc, file input:     %8.2f MB/s\n", size / bench_mpc(0));
+	printf("mpc, mmap input:     %8.2f MB/s\n", size / bench_mpc(1));
+	printf("load, read chunks:   %8.2f MB/s\n", size / bench_stream(0));
+	printf("load, mapped:        %8.2f MB/s\n", size / bench_stream(1));
+
+	remove(BENCH_FILE);
+	lispy_cleanup();
+	return 0;
+}
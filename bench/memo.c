@@ -0,0 +1,77 @@
+/* Parse time of the MPC grammar with and without packrat memoisation,
+ * followed by the hits each grammar rule got from it.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/memo.c mpc.c -ledit -lm -o memo-bench
+ * and run as ./memo-bench [kilobytes] */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#include <time.h>
+
+char* bench_source(size_t size) {
+	/* Generate roughly size bytes of typical source code */
+	char* s = malloc(size + 512);
+	size_t n = 0;
+	for (int i = 0; n < size; i++) {
+		n += sprintf(s + n,
+			"; Definition number %i\n"
+			"(fun {f%i x y} {\n"
+			"  if (> x %i)\n"
+			"    {+ (* x %i.%i) (- y -%i)}\n"
+			"    {join {\"item %i\\n\" true false} (list x y (head {%i %i %i}))}\n"
+			"})\n",
+			i, i, i, i % 97, i % 13, i % 7, i, i, i + 1, i + 2);
+	}
+	return s;
+}
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each setting is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+double bench_mpc(char* src) {
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		mpc_result_t r;
+		if (!mpc_parse("<bench>", src, Lispy, &r)) {
+			mpc_err_print(r.error);
+			exit(1);
+		}
+		mpc_ast_delete(r.output);
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	return best;
+}
+
+void bench_memoise(int on) {
+	mpc_parser_t* rules[] = {
+		Number, Decimal, Boolean, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy
+	};
+	for (int i = 0; i < sizeof(rules) / sizeof(mpc_parser_t*); i++) {
+		if (on) { mpca_memoise(rules[i]); } else { mpc_memoise(rules[i], NULL, NULL); }
+	}
+}
+
+int main(int argc, char** argv) {
+	size_t kb = argc > 1 ? atoi(argv[1]) : 256;
+	char* src = bench_source(kb << 10);
+	double size = (double)strlen(src) / (1 << 20);
+
+	lispy_init();
+	printf("%.2f MB of source\n", size);
+	printf("without memoisation: %8.3f MB/s\n", size / bench_mpc(src));
+	bench_memoise(1);
+	printf("with memoisation:    %8.3f MB/s\n", size / bench_mpc(src));
+	mpc_stats(Lispy);
+
+	free(src);
+	lispy_cleanup();
+	return 0;
+}
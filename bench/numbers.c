@@ -0,0 +1,112 @@
+/* Rate of reading number literals, with the C library's strtol and strtod
+ * against the reader's own, and of reading a file made of them.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/numbers.c mpc.c -ledit -lm -o numbers-bench
+ * and run as ./numbers-bench [millions] */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#include <time.h>
+
+/* Generate count literals, integers or decimals, separated by spaces */
+char* bench_literals(size_t count, int dec) {
+	char* s = malloc(count * 24 + 1);
+	size_t n = 0;
+	unsigned long x = 12345;
+	for (size_t i = 0; i < count; i++) {
+		x = x * 6364136223846793005UL + 1442695040888963407UL;
+		long v = (long)(x >> 33) % 1000000 - 500000;
+		n += dec ? sprintf(s + n, "%ld.%02lu ", v, (x >> 20) % 100)
+			: sprintf(s + n, "%ld ", v >> (x >> 60));
+	}
+	s[n] = '\0';
+	return s;
+}
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each parser is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+double bench_libc(char* src, int dec) {
+	double best = HUGE_VAL;
+	double sum = 0;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		for (char* s = src; *s; s++) {
+			char* end;
+			sum += dec ? strtod(s, &end) : strtol(s, &end, 10);
+			s = end;
+		}
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	if (sum == 0.5) { puts(""); }
+	return best;
+}
+
+double bench_reader(char* src, int dec) {
+	double best = HUGE_VAL;
+	double sum = 0;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		for (char* s = src; *s; s++) {
+			char* end = strchr(s, ' ');
+			if (dec) {
+				double x;
+				lread_double(s, end, &x);
+				sum += x;
+			} else {
+				long x;
+				lread_long(s, end, &x);
+				sum += x;
+			}
+			s = end;
+		}
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	if (sum == 0.5) { puts(""); }
+	return best;
+}
+
+double bench_read(char* src) {
+	/* Read the literals as one big list, the way load would */
+	size_t n = strlen(src);
+	char* list = malloc(n + 3);
+	list[0] = '{';
+	memcpy(list + 1, src, n);
+	strcpy(list + n + 1, "}");
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		char* err;
+		lval* x = lval_read_string("<bench>", list, &err);
+		if (!x) { puts(err); exit(1); }
+		lval_del(x);
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	free(list);
+	return best;
+}
+
+int main(int argc, char** argv) {
+	size_t count = (argc > 1 ? atoi(argv[1]) : 2) * 1000000;
+	lispy_init();
+	printf("%-8s %12s %12s %12s\n", "literal", "libc M/s", "reader M/s", "read MB/s");
+	for (int dec = 0; dec < 2; dec++) {
+		char* src = bench_literals(count, dec);
+		double m = (double)count / 1e6;
+		printf("%-8s %12.2f %12.2f %12.2f\n", dec ? "decimal" : "integer",
+			m / bench_libc(src, dec), m / bench_reader(src, dec),
+			(double)strlen(src) / (1 << 20) / bench_read(src));
+		free(src);
+	}
+	lispy_cleanup();
+	return 0;
+}
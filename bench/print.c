@@ -0,0 +1,85 @@
+/* Rate of formatting numbers with printf against the interpreter's own
+ * formatting, and of printing a long list of them.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/print.c mpc.c -ledit -lm -o print-bench
+ * and run as ./print-bench [millions] > /dev/null, which prints the times
+ * to stderr */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#include <time.h>
+
+/* Fill a list with count numbers or decimals of varied size */
+lval* bench_numbers(size_t count, int dec) {
+	lval* v = lval_qexpr();
+	unsigned long x = 12345;
+	for (size_t i = 0; i < count; i++) {
+		x = x * 6364136223846793005UL + 1442695040888963407UL;
+		long n = (long)(x >> 33) % 1000000 - 500000;
+		lval_add(v, dec ? lval_dec(n / 1000.0) : lval_num(n >> (x >> 60)));
+	}
+	return v;
+}
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each formatter is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+double bench_format(lval* v, char* fmt) {
+	double best = HUGE_VAL;
+	size_t total = 0;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		char buf[LFMT_SIZE];
+		for (int j = 0; j < v->count; j++) {
+			lval* x = v->cell[j];
+			if (fmt) {
+				total += x->type == LVAL_NUM ? snprintf(buf, sizeof(buf), fmt, x->num)
+					: snprintf(buf, sizeof(buf), fmt, x->dec);
+			} else {
+				total += x->type == LVAL_NUM ? lfmt_long(buf, x->num)
+					: lfmt_double(buf, x->dec);
+			}
+		}
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	if (total == 1) { puts(""); }
+	return best;
+}
+
+double bench_print(lval* v) {
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		lval_println(v);
+		fflush(stdout);
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	return best;
+}
+
+int main(int argc, char** argv) {
+	size_t count = (argc > 1 ? atoi(argv[1]) : 2) * 1000000;
+	double m = (double)count / 1e6;
+
+	lval* nums = bench_numbers(count, 0);
+	fprintf(stderr, "integers, printf %%li:   %8.2f M/s\n", m / bench_format(nums, "%li"));
+	fprintf(stderr, "integers, lfmt_long:    %8.2f M/s\n", m / bench_format(nums, NULL));
+	fprintf(stderr, "integers, lval_print:   %8.2f M/s\n", m / bench_print(nums));
+	lval_del(nums);
+
+	lval* decs = bench_numbers(count, 1);
+	fprintf(stderr, "decimals, printf %%f:    %8.2f M/s\n", m / bench_format(decs, "%f"));
+	fprintf(stderr, "decimals, printf %%.17g: %8.2f M/s\n", m / bench_format(decs, "%.17g"));
+	fprintf(stderr, "decimals, lfmt_double:  %8.2f M/s\n", m / bench_format(decs, NULL));
+	fprintf(stderr, "decimals, lval_print:   %8.2f M/s\n", m / bench_print(decs));
+	lval_del(decs);
+	return 0;
+}
@@ -0,0 +1,90 @@
+/* Parse throughput of the hand written reader against mpc, with mpc's AST
+ * built through malloc and in the reader's arena.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/read.c mpc.c -ledit -lm -o read-bench
+ * and run as ./read-bench [megabytes] */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#include <time.h>
+
+char* bench_source(size_t size) {
+	/* Generate roughly size bytes of typical source code */
+	char* s = malloc(size + 512);
+	size_t n = 0;
+	for (int i = 0; n < size; i++) {
+		n += sprintf(s + n,
+			"; Definition number %i\n"
+			"(fun {f%i x y} {\n"
+			"  if (> x %i)\n"
+			"    {+ (* x %i.%i) (- y -%i)}\n"
+			"    {join {\"item %i\\n\" true false} (list x y (head {%i %i %i}))}\n"
+			"})\n",
+			i, i, i, i % 97, i % 13, i % 7, i, i, i + 1, i + 2);
+	}
+	return s;
+}
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each reader is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+double bench_hand(char* src, size_t len) {
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		lval* x = lread(src, len);
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+		lval_del(x);
+	}
+	return best;
+}
+
+double bench_mpc(char* src, int arena) {
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		mpc_result_t r;
+		if (arena) { mpc_arena_use(reader_arena); }
+		if (!mpc_parse("<bench>", src, Lispy, &r)) {
+			mpc_err_print(r.error);
+			exit(1);
+		}
+		lval* x = lval_read(r.output);
+		if (arena) {
+			mpc_arena_use(NULL);
+			reader_arena_used = mpc_arena_used(reader_arena);
+			mpc_arena_clear(reader_arena);
+		} else {
+			mpc_ast_delete(r.output);
+		}
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+		lval_del(x);
+	}
+	return best;
+}
+
+int main(int argc, char** argv) {
+	size_t mb = argc > 1 ? atoi(argv[1]) : 1;
+	char* src = bench_source(mb << 20);
+	size_t len = strlen(src);
+	double size = (double)len / (1 << 20);
+
+	lispy_init();
+	printf("%.1f MB of source\n", size);
+	printf("hand written reader: %8.2f MB/s\n", size / bench_hand(src, len));
+	printf("mpc and lval_read:   %8.2f MB/s\n", size / bench_mpc(src, 0));
+	printf("mpc in an arena:     %8.2f MB/s\n", size / bench_mpc(src, 1));
+	printf("arena bytes used:    %8.2f MB\n", (double)reader_arena_used / (1 << 20));
+
+	free(src);
+	lispy_cleanup();
+	return 0;
+}
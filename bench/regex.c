@@ -0,0 +1,90 @@
+/* Tokenizing throughput of the grammar's regexes, compiled to DFAs
+ * against the parsers they are built from.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/regex.c -lm -o regex-bench
+ * and run as ./regex-bench [kilobytes] */
+
+#include "../mpc.c"
+
+#include <time.h>
+
+typedef struct {
+	const char* name;
+	const char* re;
+	const char* tokens[4];
+} bench_rule;
+
+/* The token rules of the grammar in src.c with some typical input */
+bench_rule bench_rules[] = {
+	{ "number",  "-?[0-9]+",                         { "42", "-7", "100000", "3" } },
+	{ "decimal", "-?[0-9]+\\.[0-9]*",                { "3.14", "-0.5", "100.", "2.718281" } },
+	{ "symbol",  "[a-zA-Z0-9_+\\-*\\/\\\\=<>!&|]+",  { "head", "+", "list-length", "<=" } },
+	{ "string",  "\"(\\\\.|[^\"])*\"",               { "\"item\"", "\"a \\\"b\\\"\"", "\"\"", "\"x\\n\"" } },
+	{ "comment", ";[^\\r\\n]*",                      { "; note\n", ";\n", "; a longer comment\n", ";;\n" } },
+};
+
+char* bench_input(bench_rule* b, size_t size) {
+	char* s = malloc(size + 64);
+	size_t n = 0;
+	for (int i = 0; n < size; i++) {
+		n += sprintf(s + n, "%s ", b->tokens[i % 4]);
+	}
+	return s;
+}
+
+mpc_parser_t* bench_uncompiled(const char* re) {
+	/* Take the parser a compiled regex was built from */
+	mpc_parser_t* p = mpc_re(re);
+	if (p->type != MPC_TYPE_DFA) { return p; }
+	mpc_parser_t* x = p->data.dfa.x;
+	free(p->data.dfa.trans);
+	free(p->data.dfa.accept);
+	free(p);
+	return x;
+}
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each parser is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+double bench_tokens(mpc_parser_t* re, char* src) {
+	mpc_parser_t* tokens = mpc_many(mpcf_freefold, mpc_tok(re));
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		mpc_result_t r;
+		if (!mpc_parse("<bench>", src, tokens, &r)) {
+			mpc_err_print(r.error);
+			exit(1);
+		}
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	mpc_delete(tokens);
+	return best;
+}
+
+int main(int argc, char** argv) {
+	size_t kb = argc > 1 ? atoi(argv[1]) : 1024;
+	printf("%-8s %12s %12s\n", "rule", "parser MB/s", "DFA MB/s");
+	for (size_t i = 0; i < sizeof(bench_rules) / sizeof(bench_rule); i++) {
+		bench_rule* b = &bench_rules[i];
+		char* src = bench_input(b, kb << 10);
+		double size = (double)strlen(src) / (1 << 20);
+
+		mpc_parser_t* compiled = mpc_re(b->re);
+		double before = size / bench_tokens(bench_uncompiled(b->re), src);
+		if (compiled->type == MPC_TYPE_DFA) {
+			printf("%-8s %12.2f %12.2f\n", b->name, before, size / bench_tokens(compiled, src));
+		} else {
+			printf("%-8s %12.2f %12s\n", b->name, before, "-");
+			mpc_delete(compiled);
+		}
+		free(src);
+	}
+	return 0;
+}
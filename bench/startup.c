@@ -0,0 +1,40 @@
+/* Time to set up the MPC grammar from its table in grammar.h and from its
+ * text, as done once at every start of the interpreter.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/startup.c mpc.c -ledit -lm -o startup-bench
+ * and run as ./startup-bench [iterations] */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#include <time.h>
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each setting is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+double bench_init(int table, int n) {
+	double best = HUGE_VAL;
+	grammar_table = table;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		for (int j = 0; j < n; j++) {
+			lispy_init();
+			lispy_cleanup();
+		}
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	return best / n;
+}
+
+int main(int argc, char** argv) {
+	int n = argc > 1 ? atoi(argv[1]) : 1000;
+	printf("grammar from table: %8.1f us\n", bench_init(1, n) * 1e6);
+	printf("grammar from text:  %8.1f us\n", bench_init(0, n) * 1e6);
+	return 0;
+}
@@ -0,0 +1,70 @@
+/* Time to read one long string literal and one long comment with mpc, and
+ * the string with the hand written reader, for doubling lengths. Each should
+ * read at a steady rate as they grow.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/strings.c mpc.c -ledit -lm -o strings-bench
+ * and run as ./strings-bench [megabytes] for the longest */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#include <time.h>
+
+char* bench_source(size_t size, int comment) {
+	/* A string literal or comment of size characters, a few of them escapes */
+	char* s = malloc(size + 8);
+	size_t n = 0;
+	s[n++] = comment ? ';' : '"';
+	while (n < size) {
+		if (!comment && n % 64 == 0) { s[n++] = '\\'; s[n++] = 'n'; }
+		else { s[n++] = "abcdefgh "[n % 9]; }
+	}
+	if (comment) { s[n++] = '\n'; s[n++] = '1'; } else { s[n++] = '"'; }
+	s[n] = '\0';
+	return s;
+}
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+double bench_hand(char* src) {
+	clock_t start = clock();
+	lval* x = lread(src, strlen(src));
+	if (!x) { puts("Unreadable input"); exit(1); }
+	lval_del(x);
+	return bench_time(start);
+}
+
+double bench_read(char* src) {
+	clock_t start = clock();
+	mpc_result_t r;
+	if (!mpc_parse("<bench>", src, Lispy, &r)) {
+		mpc_err_print(r.error);
+		exit(1);
+	}
+	lval* x = lval_read(r.output);
+	mpc_ast_delete(r.output);
+	lval_del(x);
+	return bench_time(start);
+}
+
+int main(int argc, char** argv) {
+	size_t mb = argc > 1 ? atoi(argv[1]) : 8;
+
+	lispy_init();
+	printf("%10s %14s %14s %14s\n", "KB", "string MB/s", "comment MB/s", "reader MB/s");
+	for (size_t kb = 64; kb <= mb << 10; kb *= 2) {
+		char* s = bench_source(kb << 10, 0);
+		char* c = bench_source(kb << 10, 1);
+		double size = (double)kb / 1024;
+		printf("%10zu %14.2f %14.2f %14.2f\n", kb,
+			size / bench_read(s), size / bench_read(c), size / bench_hand(s));
+		free(s);
+		free(c);
+	}
+
+	lispy_cleanup();
+	return 0;
+}
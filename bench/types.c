@@ -0,0 +1,66 @@
+/* Time for a loop summing with loop and recur, defined with the optimiser
+ * and type inference and with neither, along with the call sites type
+ * inference gave specialised builtins. The JIT is switched off, so only
+ * the interpreter runs the loop.
+ *
+ * Build from the repository root with
+ *   cc -std=c99 -O2 bench/types.c mpc.c -ledit -lm -o types-bench
+ * and run there as ./types-bench [iterations] */
+
+#define JDLISP_NO_MAIN
+#include "../src.c"
+
+#include <time.h>
+
+double bench_time(clock_t start) {
+	return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* Each setting is timed over a few runs, taking the fastest */
+#define BENCH_RUNS 3
+
+lval* bench_eval(lenv* e, char* src) {
+	char* err;
+	lval* v = lval_read_string("<bench>", src, &err);
+	if (!v) { puts(err); exit(1); }
+	lval* x = lval_eval(e, lval_take(v, 0));
+	if (x->type == LVAL_ERR) { lval_println(x); exit(1); }
+	return x;
+}
+
+double bench_loop(lenv* e, int optimise, long n) {
+	opt_enabled = optimise;
+	lval_del(bench_eval(e,
+		"(fun {sum-to n} {loop {i acc} 0 0 "
+		"{if (< i n) {recur (+ i 1) (+ acc (* i 2))} {acc}}})"));
+
+	char src[64];
+	sprintf(src, "(sum-to %li)", n);
+	double best = HUGE_VAL;
+	for (int i = 0; i < BENCH_RUNS; i++) {
+		clock_t start = clock();
+		lval_del(bench_eval(e, src));
+		double t = bench_time(start);
+		if (t < best) { best = t; }
+	}
+	return best;
+}
+
+int main(int argc, char** argv) {
+	long n = argc > 1 ? atol(argv[1]) : 300000;
+
+	lispy_init();
+	jit_enabled = 0;
+	lenv* e = lenv_new();
+	lenv_add_builtins(e);
+
+	double typed = bench_loop(e, 1, n);
+	printf("%i call sites specialised, %i left generic\n", ty_specialised, ty_generic);
+	printf("%li iterations\n", n);
+	printf("optimised:   %8.3f s\n", typed);
+	printf("--no-opt:    %8.3f s\n", bench_loop(e, 0, n));
+
+	lenv_del(e);
+	lispy_cleanup();
+	return 0;
+}
@@ -0,0 +1,324 @@
+/* Parser table written by mpc_table_print */
+
+static const int lispy_table_links[] = {
+  10, 11, 1, 12, 13, 1, 14, 15, 16, 17, 1, 18, 19, 1, 20, 21,
+  1, 22, 23, 24, 33, 33, 25, 26, 27, 33, 33, 28, 29, 30, 31, 32,
+  33, 34, 35, 36, 37, 38, 33, 33, 41, 42, 1, 43, 44, 1, 48, 49,
+  1, 51, 52, 1, 53, 54, 1, 56, 57, 1, 58, 59, 1, 60, 61, 1,
+  62, 63, 1, 64, 65, 1, 66, 67, 1, 68, 69, 1, 70, 71, 1, 72,
+  73, 1, 74, 75, 1, 77, 78, 1, 87, 88, 1, 91, 92, 1, 103, 104,
+  1, 106, 107, 3, 108, 109, 3, 112, 113, 3, 114, 115, 3, 116, 117, 3,
+  131, 132, 3, 133, 134, 3, 141, 142, 3, 143, 144, 3, 145, 146, 3, 147,
+  148, 3, 149, 150, 3, 151, 152, 3, 153, 154, 1, 156, 157, 158, 159, 1,
+  1, 1, 167, 168, 169, 1, 1, 171, 172, 1, 209, 210, 1, 212, 213, 225,
+  226, 236, 237, 1, 238, 239, 1, 246, 247, 1,
+};
+
+static const mpc_table_node_t lispy_table_nodes[] = {
+  { 24, 2, 0, 32, 0, NULL, NULL }, /* number */
+  { 24, 2, 3, 32, 0, NULL, NULL }, /* decimal */
+  { 23, 2, 6, 0, 0, NULL, NULL }, /* boolean */
+  { 24, 2, 8, 32, 0, NULL, NULL }, /* symbol */
+  { 24, 2, 11, 32, 0, NULL, NULL }, /* string */
+  { 24, 2, 14, 32, 0, NULL, NULL }, /* comment */
+  { 24, 3, 17, 30, 0, NULL, NULL }, /* sexpr */
+  { 24, 3, 22, 30, 0, NULL, NULL }, /* qexpr */
+  { 23, 8, 27, 0, 0, NULL, NULL }, /* expr */
+  { 24, 3, 35, 30, 0, NULL, NULL }, /* lispy */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 16, 0, 39, 35, 0, "regex", NULL }, /* mpc_ast_tag */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 16, 0, 40, 35, 0, "regex", NULL }, /* mpc_ast_tag */
+  { 24, 2, 40, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 24, 2, 43, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 16, 0, 45, 35, 0, "regex", NULL }, /* mpc_ast_tag */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 16, 0, 46, 35, 0, "regex", NULL }, /* mpc_ast_tag */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 16, 0, 47, 35, 0, "regex", NULL }, /* mpc_ast_tag */
+  { 24, 2, 46, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 20, 0, 50, 30, 0, NULL, NULL }, /* mpcf_fold_ast */
+  { 24, 2, 49, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 24, 2, 52, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 20, 0, 55, 30, 0, NULL, NULL }, /* mpcf_fold_ast */
+  { 24, 2, 55, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 24, 2, 58, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 24, 2, 61, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 24, 2, 64, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 24, 2, 67, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 24, 2, 70, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 24, 2, 73, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 24, 2, 76, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 24, 2, 79, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 24, 2, 82, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 20, 0, 76, 30, 0, NULL, NULL }, /* mpcf_fold_ast */
+  { 24, 2, 85, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 15, 0, 79, 31, 0, NULL, NULL }, /* mpcf_str_ast */
+  { 15, 0, 80, 31, 0, NULL, NULL }, /* mpcf_str_ast */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 16, 0, 81, 35, 0, "string", NULL }, /* mpc_ast_tag */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 16, 0, 82, 35, 0, "string", NULL }, /* mpc_ast_tag */
+  { 15, 0, 83, 31, 0, NULL, NULL }, /* mpcf_str_ast */
+  { 15, 0, 84, 31, 0, NULL, NULL }, /* mpcf_str_ast */
+  { 15, 0, 85, 31, 0, NULL, NULL }, /* mpcf_str_ast */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 16, 0, 86, 35, 0, "char", NULL }, /* mpc_ast_tag */
+  { 24, 2, 88, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 16, 0, 89, 35, 0, "char", NULL }, /* mpc_ast_tag */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 16, 0, 90, 35, 0, "char", NULL }, /* mpc_ast_tag */
+  { 24, 2, 91, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 16, 0, 93, 35, 0, "char", NULL }, /* mpc_ast_tag */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 15, 0, 94, 37, 0, NULL, NULL }, /* mpc_ast_add_root */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 15, 0, 95, 37, 0, NULL, NULL }, /* mpc_ast_add_root */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 15, 0, 96, 37, 0, NULL, NULL }, /* mpc_ast_add_root */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 15, 0, 97, 37, 0, NULL, NULL }, /* mpc_ast_add_root */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 15, 0, 98, 37, 0, NULL, NULL }, /* mpc_ast_add_root */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 15, 0, 99, 37, 0, NULL, NULL }, /* mpc_ast_add_root */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 15, 0, 100, 37, 0, NULL, NULL }, /* mpc_ast_add_root */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 15, 0, 101, 37, 0, NULL, NULL }, /* mpc_ast_add_root */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 16, 0, 102, 35, 0, "regex", NULL }, /* mpc_ast_tag */
+  { 24, 2, 94, 32, 0, NULL, NULL }, /* mpcf_state_ast */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 16, 0, 105, 35, 0, "regex", NULL }, /* mpc_ast_tag */
+  { 24, 2, 97, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 24, 2, 100, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 15, 0, 110, 31, 0, NULL, NULL }, /* mpcf_str_ast */
+  { 15, 0, 111, 31, 0, NULL, NULL }, /* mpcf_str_ast */
+  { 24, 2, 103, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 24, 2, 106, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 24, 2, 109, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 15, 0, 118, 31, 0, NULL, NULL }, /* mpcf_str_ast */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 15, 0, 119, 37, 0, NULL, NULL }, /* mpc_ast_add_root */
+  { 15, 0, 120, 31, 0, NULL, NULL }, /* mpcf_str_ast */
+  { 15, 0, 121, 31, 0, NULL, NULL }, /* mpcf_str_ast */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 15, 0, 122, 37, 0, NULL, NULL }, /* mpc_ast_add_root */
+  { 15, 0, 123, 31, 0, NULL, NULL }, /* mpcf_str_ast */
+  { 16, 0, 1, 36, 0, "decimal", NULL }, /* mpc_ast_add_tag */
+  { 16, 0, 0, 36, 0, "number", NULL }, /* mpc_ast_add_tag */
+  { 16, 0, 2, 36, 0, "boolean", NULL }, /* mpc_ast_add_tag */
+  { 16, 0, 3, 36, 0, "symbol", NULL }, /* mpc_ast_add_tag */
+  { 16, 0, 4, 36, 0, "string", NULL }, /* mpc_ast_add_tag */
+  { 16, 0, 5, 36, 0, "comment", NULL }, /* mpc_ast_add_tag */
+  { 16, 0, 6, 36, 0, "sexpr", NULL }, /* mpc_ast_add_tag */
+  { 16, 0, 7, 36, 0, "qexpr", NULL }, /* mpc_ast_add_tag */
+  { 15, 0, 124, 31, 0, NULL, NULL }, /* mpcf_str_ast */
+  { 7, 0, 0, 0, 0, NULL, NULL },
+  { 15, 0, 125, 37, 0, NULL, NULL }, /* mpc_ast_add_root */
+  { 15, 0, 126, 31, 0, NULL, NULL }, /* mpcf_str_ast */
+  { 29, 3, 127, 0, 0, "\000\000\001",
+    (const unsigned char *)
+    "\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\001\377\377\002\002\002\002\002\002\002\002\002\002\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377"
+    "\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\002\002\002\002\002\002\002\002\002\002\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377"
+    "\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\002\002\002\002\002\002\002\002\002\002\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377" },
+  { 5, 0, 128, 0, 0, "whitespace", NULL },
+  { 29, 5, 129, 0, 0, "\000\000\000\001\001",
+    (const unsigned char *)
+    "\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\001\377\377\002\002\002\002\002\002\002\002\002\002\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377"
+    "\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\002\002\002\002\002\002\002\002\002\002\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377"
+    "\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\003\377\002\002\002\002\002\002\002\002\002\002\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377"
+    "\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\004\004\004\004\004\004\004\004\004\004\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377"
+    "\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\004\004\004\004\004\004\004\004\004\004\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377" },
+  { 5, 0, 130, 0, 0, "whitespace", NULL },
+  { 24, 2, 112, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 24, 2, 115, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 29, 2, 135, 0, 0, "\000\001",
+    (const unsigned char *)
+    "\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\001\377\377\377\377\001\377\377\377\001\001\377\001\377\001\001\001\001\001\001\001\001\001\001\001\377\377\001\001\001\377\377\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\377\001\377\377\001\377\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\377\001\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377"
+    "\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\001\377\377\377\377\001\377\377\377\001\001\377\001\377\001\001\001\001\001\001\001\001\001\001\001\377\377\001\001\001\377\377\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\377\001\377\377\001\377\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\001\377\001\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377" },
+  { 5, 0, 136, 0, 0, "whitespace", NULL },
+  { 30, 0, 137, 0, 0, NULL, NULL },
+  { 5, 0, 138, 0, 0, "whitespace", NULL },
+  { 29, 3, 139, 0, 0, "\000\001\001",
+    (const unsigned char *)
+    "\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\001\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377\377"
+    "\377\002\002\002\002\002\002\002\002\002\377\002\002\377\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002"
+    "\377\002\002\002\002\002\002\002\002\002\377\002\002\377\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002\002" },
+  { 5, 0, 140, 0, 0, "whitespace", NULL },
+  { 24, 2, 118, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 16, 0, 8, 36, 0, "expr", NULL }, /* mpc_ast_add_tag */
+  { 24, 2, 121, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 24, 2, 124, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 16, 0, 8, 36, 0, "expr", NULL }, /* mpc_ast_add_tag */
+  { 24, 2, 127, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 24, 2, 130, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 16, 0, 8, 36, 0, "expr", NULL }, /* mpc_ast_add_tag */
+  { 24, 2, 133, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 24, 2, 136, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 15, 0, 155, 2, 0, NULL, NULL }, /* mpcf_free */
+  { 24, 4, 139, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 15, 0, 160, 2, 0, NULL, NULL }, /* mpcf_free */
+  { 5, 0, 161, 0, 0, "\042true\042", NULL },
+  { 5, 0, 162, 0, 0, "whitespace", NULL },
+  { 5, 0, 163, 0, 0, "\042false\042", NULL },
+  { 5, 0, 164, 0, 0, "whitespace", NULL },
+  { 21, 0, 165, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 15, 0, 166, 2, 0, NULL, NULL }, /* mpcf_free */
+  { 24, 3, 146, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 15, 0, 170, 2, 0, NULL, NULL }, /* mpcf_free */
+  { 24, 2, 151, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 15, 0, 173, 2, 0, NULL, NULL }, /* mpcf_free */
+  { 5, 0, 174, 0, 0, "'('", NULL },
+  { 5, 0, 175, 0, 0, "whitespace", NULL },
+  { 5, 0, 176, 0, 0, "')'", NULL },
+  { 5, 0, 177, 0, 0, "whitespace", NULL },
+  { 5, 0, 178, 0, 0, "'{'", NULL },
+  { 5, 0, 179, 0, 0, "whitespace", NULL },
+  { 5, 0, 180, 0, 0, "'}'", NULL },
+  { 5, 0, 181, 0, 0, "whitespace", NULL },
+  { 30, 0, 182, 0, 0, NULL, NULL },
+  { 5, 0, 183, 0, 0, "whitespace", NULL },
+  { 30, 0, 184, 0, 0, NULL, NULL },
+  { 5, 0, 185, 0, 0, "whitespace", NULL },
+  { 19, 0, 186, 5, 0, NULL, NULL }, /* mpcf_ctor_str */
+  { 21, 0, 187, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 5, 0, 188, 0, 0, "spaces", NULL },
+  { 19, 0, 189, 5, 0, NULL, NULL }, /* mpcf_ctor_str */
+  { 21, 0, 190, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 5, 0, 191, 0, 0, "'.'", NULL },
+  { 20, 0, 192, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 5, 0, 193, 0, 0, "spaces", NULL },
+  { 14, 0, 0, 0, 0, "true", NULL },
+  { 15, 0, 194, 2, 0, NULL, NULL }, /* mpcf_free */
+  { 14, 0, 0, 0, 0, "false", NULL },
+  { 15, 0, 195, 2, 0, NULL, NULL }, /* mpcf_free */
+  { 5, 0, 196, 0, 0, "one of 'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_+-*/\134=<>!&|'", NULL },
+  { 5, 0, 197, 0, 0, "spaces", NULL },
+  { 5, 0, 198, 0, 0, "'\042'", NULL },
+  { 20, 0, 199, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 5, 0, 200, 0, 0, "'\042'", NULL },
+  { 5, 0, 201, 0, 0, "spaces", NULL },
+  { 5, 0, 202, 0, 0, "';'", NULL },
+  { 20, 0, 203, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 5, 0, 204, 0, 0, "spaces", NULL },
+  { 9, 1, 0, 0, 0, "(", NULL },
+  { 15, 0, 205, 2, 0, NULL, NULL }, /* mpcf_free */
+  { 9, 1, 0, 0, 0, ")", NULL },
+  { 15, 0, 206, 2, 0, NULL, NULL }, /* mpcf_free */
+  { 9, 1, 0, 0, 0, "{", NULL },
+  { 15, 0, 207, 2, 0, NULL, NULL }, /* mpcf_free */
+  { 9, 1, 0, 0, 0, "}", NULL },
+  { 15, 0, 208, 2, 0, NULL, NULL }, /* mpcf_free */
+  { 24, 2, 154, 8, 0, NULL, NULL }, /* mpcf_snd */
+  { 15, 0, 211, 2, 0, NULL, NULL }, /* mpcf_free */
+  { 23, 2, 157, 0, 0, NULL, NULL },
+  { 15, 0, 214, 2, 0, NULL, NULL }, /* mpcf_free */
+  { 5, 0, 215, 0, 0, "'-'", NULL },
+  { 5, 0, 216, 0, 0, "one of '0123456789'", NULL },
+  { 20, 0, 217, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 5, 0, 218, 0, 0, "'-'", NULL },
+  { 5, 0, 219, 0, 0, "one of '0123456789'", NULL },
+  { 9, 1, 0, 0, 0, ".", NULL },
+  { 5, 0, 220, 0, 0, "one of '0123456789'", NULL },
+  { 20, 0, 221, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 5, 0, 222, 0, 0, "spaces", NULL },
+  { 5, 0, 223, 0, 0, "spaces", NULL },
+  { 10, 0, 0, 0, 0, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_+-*/\134=<>!&|", NULL },
+  { 20, 0, 224, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 9, 1, 0, 0, 0, "\042", NULL },
+  { 23, 2, 159, 0, 0, NULL, NULL },
+  { 9, 1, 0, 0, 0, "\042", NULL },
+  { 20, 0, 227, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 9, 1, 0, 0, 0, ";", NULL },
+  { 5, 0, 228, 0, 0, "none of '\015\012'", NULL },
+  { 20, 0, 229, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 5, 0, 230, 0, 0, "spaces", NULL },
+  { 5, 0, 231, 0, 0, "spaces", NULL },
+  { 5, 0, 232, 0, 0, "spaces", NULL },
+  { 5, 0, 233, 0, 0, "spaces", NULL },
+  { 5, 0, 234, 0, 0, "start of input", NULL },
+  { 3, 0, 0, 5, 0, NULL, NULL }, /* mpcf_ctor_str */
+  { 5, 0, 235, 0, 0, "spaces", NULL },
+  { 24, 2, 161, 7, 0, NULL, NULL }, /* mpcf_fst */
+  { 24, 2, 164, 8, 0, NULL, NULL }, /* mpcf_snd */
+  { 5, 0, 240, 0, 0, "spaces", NULL },
+  { 9, 1, 0, 0, 0, "-", NULL },
+  { 10, 0, 0, 0, 0, "0123456789", NULL },
+  { 5, 0, 241, 0, 0, "whitespace", NULL },
+  { 9, 1, 0, 0, 0, "-", NULL },
+  { 10, 0, 0, 0, 0, "0123456789", NULL },
+  { 10, 0, 0, 0, 0, "0123456789", NULL },
+  { 5, 0, 242, 0, 0, "whitespace", NULL },
+  { 20, 0, 243, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 20, 0, 244, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 5, 0, 245, 0, 0, "whitespace", NULL },
+  { 24, 2, 167, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 5, 0, 248, 0, 0, "none of '\042'", NULL },
+  { 5, 0, 249, 0, 0, "whitespace", NULL },
+  { 11, 0, 0, 0, 0, "\015\012", NULL },
+  { 5, 0, 250, 0, 0, "whitespace", NULL },
+  { 20, 0, 251, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 20, 0, 252, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 20, 0, 253, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 20, 0, 254, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 27, 0, 0, 0, 0, NULL, NULL },
+  { 20, 0, 255, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 5, 0, 256, 0, 0, "newline", NULL },
+  { 5, 0, 257, 0, 0, "end of input", NULL },
+  { 5, 0, 258, 0, 0, "end of input", NULL },
+  { 3, 0, 0, 5, 0, NULL, NULL }, /* mpcf_ctor_str */
+  { 20, 0, 259, 14, 0, NULL, NULL }, /* mpcf_strfold */
+  { 5, 0, 260, 0, 0, "one of ' \014\012\015\011\013'", NULL },
+  { 5, 0, 261, 0, 0, "one of ' \014\012\015\011\013'", NULL },
+  { 5, 0, 262, 0, 0, "whitespace", NULL },
+  { 5, 0, 263, 0, 0, "whitespace", NULL },
+  { 5, 0, 264, 0, 0, "one of ' \014\012\015\011\013'", NULL },
+  { 5, 0, 265, 0, 0, "'\134'", NULL },
+  { 5, 0, 266, 0, 0, "any character except a newline", NULL },
+  { 11, 0, 0, 0, 0, "\042", NULL },
+  { 5, 0, 267, 0, 0, "one of ' \014\012\015\011\013'", NULL },
+  { 5, 0, 268, 0, 0, "one of ' \014\012\015\011\013'", NULL },
+  { 5, 0, 269, 0, 0, "whitespace", NULL },
+  { 5, 0, 270, 0, 0, "whitespace", NULL },
+  { 5, 0, 271, 0, 0, "whitespace", NULL },
+  { 5, 0, 272, 0, 0, "whitespace", NULL },
+  { 5, 0, 273, 0, 0, "whitespace", NULL },
+  { 5, 0, 274, 0, 0, "'\012'", NULL },
+  { 28, 0, 0, 0, 0, NULL, NULL },
+  { 28, 0, 0, 0, 0, NULL, NULL },
+  { 5, 0, 275, 0, 0, "whitespace", NULL },
+  { 10, 0, 0, 0, 0, " \014\012\015\011\013", NULL },
+  { 10, 0, 0, 0, 0, " \014\012\015\011\013", NULL },
+  { 5, 0, 276, 0, 0, "one of ' \014\012\015\011\013'", NULL },
+  { 5, 0, 277, 0, 0, "one of ' \014\012\015\011\013'", NULL },
+  { 10, 0, 0, 0, 0, " \014\012\015\011\013", NULL },
+  { 9, 1, 0, 0, 0, "\134", NULL },
+  { 5, 0, 278, 0, 0, "none of '\012'", NULL },
+  { 10, 0, 0, 0, 0, " \014\012\015\011\013", NULL },
+  { 10, 0, 0, 0, 0, " \014\012\015\011\013", NULL },
+  { 5, 0, 279, 0, 0, "one of ' \014\012\015\011\013'", NULL },
+  { 5, 0, 280, 0, 0, "one of ' \014\012\015\011\013'", NULL },
+  { 5, 0, 281, 0, 0, "one of ' \014\012\015\011\013'", NULL },
+  { 5, 0, 282, 0, 0, "one of ' \014\012\015\011\013'", NULL },
+  { 5, 0, 283, 0, 0, "one of ' \014\012\015\011\013'", NULL },
+  { 9, 1, 0, 0, 0, "\012", NULL },
+  { 5, 0, 284, 0, 0, "one of ' \014\012\015\011\013'", NULL },
+  { 10, 0, 0, 0, 0, " \014\012\015\011\013", NULL },
+  { 10, 0, 0, 0, 0, " \014\012\015\011\013", NULL },
+  { 11, 0, 0, 0, 0, "\012", NULL },
+  { 10, 0, 0, 0, 0, " \014\012\015\011\013", NULL },
+  { 10, 0, 0, 0, 0, " \014\012\015\011\013", NULL },
+  { 10, 0, 0, 0, 0, " \014\012\015\011\013", NULL },
+  { 10, 0, 0, 0, 0, " \014\012\015\011\013", NULL },
+  { 10, 0, 0, 0, 0, " \014\012\015\011\013", NULL },
+  { 10, 0, 0, 0, 0, " \014\012\015\011\013", NULL },
+};
+
+static const mpc_table_t lispy_table = { 10, 285, lispy_table_nodes, lispy_table_links };
+
+static const char lispy_table_grammar[] = "\tnumber\t\t: /-?[0-9]+/ ; \n\tdecimal\t\t: /-?[0-9]+\\.[0-9]*/ ; \n\tboolean\t\t: \"true\" | \"false\" ; \n\tsymbol\t\t: /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&|]+/ ; \n\tstring\t\t: /\"(\\\\.|[^\"])*\"/ ; \n\tcomment\t\t: /;[^\\r\\n]*/ ; \n\tsexpr\t\t: \'(\' <expr>* \')\' ; \n\tqexpr\t\t: \'{\' <expr>* \'}\' ; \n\texpr\t\t: <decimal> | <number> | <boolean> | <symbol> \n\t\t\t| <string> | <comment> | <sexpr> | <qexpr> ; \n\tlispy\t\t: /^/ <expr>* /$/ ; \n";
@@ -1,5 +1,16 @@
+/* mmap needs POSIX declarations, even when compiling with -std=c99 */
+#if !defined(_WIN32) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif
+
 #include "mpc.h"
 
+#ifndef _WIN32
+#define MPC_USE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 /*
 ** State Type
 */
@@ -55,12 +66,23 @@ static mpc_state_t mpc_state_new(void) {
 ** backtracking and make LL(1) grammars easy
 ** to parse for all input methods.
 **
+** Where available there is also Mmap, which maps
+** a regular file into memory and then works just
+** like String, reading and backtracking over the
+** mapping without copying any of it.
+**
 */
 
 enum {
   MPC_INPUT_STRING = 0,
   MPC_INPUT_FILE   = 1,
-  MPC_INPUT_PIPE   = 2
+  MPC_INPUT_PIPE   = 2,
+  MPC_INPUT_MMAP   = 3
+};
+
+enum {
+  MPC_DFA_POSITIONS = 63,
+  MPC_DFA_DEAD = 0xFF
 };
 
 enum {
@@ -75,6 +97,18 @@ typedef struct {
   char mem[64];
 } mpc_mem_t;
 
+typedef struct {
+  mpc_parser_t *parser;
+  long pos;
+  int stored;
+  int ok;
+  mpc_state_t state;
+  char last;
+  mpc_val_t *output;
+  mpc_err_t *error;
+  mpc_err_t *errors;
+} mpc_memo_t;
+
 typedef struct {
 
   int type;
@@ -84,6 +118,7 @@ typedef struct {
   char *string;
   char *buffer;
   FILE *file;
+  size_t length;
 
   int suppress;
   int backtrack;
@@ -94,6 +129,11 @@ typedef struct {
   char *lasts;
   char last;
 
+  mpc_memo_t *memo;
+  int dfa;
+  int dfa_used;
+  int span;
+
   size_t mem_index;
   char mem_full[MPC_INPUT_MEM_NUM];
   mpc_mem_t mem[MPC_INPUT_MEM_NUM];
@@ -114,6 +154,11 @@ static mpc_input_t *mpc_input_new_string(const char *filename, const char *strin
   strcpy(i->string, string);
   i->buffer = NULL;
   i->file = NULL;
+  i->length = 0;
+  i->memo = NULL;
+  i->dfa = 1;
+  i->dfa_used = 0;
+  i->span = 0;
 
   i->suppress = 0;
   i->backtrack = 1;
@@ -144,6 +189,11 @@ static mpc_input_t *mpc_input_new_nstring(const char *filename, const char *stri
   i->string[length] = '\0';
   i->buffer = NULL;
   i->file = NULL;
+  i->length = 0;
+  i->memo = NULL;
+  i->dfa = 1;
+  i->dfa_used = 0;
+  i->span = 0;
 
   i->suppress = 0;
   i->backtrack = 1;
@@ -173,6 +223,11 @@ static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
   i->string = NULL;
   i->buffer = NULL;
   i->file = pipe;
+  i->length = 0;
+  i->memo = NULL;
+  i->dfa = 1;
+  i->dfa_used = 0;
+  i->span = 0;
 
   i->suppress = 0;
   i->backtrack = 1;
@@ -201,6 +256,11 @@ static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
   i->string = NULL;
   i->buffer = NULL;
   i->file = file;
+  i->length = 0;
+  i->memo = NULL;
+  i->dfa = 1;
+  i->dfa_used = 0;
+  i->span = 0;
 
   i->suppress = 0;
   i->backtrack = 1;
@@ -216,12 +276,43 @@ static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
   return i;
 }
 
+#ifdef MPC_USE_MMAP
+static mpc_input_t *mpc_input_new_mmap(const char *filename, FILE *file) {
+
+  struct stat st;
+  void *map;
+  mpc_input_t *i;
+
+  /* Only non-empty regular files can be mapped */
+  if (fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    return NULL;
+  }
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+  if (map == MAP_FAILED) { return NULL; }
+
+  i = mpc_input_new_file(filename, file);
+  i->type = MPC_INPUT_MMAP;
+  i->string = map;
+  i->length = st.st_size;
+  i->file = NULL;
+
+  return i;
+}
+#endif
+
+static void mpc_memo_delete(mpc_input_t *i);
+
 static void mpc_input_delete(mpc_input_t *i) {
 
+  mpc_memo_delete(i);
   free(i->filename);
 
   if (i->type == MPC_INPUT_STRING) { free(i->string); }
   if (i->type == MPC_INPUT_PIPE) { free(i->buffer); }
+#ifdef MPC_USE_MMAP
+  if (i->type == MPC_INPUT_MMAP) { munmap(i->string, i->length); }
+#endif
 
   free(i->marks);
   free(i->lasts);
@@ -374,6 +465,8 @@ static char mpc_input_getc(mpc_input_t *i) {
   switch (i->type) {
 
     case MPC_INPUT_STRING: return i->string[i->state.pos];
+    case MPC_INPUT_MMAP:
+      return (size_t)i->state.pos < i->length ? i->string[i->state.pos] : '\0';
     case MPC_INPUT_FILE: c = fgetc(i->file); return c;
     case MPC_INPUT_PIPE:
 
@@ -397,6 +490,8 @@ static char mpc_input_peekc(mpc_input_t *i) {
 
   switch (i->type) {
     case MPC_INPUT_STRING: return i->string[i->state.pos];
+    case MPC_INPUT_MMAP:
+      return (size_t)i->state.pos < i->length ? i->string[i->state.pos] : '\0';
     case MPC_INPUT_FILE:
 
       c = fgetc(i->file);
@@ -470,7 +565,9 @@ static int mpc_input_success(mpc_input_t *i, char c, char **o) {
     i->state.row++;
   }
 
-  if (o) {
+  if (o && i->span) {
+    (*o) = NULL;
+  } else if (o) {
     (*o) = mpc_malloc(i, 2);
     (*o)[0] = c;
     (*o)[1] = '\0';
@@ -540,6 +637,49 @@ static int mpc_input_string(mpc_input_t *i, const char *c, char **o) {
   return 1;
 }
 
+static int mpc_input_dfa(mpc_input_t *i, const unsigned char *trans, const char *accept, char **o) {
+
+  /* Run a compiled regex over the input in place, taking the longest match */
+
+  const unsigned char *s = (const unsigned char*)i->string + i->state.pos;
+  size_t limit = i->type == MPC_INPUT_MMAP ? i->length - i->state.pos : (size_t)-1;
+  size_t n = 0, k;
+  long match = accept[0] ? 0 : -1;
+  int state = 0;
+
+  while (n < limit && s[n] != '\0') {
+    state = trans[state * 256 + s[n]];
+    if (state == MPC_DFA_DEAD) { break; }
+    n++;
+    if (accept[state]) { match = n; }
+  }
+
+  if (match < 0) { return 0; }
+
+  for (k = 0; k < (size_t)match; k++) {
+    if (s[k] == '\n') { i->state.col = 0; i->state.row++; }
+    else { i->state.col++; }
+  }
+  if (match > 0) { i->last = s[match-1]; }
+  i->state.pos += match;
+
+  *o = mpc_malloc(i, match + 1);
+  memcpy(*o, s, match);
+  (*o)[match] = '\0';
+  return 1;
+}
+
+static int mpc_input_span(mpc_input_t *i, long start, char **o) {
+
+  /* Copy out everything read since start in one go */
+
+  long n = i->state.pos - start;
+  *o = mpc_malloc(i, n + 1);
+  memcpy(*o, i->string + start, n);
+  (*o)[n] = '\0';
+  return 1;
+}
+
 static int mpc_input_anchor(mpc_input_t* i, int(*f)(char,char), char **o) {
   *o = NULL;
   return f(i->last, mpc_input_peekc(i));
@@ -601,7 +741,7 @@ static void mpc_err_string_cat(char *buffer, int *pos, int *max, char const *fmt
   va_end(va);
 }
 
-static char char_unescape_buffer[4];
+static MPC_THREAD_LOCAL char char_unescape_buffer[4];
 
 static const char *mpc_err_char_unescape(char c) {
 
@@ -876,6 +1016,28 @@ static mpc_err_t *mpc_err_merge(mpc_input_t *i, mpc_err_t *x, mpc_err_t *y) {
   return mpc_err_or(i, errs, 2);
 }
 
+static mpc_err_t *mpc_err_copy(mpc_input_t *i, mpc_err_t *x) {
+  int j;
+  mpc_err_t *y;
+  if (x == NULL) { return NULL; }
+  y = mpc_malloc(i, sizeof(mpc_err_t));
+  y->state = x->state;
+  y->received = x->received;
+  y->filename = mpc_malloc(i, strlen(x->filename) + 1);
+  strcpy(y->filename, x->filename);
+  y->failure = NULL;
+  if (x->failure) {
+    y->failure = mpc_malloc(i, strlen(x->failure) + 1);
+    strcpy(y->failure, x->failure);
+  }
+  y->expected_num = 0;
+  y->expected = NULL;
+  for (j = 0; j < x->expected_num; j++) {
+    mpc_err_add_expected(i, y, x->expected[j]);
+  }
+  return y;
+}
+
 /*
 ** Parser Type
 */
@@ -914,7 +1076,10 @@ enum {
   MPC_TYPE_CHECK_WITH = 26,
 
   MPC_TYPE_SOI        = 27,
-  MPC_TYPE_EOI        = 28
+  MPC_TYPE_EOI        = 28,
+
+  MPC_TYPE_DFA        = 29,
+  MPC_TYPE_SPAN       = 30
 };
 
 typedef struct { char *m; } mpc_pdata_fail_t;
@@ -934,6 +1099,8 @@ typedef struct { mpc_parser_t *x; mpc_dtor_t dx; mpc_ctor_t lf; } mpc_pdata_not_
 typedef struct { int n; mpc_fold_t f; mpc_parser_t *x; mpc_dtor_t dx; } mpc_pdata_repeat_t;
 typedef struct { int n; mpc_parser_t **xs; } mpc_pdata_or_t;
 typedef struct { int n; mpc_fold_t f; mpc_parser_t **xs; mpc_dtor_t *dxs;  } mpc_pdata_and_t;
+typedef struct { mpc_parser_t *x; int n; unsigned char *trans; char *accept; } mpc_pdata_dfa_t;
+typedef struct { mpc_parser_t *x; } mpc_pdata_span_t;
 
 typedef union {
   mpc_pdata_fail_t fail;
@@ -953,6 +1120,8 @@ typedef union {
   mpc_pdata_repeat_t repeat;
   mpc_pdata_and_t and;
   mpc_pdata_or_t or;
+  mpc_pdata_dfa_t dfa;
+  mpc_pdata_span_t span;
 } mpc_pdata_t;
 
 struct mpc_parser_t {
@@ -960,6 +1129,10 @@ struct mpc_parser_t {
   mpc_pdata_t data;
   char type;
   char retained;
+  mpc_apply_t memo_copy;
+  mpc_dtor_t memo_dtor;
+  unsigned long memo_hits;
+  unsigned long memo_misses;
 };
 
 static mpc_val_t *mpcf_input_nth_free(mpc_input_t *i, int n, mpc_val_t **xs, int x) {
@@ -974,11 +1147,21 @@ static mpc_val_t *mpcf_input_trd_free(mpc_input_t *i, int n, mpc_val_t **xs) { r
 
 static mpc_val_t *mpcf_input_strfold(mpc_input_t *i, int n, mpc_val_t **xs) {
   int j;
-  size_t l = 0;
+  size_t l, k;
+  if (i->span) {
+    for (j = 0; j < n; j++) { mpc_free(i, xs[j]); }
+    return NULL;
+  }
   if (n == 0) { return mpc_calloc(i, 1, 1); }
-  for (j = 0; j < n; j++) { l += strlen(xs[j]); }
-  xs[0] = mpc_realloc(i, xs[0], l + 1);
-  for (j = 1; j < n; j++) { strcat(xs[0], xs[j]); mpc_free(i, xs[j]); }
+  l = strlen(xs[0]);
+  for (j = 1, k = l; j < n; j++) { k += strlen(xs[j]); }
+  xs[0] = mpc_realloc(i, xs[0], k + 1);
+  for (j = 1; j < n; j++) {
+    k = strlen(xs[j]);
+    memcpy((char*)xs[0] + l, xs[j], k + 1);
+    l += k;
+    mpc_free(i, xs[j]);
+  }
   return xs[0];
 }
 
@@ -1044,9 +1227,12 @@ enum {
 
 #define MPC_MAX_RECURSION_DEPTH 1000
 
-static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e, int depth) {
+static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e, int depth);
+
+static int mpc_parse_node(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e, int depth) {
 
   int j = 0, k = 0;
+  long start;
   mpc_result_t results_stk[MPC_PARSE_STACK_MIN];
   mpc_result_t *results;
   int results_slots = MPC_PARSE_STACK_MIN;
@@ -1071,6 +1257,34 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
     case MPC_TYPE_SOI:     MPC_PRIMITIVE(mpc_input_soi(i, (char**)&r->output));
     case MPC_TYPE_EOI:     MPC_PRIMITIVE(mpc_input_eoi(i, (char**)&r->output));
 
+    /* Compiled regexes run in place on input held in memory, otherwise
+       their original parser is used */
+
+    case MPC_TYPE_DFA:
+      if (i->dfa && i->backtrack > 0
+      && (i->type == MPC_INPUT_STRING || i->type == MPC_INPUT_MMAP)) {
+        i->dfa_used = 1;
+        MPC_PRIMITIVE(mpc_input_dfa(i, p->data.dfa.trans, p->data.dfa.accept, (char**)&r->output));
+      }
+      return mpc_parse_run(i, p->data.dfa.x, r, e, depth);
+
+    /* Other regexes on input held in memory build no output as they
+       go, and instead copy what they matched once they are done */
+
+    case MPC_TYPE_SPAN:
+      if (i->backtrack > 0
+      && (i->type == MPC_INPUT_STRING || i->type == MPC_INPUT_MMAP)) {
+        start = i->state.pos;
+        i->span++;
+        j = mpc_parse_run(i, p->data.span.x, r, e, depth+1);
+        i->span--;
+        if (!j) { MPC_FAILURE(r->error); }
+        mpc_free(i, r->output);
+        if (i->span) { MPC_SUCCESS(NULL); }
+        MPC_PRIMITIVE(mpc_input_span(i, start, (char**)&r->output));
+      }
+      return mpc_parse_run(i, p->data.span.x, r, e, depth);
+
     /* Other parsers */
 
     case MPC_TYPE_UNDEFINED: MPC_FAILURE(mpc_err_fail(i, "Parser Undefined!"));
@@ -1225,16 +1439,19 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
         ? mpc_malloc(i, sizeof(mpc_result_t) * p->data.repeat.n)
         : results_stk;
 
+      mpc_input_mark(i);
       while (mpc_parse_run(i, p->data.repeat.x, &results[j], e, depth+1)) {
         j++;
         if (j == p->data.repeat.n) { break; }
       }
 
       if (j == p->data.repeat.n) {
+        mpc_input_unmark(i);
         MPC_SUCCESS(
           mpc_parse_fold(i, p->data.repeat.f, j, (mpc_val_t**)results);
           if (p->data.repeat.n > MPC_PARSE_STACK_MIN) { mpc_free(i, results); });
       } else {
+        mpc_input_rewind(i);
         for (k = 0; k < j; k++) {
           mpc_parse_dtor(i, p->data.repeat.dx, results[k].output);
         }
@@ -1304,11 +1521,134 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
 #undef MPC_FAILURE
 #undef MPC_PRIMITIVE
 
+/*
+** Packrat Memoisation
+**
+** Parsers given to `mpc_memoise` remember their
+** result at each input position, so that when
+** backtracking tries them again at the same place
+** a copy of the earlier result is returned rather
+** than parsing the input again.
+**
+** A position is only stored once a parser has
+** been tried there twice, so input which never
+** backtracks pays only for a table lookup. The
+** table has a fixed number of entries which are
+** replaced when they collide, and is only used
+** with String and Mmap input, where positions
+** can be revisited freely.
+*/
+
+enum {
+  MPC_MEMO_SIZE = 4096
+};
+
+static size_t mpc_memo_hash(mpc_parser_t *p, long pos) {
+  return (((size_t)p >> 4) ^ ((size_t)pos * 2654435761u)) & (MPC_MEMO_SIZE-1);
+}
+
+static void mpc_memo_clear(mpc_input_t *i, mpc_memo_t *m) {
+  if (m->stored) {
+    if (m->ok) { m->parser->memo_dtor(m->output); }
+    else { mpc_err_delete_internal(i, m->error); }
+    mpc_err_delete_internal(i, m->errors);
+  }
+  m->parser = NULL;
+  m->stored = 0;
+}
+
+static void mpc_memo_delete(mpc_input_t *i) {
+  int j;
+  if (i->memo == NULL) { return; }
+  for (j = 0; j < MPC_MEMO_SIZE; j++) { mpc_memo_clear(i, &i->memo[j]); }
+  free(i->memo);
+}
+
+static int mpc_memo_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e, int depth) {
+
+  long pos = i->state.pos;
+  mpc_err_t *errors = NULL;
+  mpc_memo_t *m;
+  int x;
+
+  if (i->memo == NULL) { i->memo = calloc(MPC_MEMO_SIZE, sizeof(mpc_memo_t)); }
+  m = &i->memo[mpc_memo_hash(p, pos)];
+
+  /* Replay a stored result, along with any errors merged while parsing it */
+
+  if (m->parser == p && m->pos == pos && m->stored) {
+    p->memo_hits++;
+    *e = mpc_err_merge(i, *e, mpc_err_copy(i, m->errors));
+    if (m->ok) {
+      i->state = m->state;
+      i->last = m->last;
+      r->output = p->memo_copy(m->output);
+      return 1;
+    }
+    r->error = mpc_err_copy(i, m->error);
+    return 0;
+  }
+
+  p->memo_misses++;
+
+  if (m->parser != p || m->pos != pos) {
+    mpc_memo_clear(i, m);
+    m->parser = p;
+    m->pos = pos;
+    return mpc_parse_node(i, p, r, e, depth);
+  }
+
+  /* Tried here before, so parse and keep the result */
+
+  x = mpc_parse_node(i, p, r, &errors, depth);
+
+  m = &i->memo[mpc_memo_hash(p, pos)];
+  mpc_memo_clear(i, m);
+  m->parser = p;
+  m->pos = pos;
+  m->stored = 1;
+  m->ok = x;
+  m->errors = mpc_err_copy(i, errors);
+  if (x) {
+    m->state = i->state;
+    m->last = i->last;
+    m->output = p->memo_copy(r->output);
+  } else {
+    m->error = mpc_err_copy(i, r->error);
+  }
+
+  *e = mpc_err_merge(i, *e, errors);
+  return x;
+}
+
+static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e, int depth) {
+  if (p->memo_copy && !i->suppress && !i->span
+  && (i->type == MPC_INPUT_STRING || i->type == MPC_INPUT_MMAP)) {
+    return mpc_memo_run(i, p, r, e, depth);
+  }
+  return mpc_parse_node(i, p, r, e, depth);
+}
+
 int mpc_parse_input(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r) {
   int x;
   mpc_err_t *e = mpc_err_fail(i, "Unknown Error");
   e->state = mpc_state_invalid();
   x = mpc_parse_run(i, p, r, &e, 0);
+
+  /* Compiled regexes do not report why they failed, so parse
+     again without them to find the error */
+  if (!x && i->dfa_used) {
+    mpc_err_delete_internal(i, e);
+    mpc_err_delete_internal(i, r->error);
+    mpc_memo_delete(i);
+    i->memo = NULL;
+    i->state = mpc_state_new();
+    i->last = '\0';
+    i->dfa = 0;
+    i->dfa_used = 0;
+    return mpc_parse_input(i, p, r);
+  }
+
   if (x) {
     mpc_err_delete_internal(i, e);
     r->output = mpc_export(i, r->output);
@@ -1342,6 +1682,19 @@ int mpc_parse_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result
   return x;
 }
 
+int mpc_parse_mmap(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r) {
+#ifdef MPC_USE_MMAP
+  int x;
+  mpc_input_t *i = mpc_input_new_mmap(filename, file);
+  if (i) {
+    x = mpc_parse_input(i, p, r);
+    mpc_input_delete(i);
+    return x;
+  }
+#endif
+  return mpc_parse_file(filename, file, p, r);
+}
+
 int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result_t *r) {
   int x;
   mpc_input_t *i = mpc_input_new_pipe(filename, pipe);
@@ -1361,7 +1714,7 @@ int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
     return 0;
   }
 
-  res = mpc_parse_file(filename, f, p, r);
+  res = mpc_parse_mmap(filename, f, p, r);
   fclose(f);
   return res;
 }
@@ -1430,6 +1783,16 @@ static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
     case MPC_TYPE_OR:  mpc_undefine_or(p);  break;
     case MPC_TYPE_AND: mpc_undefine_and(p); break;
 
+    case MPC_TYPE_DFA:
+      mpc_undefine_unretained(p->data.dfa.x, 0);
+      free(p->data.dfa.trans);
+      free(p->data.dfa.accept);
+      break;
+
+    case MPC_TYPE_SPAN:
+      mpc_undefine_unretained(p->data.span.x, 0);
+      break;
+
     case MPC_TYPE_CHECK:
       mpc_undefine_unretained(p->data.check.x, 0);
       free(p->data.check.e);
@@ -1553,6 +1916,18 @@ mpc_parser_t *mpc_copy(mpc_parser_t *a) {
       }
     break;
 
+    case MPC_TYPE_DFA:
+      p->data.dfa.x = mpc_copy(a->data.dfa.x);
+      p->data.dfa.trans = malloc(a->data.dfa.n * 256);
+      memcpy(p->data.dfa.trans, a->data.dfa.trans, a->data.dfa.n * 256);
+      p->data.dfa.accept = malloc(a->data.dfa.n);
+      memcpy(p->data.dfa.accept, a->data.dfa.accept, a->data.dfa.n);
+      break;
+
+    case MPC_TYPE_SPAN:
+      p->data.span.x = mpc_copy(a->data.span.x);
+      break;
+
     case MPC_TYPE_CHECK:
       p->data.check.x      = mpc_copy(a->data.check.x);
       p->data.check.e      = malloc(strlen(a->data.check.e)+1);
@@ -1577,6 +1952,12 @@ mpc_parser_t *mpc_undefine(mpc_parser_t *p) {
   return p;
 }
 
+mpc_parser_t *mpc_memoise(mpc_parser_t *p, mpc_apply_t copy, mpc_dtor_t d) {
+  p->memo_copy = copy;
+  p->memo_dtor = d;
+  return p;
+}
+
 mpc_parser_t *mpc_define(mpc_parser_t *p, mpc_parser_t *a) {
 
   if (p->retained) {
@@ -2350,6 +2731,208 @@ static mpc_val_t *mpcf_re_range(mpc_val_t *x) {
   return out;
 }
 
+/*
+** Regex Compilation
+**
+** Once built, a regex is compiled into a DFA
+** with a 256 entry transition table per state
+** when doing so cannot change what it matches.
+**
+** Regex parsers never backtrack into a repeat or
+** an alternative which has succeeded, so this is
+** only done when every choice in the regex can be
+** made from the next character alone, that is,
+** when each character of the regex is followed
+** by a set of others which do not overlap. Then
+** the DFA has a state per character of the regex
+** and taking its longest match gives the same
+** result. Other regexes keep their parser, run as
+** a span: the output of a regex is always the text
+** it matched, so on input held in memory it is
+** copied out once at the end rather than built up
+** a character at a time.
+*/
+
+typedef struct {
+  int n;
+  unsigned char sets[MPC_DFA_POSITIONS][32];
+  unsigned long long follow[MPC_DFA_POSITIONS];
+} mpc_dfa_t;
+
+typedef struct {
+  int nullable;
+  unsigned long long first;
+  unsigned long long last;
+} mpc_dfa_node_t;
+
+static void mpc_dfa_follow(mpc_dfa_t *d, unsigned long long from, unsigned long long to) {
+  int j;
+  for (j = 0; j < d->n; j++) {
+    if (from & (1ULL << j)) { d->follow[j] |= to; }
+  }
+}
+
+static int mpc_dfa_char(mpc_dfa_t *d, mpc_parser_t *p, mpc_dfa_node_t *x) {
+
+  int c;
+  unsigned char *set;
+  char y;
+
+  if (d->n == MPC_DFA_POSITIONS) { return 0; }
+  set = d->sets[d->n];
+
+  /* The input ends at '\0' so it is never part of a match */
+  for (c = 1; c < 256; c++) {
+    y = (char)c;
+    if ((p->type == MPC_TYPE_ANY)
+    ||  (p->type == MPC_TYPE_SINGLE  && y == p->data.single.x)
+    ||  (p->type == MPC_TYPE_RANGE   && y >= p->data.range.x && y <= p->data.range.y)
+    ||  (p->type == MPC_TYPE_ONEOF   && strchr(p->data.string.x, y) != 0)
+    ||  (p->type == MPC_TYPE_NONEOF  && strchr(p->data.string.x, y) == 0)
+    ||  (p->type == MPC_TYPE_SATISFY && p->data.satisfy.f(y))) {
+      set[c / 8] |= 1 << (c % 8);
+    }
+  }
+
+  x->nullable = 0;
+  x->first = x->last = 1ULL << d->n;
+  d->n++;
+  return 1;
+}
+
+static int mpc_dfa_node(mpc_dfa_t *d, mpc_parser_t *p, mpc_dfa_node_t *x) {
+
+  int j;
+  mpc_dfa_node_t y;
+
+  switch (p->type) {
+
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_SINGLE:
+    case MPC_TYPE_RANGE:
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+    case MPC_TYPE_SATISFY:
+      return mpc_dfa_char(d, p, x);
+
+    case MPC_TYPE_EXPECT:
+      return mpc_dfa_node(d, p->data.expect.x, x);
+
+    case MPC_TYPE_LIFT:
+      if (p->data.lift.lf != mpcf_ctor_str) { return 0; }
+      x->nullable = 1;
+      x->first = x->last = 0;
+      return 1;
+
+    case MPC_TYPE_AND:
+      if (p->data.and.f != mpcf_strfold) { return 0; }
+      x->nullable = 1;
+      x->first = x->last = 0;
+      for (j = 0; j < p->data.and.n; j++) {
+        if (!mpc_dfa_node(d, p->data.and.xs[j], &y)) { return 0; }
+        mpc_dfa_follow(d, x->last, y.first);
+        if (x->nullable) { x->first |= y.first; }
+        x->last = y.nullable ? x->last | y.last : y.last;
+        x->nullable = x->nullable && y.nullable;
+      }
+      return 1;
+
+    case MPC_TYPE_OR:
+      x->nullable = 0;
+      x->first = x->last = 0;
+      for (j = 0; j < p->data.or.n; j++) {
+        /* An alternative matching nothing hides those after it */
+        if (x->nullable) { return 0; }
+        if (!mpc_dfa_node(d, p->data.or.xs[j], &y)) { return 0; }
+        x->nullable = y.nullable;
+        x->first |= y.first;
+        x->last |= y.last;
+      }
+      return 1;
+
+    case MPC_TYPE_MAYBE:
+      if (p->data.not.lf != mpcf_ctor_str) { return 0; }
+      if (!mpc_dfa_node(d, p->data.not.x, x)) { return 0; }
+      x->nullable = 1;
+      return 1;
+
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+      if (p->data.repeat.f != mpcf_strfold) { return 0; }
+      if (!mpc_dfa_node(d, p->data.repeat.x, x) || x->nullable) { return 0; }
+      mpc_dfa_follow(d, x->last, x->first);
+      x->nullable = p->type == MPC_TYPE_MANY;
+      return 1;
+
+    case MPC_TYPE_COUNT:
+      if (p->data.repeat.f != mpcf_strfold) { return 0; }
+      x->nullable = 1;
+      x->first = x->last = 0;
+      for (j = 0; j < p->data.repeat.n; j++) {
+        if (!mpc_dfa_node(d, p->data.repeat.x, &y)) { return 0; }
+        mpc_dfa_follow(d, x->last, y.first);
+        if (x->nullable) { x->first |= y.first; }
+        x->last = y.nullable ? x->last | y.last : y.last;
+        x->nullable = x->nullable && y.nullable;
+      }
+      return 1;
+
+    default: return 0;
+  }
+
+}
+
+static mpc_parser_t *mpc_re_span(mpc_parser_t *a) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_SPAN;
+  p->data.span.x = a;
+  return p;
+}
+
+static mpc_parser_t *mpc_re_compile(mpc_parser_t *a) {
+
+  int s, j, c;
+  unsigned long long next;
+  unsigned char *trans;
+  char *accept;
+  mpc_parser_t *p;
+  mpc_dfa_node_t x;
+  mpc_dfa_t *d = calloc(1, sizeof(mpc_dfa_t));
+
+  if (!mpc_dfa_node(d, a, &x)) { free(d); return mpc_re_span(a); }
+
+  /* State 0 is the start and state j+1 follows a match of character j */
+
+  trans = malloc((d->n + 1) * 256);
+  accept = malloc(d->n + 1);
+  memset(trans, MPC_DFA_DEAD, (d->n + 1) * 256);
+
+  for (s = 0; s <= d->n; s++) {
+    next = s == 0 ? x.first : d->follow[s-1];
+    accept[s] = s == 0 ? x.nullable : (x.last >> (s-1)) & 1;
+    for (j = 0; j < d->n; j++) {
+      if (!(next & (1ULL << j))) { continue; }
+      for (c = 1; c < 256; c++) {
+        if (!(d->sets[j][c / 8] & (1 << (c % 8)))) { continue; }
+        if (trans[s * 256 + c] != MPC_DFA_DEAD) {
+          free(trans); free(accept); free(d);
+          return mpc_re_span(a);
+        }
+        trans[s * 256 + c] = j + 1;
+      }
+    }
+  }
+
+  p = mpc_undefined();
+  p->type = MPC_TYPE_DFA;
+  p->data.dfa.x = a;
+  p->data.dfa.n = d->n + 1;
+  p->data.dfa.trans = trans;
+  p->data.dfa.accept = accept;
+  free(d);
+  return p;
+}
+
 mpc_parser_t *mpc_re(const char *re) {
   return mpc_re_mode(re, MPC_RE_DEFAULT);
 }
@@ -2417,7 +3000,7 @@ mpc_parser_t *mpc_re_mode(const char *re, int mode) {
 
   mpc_optimise(r.output);
 
-  return r.output;
+  return mpc_re_compile(r.output);
 
 }
 
@@ -2501,9 +3084,11 @@ static mpc_val_t *mpcf_escape_new(mpc_val_t *x, const char *input, const char **
 
   int i;
   int found;
-  char buff[2];
   char *s = x;
-  char *y = calloc(1, 1);
+  size_t n = 0, k, max = strlen(x) + 1;
+  char *y = malloc(max);
+
+  /* The output is grown by doubling so long strings take linear time */
 
   while (*s) {
 
@@ -2512,8 +3097,10 @@ static mpc_val_t *mpcf_escape_new(mpc_val_t *x, const char *input, const char **
 
     while (output[i]) {
       if (*s == input[i]) {
-        y = realloc(y, strlen(y) + strlen(output[i]) + 1);
-        strcat(y, output[i]);
+        k = strlen(output[i]);
+        while (n + k + 1 > max) { max *= 2; y = realloc(y, max); }
+        memcpy(y + n, output[i], k);
+        n += k;
         found = 1;
         break;
       }
@@ -2521,15 +3108,14 @@ static mpc_val_t *mpcf_escape_new(mpc_val_t *x, const char *input, const char **
     }
 
     if (!found) {
-      y = realloc(y, strlen(y) + 2);
-      buff[0] = *s; buff[1] = '\0';
-      strcat(y, buff);
+      if (n + 2 > max) { max *= 2; y = realloc(y, max); }
+      y[n++] = *s;
     }
 
     s++;
   }
 
-
+  y[n] = '\0';
   return y;
 }
 
@@ -2537,9 +3123,12 @@ static mpc_val_t *mpcf_unescape_new(mpc_val_t *x, const char *input, const char
 
   int i;
   int found = 0;
-  char buff[2];
   char *s = x;
-  char *y = calloc(1, 1);
+  size_t n = 0;
+
+  /* Unescaping never lengthens a string so the output is allocated once */
+
+  char *y = malloc(strlen(x) + 1);
 
   while (*s) {
 
@@ -2549,9 +3138,7 @@ static mpc_val_t *mpcf_unescape_new(mpc_val_t *x, const char *input, const char
     while (output[i]) {
       if ((*(s+0)) == output[i][0] &&
           (*(s+1)) == output[i][1]) {
-        y = realloc(y, strlen(y) + 1 + 1);
-        buff[0] = input[i]; buff[1] = '\0';
-        strcat(y, buff);
+        if (input[i]) { y[n++] = input[i]; }
         found = 1;
         s++;
         break;
@@ -2560,15 +3147,14 @@ static mpc_val_t *mpcf_unescape_new(mpc_val_t *x, const char *input, const char
     }
 
     if (!found) {
-      y = realloc(y, strlen(y) + 1 + 1);
-      buff[0] = *s; buff[1] = '\0';
-      strcat(y, buff);
+      y[n++] = *s;
     }
 
     if (*s == '\0') { break; }
     else { s++; }
   }
 
+  y[n] = '\0';
   return y;
 
 }
@@ -2648,16 +3234,19 @@ mpc_val_t *mpcf_freefold(int n, mpc_val_t **xs) {
 
 mpc_val_t *mpcf_strfold(int n, mpc_val_t **xs) {
   int i;
-  size_t l = 0;
+  size_t l, k;
 
   if (n == 0) { return calloc(1, 1); }
 
-  for (i = 0; i < n; i++) { l += strlen(xs[i]); }
+  l = strlen(xs[0]);
+  for (i = 1, k = l; i < n; i++) { k += strlen(xs[i]); }
 
-  xs[0] = realloc(xs[0], l + 1);
+  xs[0] = realloc(xs[0], k + 1);
 
   for (i = 1; i < n; i++) {
-    strcat(xs[0], xs[i]); free(xs[i]);
+    k = strlen(xs[i]);
+    memcpy((char*)xs[0] + l, xs[i], k + 1);
+    l += k; free(xs[i]);
   }
 
   return xs[0];
@@ -2770,6 +3359,8 @@ static void mpc_print_unretained(mpc_parser_t *p, int force) {
   if (p->type == MPC_TYPE_APPLY)    { mpc_print_unretained(p->data.apply.x, 0); }
   if (p->type == MPC_TYPE_APPLY_TO) { mpc_print_unretained(p->data.apply_to.x, 0); }
   if (p->type == MPC_TYPE_PREDICT)  { mpc_print_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_DFA)      { mpc_print_unretained(p->data.dfa.x, 0); }
+  if (p->type == MPC_TYPE_SPAN)     { mpc_print_unretained(p->data.span.x, 0); }
 
   if (p->type == MPC_TYPE_NOT)   { mpc_print_unretained(p->data.not.x, 0); printf("!"); }
   if (p->type == MPC_TYPE_MAYBE) { mpc_print_unretained(p->data.not.x, 0); printf("?"); }
@@ -2880,6 +3471,181 @@ int mpc_test_pass(mpc_parser_t *p, const char *s, const void *d,
 }
 
 
+/*
+** Arenas
+**
+** While an arena is in use every AST node, tag,
+** contents and children array is taken from its
+** chunks rather than allocated with malloc. Small
+** blocks freed while parsing, such as the nodes
+** thrown away as rules fold their results, are kept
+** on a list by size to be handed out again. The rest
+** is released at once by clearing the arena, so an
+** AST should be built and deleted with the same
+** arena in use.
+*/
+
+enum {
+  MPC_ARENA_CHUNK = 65536,
+  MPC_ARENA_ALIGN = sizeof(size_t),
+  MPC_ARENA_CLASSES = 16
+};
+
+typedef struct mpc_arena_chunk_t {
+  struct mpc_arena_chunk_t *next;
+  size_t size;
+  size_t used;
+} mpc_arena_chunk_t;
+
+struct mpc_arena_t {
+  size_t chunk;
+  size_t used;
+  mpc_arena_chunk_t *chunks;
+  void *free[MPC_ARENA_CLASSES];
+};
+
+static MPC_THREAD_LOCAL mpc_arena_t *mpc_arena_current = NULL;
+
+#define MPC_ARENA_ROUND(n) (((n) + MPC_ARENA_ALIGN - 1) & ~(size_t)(MPC_ARENA_ALIGN - 1))
+#define MPC_ARENA_DATA(c) ((char*)(c) + MPC_ARENA_ROUND(sizeof(mpc_arena_chunk_t)))
+#define MPC_ARENA_SIZE(x) (*(size_t*)((char*)(x) - MPC_ARENA_ALIGN))
+
+mpc_arena_t *mpc_arena_new(size_t chunk) {
+  mpc_arena_t *a = malloc(sizeof(mpc_arena_t));
+  a->chunk = chunk ? chunk : MPC_ARENA_CHUNK;
+  a->used = 0;
+  a->chunks = NULL;
+  memset(a->free, 0, sizeof(a->free));
+  return a;
+}
+
+mpc_arena_t *mpc_arena_use(mpc_arena_t *a) {
+  mpc_arena_t *prev = mpc_arena_current;
+  mpc_arena_current = a;
+  return prev;
+}
+
+size_t mpc_arena_used(mpc_arena_t *a) {
+  return a->used;
+}
+
+void mpc_arena_clear(mpc_arena_t *a) {
+
+  /* Keep one chunk of the usual size to start again with */
+
+  mpc_arena_chunk_t *c = a->chunks, *next, *keep = NULL;
+
+  while (c) {
+    next = c->next;
+    if (keep == NULL && c->size == a->chunk) { keep = c; }
+    else { free(c); }
+    c = next;
+  }
+
+  if (keep) { keep->next = NULL; keep->used = 0; }
+  a->chunks = keep;
+  a->used = 0;
+  memset(a->free, 0, sizeof(a->free));
+}
+
+void mpc_arena_delete(mpc_arena_t *a) {
+  mpc_arena_clear(a);
+  free(a->chunks);
+  if (mpc_arena_current == a) { mpc_arena_current = NULL; }
+  free(a);
+}
+
+static void *mpc_arena_alloc(mpc_arena_t *a, size_t n) {
+
+  /* Each block is preceded by its capacity so it can be grown */
+
+  size_t size = n ? MPC_ARENA_ROUND(n) : MPC_ARENA_ALIGN;
+  size_t need = MPC_ARENA_ALIGN + size;
+  size_t class = size / MPC_ARENA_ALIGN - 1;
+  mpc_arena_chunk_t *c = a->chunks;
+  char *p;
+
+  a->used += need;
+
+  if (class < MPC_ARENA_CLASSES && a->free[class]) {
+    p = a->free[class];
+    a->free[class] = *(void**)p;
+    return p;
+  }
+
+  if (c == NULL || c->size - c->used < need) {
+    c = malloc(MPC_ARENA_ROUND(sizeof(mpc_arena_chunk_t)) + (need > a->chunk ? need : a->chunk));
+    c->next = a->chunks;
+    c->size = need > a->chunk ? need : a->chunk;
+    c->used = 0;
+    a->chunks = c;
+  }
+
+  p = MPC_ARENA_DATA(c) + c->used;
+  *(size_t*)p = size;
+  c->used += need;
+  return p + MPC_ARENA_ALIGN;
+}
+
+static void mpc_arena_free(mpc_arena_t *a, void *x) {
+
+  size_t size, class;
+
+  if (x == NULL) { return; }
+
+  size = MPC_ARENA_SIZE(x);
+  class = size / MPC_ARENA_ALIGN - 1;
+  a->used -= MPC_ARENA_ALIGN + size;
+
+  if (class < MPC_ARENA_CLASSES) {
+    *(void**)x = a->free[class];
+    a->free[class] = x;
+  }
+}
+
+static void *mpc_arena_realloc(mpc_arena_t *a, void *x, size_t n) {
+
+  size_t old, grow;
+  mpc_arena_chunk_t *c = a->chunks;
+  char *p;
+
+  if (x == NULL) { return mpc_arena_alloc(a, n); }
+
+  old = MPC_ARENA_SIZE(x);
+  if (n <= old) { return x; }
+
+  /* The latest block can grow in place when the chunk has room */
+  grow = MPC_ARENA_ROUND(n) - old;
+  if ((char*)x + old == MPC_ARENA_DATA(c) + c->used
+  &&  c->size - c->used >= grow) {
+    MPC_ARENA_SIZE(x) = MPC_ARENA_ROUND(n);
+    c->used += grow;
+    a->used += grow;
+    return x;
+  }
+
+  /*
+  ** Otherwise it moves with its capacity doubled, as
+  ** blocks such as children arrays grow one at a time.
+  */
+  p = mpc_arena_alloc(a, n < old * 2 ? old * 2 : n);
+  memcpy(p, x, old);
+  mpc_arena_free(a, x);
+  return p;
+}
+
+static void *mpc_ast_malloc(size_t n) {
+  return mpc_arena_current ? mpc_arena_alloc(mpc_arena_current, n) : malloc(n);
+}
+
+static void *mpc_ast_realloc(void *x, size_t n) {
+  return mpc_arena_current ? mpc_arena_realloc(mpc_arena_current, x, n) : realloc(x, n);
+}
+
+static void mpc_ast_free(void *x) {
+  if (mpc_arena_current) { mpc_arena_free(mpc_arena_current, x); } else { free(x); }
+}
+
 /*
 ** AST
 */
@@ -2894,28 +3660,44 @@ void mpc_ast_delete(mpc_ast_t *a) {
     mpc_ast_delete(a->children[i]);
   }
 
-  free(a->children);
-  free(a->tag);
-  free(a->contents);
-  free(a);
+  mpc_ast_free(a->children);
+  mpc_ast_free(a->tag);
+  mpc_ast_free(a->contents);
+  mpc_ast_free(a);
+
+}
+
+mpc_ast_t *mpc_ast_copy(mpc_ast_t *a) {
+
+  int i;
+  mpc_ast_t *b = mpc_ast_new(a->tag, a->contents);
+
+  b->state = a->state;
+  b->children_num = a->children_num;
+  b->children = a->children_num ? mpc_ast_malloc(sizeof(mpc_ast_t*) * a->children_num) : NULL;
+  for (i = 0; i < a->children_num; i++) {
+    b->children[i] = mpc_ast_copy(a->children[i]);
+  }
+
+  return b;
 
 }
 
 static void mpc_ast_delete_no_children(mpc_ast_t *a) {
-  free(a->children);
-  free(a->tag);
-  free(a->contents);
-  free(a);
+  mpc_ast_free(a->children);
+  mpc_ast_free(a->tag);
+  mpc_ast_free(a->contents);
+  mpc_ast_free(a);
 }
 
 mpc_ast_t *mpc_ast_new(const char *tag, const char *contents) {
 
-  mpc_ast_t *a = malloc(sizeof(mpc_ast_t));
+  mpc_ast_t *a = mpc_ast_malloc(sizeof(mpc_ast_t));
 
-  a->tag = malloc(strlen(tag) + 1);
+  a->tag = mpc_ast_malloc(strlen(tag) + 1);
   strcpy(a->tag, tag);
 
-  a->contents = malloc(strlen(contents) + 1);
+  a->contents = mpc_ast_malloc(strlen(contents) + 1);
   strcpy(a->contents, contents);
 
   a->state = mpc_state_new();
@@ -2974,14 +3756,14 @@ int mpc_ast_eq(mpc_ast_t *a, mpc_ast_t *b) {
 
 mpc_ast_t *mpc_ast_add_child(mpc_ast_t *r, mpc_ast_t *a) {
   r->children_num++;
-  r->children = realloc(r->children, sizeof(mpc_ast_t*) * r->children_num);
+  r->children = mpc_ast_realloc(r->children, sizeof(mpc_ast_t*) * r->children_num);
   r->children[r->children_num-1] = a;
   return r;
 }
 
 mpc_ast_t *mpc_ast_add_tag(mpc_ast_t *a, const char *t) {
   if (a == NULL) { return a; }
-  a->tag = realloc(a->tag, strlen(t) + 1 + strlen(a->tag) + 1);
+  a->tag = mpc_ast_realloc(a->tag, strlen(t) + 1 + strlen(a->tag) + 1);
   memmove(a->tag + strlen(t) + 1, a->tag, strlen(a->tag)+1);
   memmove(a->tag, t, strlen(t));
   memmove(a->tag + strlen(t), "|", 1);
@@ -2990,14 +3772,14 @@ mpc_ast_t *mpc_ast_add_tag(mpc_ast_t *a, const char *t) {
 
 mpc_ast_t *mpc_ast_add_root_tag(mpc_ast_t *a, const char *t) {
   if (a == NULL) { return a; }
-  a->tag = realloc(a->tag, (strlen(t)-1) + strlen(a->tag) + 1);
+  a->tag = mpc_ast_realloc(a->tag, (strlen(t)-1) + strlen(a->tag) + 1);
   memmove(a->tag + (strlen(t)-1), a->tag, strlen(a->tag)+1);
   memmove(a->tag, t, (strlen(t)-1));
   return a;
 }
 
 mpc_ast_t *mpc_ast_tag(mpc_ast_t *a, const char *t) {
-  a->tag = realloc(a->tag, strlen(t) + 1);
+  a->tag = mpc_ast_realloc(a->tag, strlen(t) + 1);
   strcpy(a->tag, t);
   return a;
 }
@@ -3279,6 +4061,7 @@ mpc_parser_t *mpca_root(mpc_parser_t *a) {
   return mpc_apply(a, (mpc_apply_t)mpc_ast_add_root);
 }
 
+mpc_parser_t *mpca_memoise(mpc_parser_t *a) { return mpc_memoise(a, (mpc_apply_t)mpc_ast_copy, (mpc_dtor_t)mpc_ast_delete); }
 mpc_parser_t *mpca_not(mpc_parser_t *a) { return mpc_not(a, (mpc_dtor_t)mpc_ast_delete); }
 mpc_parser_t *mpca_maybe(mpc_parser_t *a) { return mpc_maybe(a); }
 mpc_parser_t *mpca_many(mpc_parser_t *a) { return mpc_many(mpcf_fold_ast, a); }
@@ -3664,6 +4447,7 @@ static mpc_val_t *mpca_stmt_list_apply_to(mpc_val_t *x, void *s) {
     if (stmt->name) { stmt->grammar = mpc_expect(stmt->grammar, stmt->name); }
     mpc_optimise(stmt->grammar);
     mpc_define(left, stmt->grammar);
+    if (st->flags & MPCA_LANG_MEMOISE) { mpca_memoise(left); }
     free(stmt->ident);
     free(stmt->name);
     free(stmt);
@@ -3856,6 +4640,8 @@ static int mpc_nodecount_unretained(mpc_parser_t* p, int force) {
   if (p->type == MPC_TYPE_APPLY)    { return 1 + mpc_nodecount_unretained(p->data.apply.x, 0); }
   if (p->type == MPC_TYPE_APPLY_TO) { return 1 + mpc_nodecount_unretained(p->data.apply_to.x, 0); }
   if (p->type == MPC_TYPE_PREDICT)  { return 1 + mpc_nodecount_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_DFA)      { return 1 + mpc_nodecount_unretained(p->data.dfa.x, 0); }
+  if (p->type == MPC_TYPE_SPAN)     { return 1 + mpc_nodecount_unretained(p->data.span.x, 0); }
 
   if (p->type == MPC_TYPE_CHECK)    { return 1 + mpc_nodecount_unretained(p->data.check.x, 0); }
   if (p->type == MPC_TYPE_CHECK_WITH) { return 1 + mpc_nodecount_unretained(p->data.check_with.x, 0); }
@@ -3887,10 +4673,49 @@ static int mpc_nodecount_unretained(mpc_parser_t* p, int force) {
 
 }
 
+static void mpc_stats_memo(mpc_parser_t *p, mpc_parser_t ***seen, int *n) {
+
+  int i;
+
+  if (p->retained) {
+    for (i = 0; i < *n; i++) { if ((*seen)[i] == p) { return; } }
+    *seen = realloc(*seen, sizeof(mpc_parser_t*) * (*n + 1));
+    (*seen)[(*n)++] = p;
+    if (p->memo_copy) {
+      printf("Memo %s: %lu hits, %lu misses\n", p->name, p->memo_hits, p->memo_misses);
+    }
+  }
+
+  if (p->type == MPC_TYPE_EXPECT)     { mpc_stats_memo(p->data.expect.x, seen, n); }
+  if (p->type == MPC_TYPE_APPLY)      { mpc_stats_memo(p->data.apply.x, seen, n); }
+  if (p->type == MPC_TYPE_APPLY_TO)   { mpc_stats_memo(p->data.apply_to.x, seen, n); }
+  if (p->type == MPC_TYPE_CHECK)      { mpc_stats_memo(p->data.check.x, seen, n); }
+  if (p->type == MPC_TYPE_CHECK_WITH) { mpc_stats_memo(p->data.check_with.x, seen, n); }
+  if (p->type == MPC_TYPE_PREDICT)    { mpc_stats_memo(p->data.predict.x, seen, n); }
+  if (p->type == MPC_TYPE_NOT)        { mpc_stats_memo(p->data.not.x, seen, n); }
+  if (p->type == MPC_TYPE_MAYBE)      { mpc_stats_memo(p->data.not.x, seen, n); }
+  if (p->type == MPC_TYPE_MANY)       { mpc_stats_memo(p->data.repeat.x, seen, n); }
+  if (p->type == MPC_TYPE_MANY1)      { mpc_stats_memo(p->data.repeat.x, seen, n); }
+  if (p->type == MPC_TYPE_COUNT)      { mpc_stats_memo(p->data.repeat.x, seen, n); }
+
+  if (p->type == MPC_TYPE_OR) {
+    for (i = 0; i < p->data.or.n; i++) { mpc_stats_memo(p->data.or.xs[i], seen, n); }
+  }
+
+  if (p->type == MPC_TYPE_AND) {
+    for (i = 0; i < p->data.and.n; i++) { mpc_stats_memo(p->data.and.xs[i], seen, n); }
+  }
+
+}
+
 void mpc_stats(mpc_parser_t* p) {
+  int n = 0;
+  mpc_parser_t **seen = NULL;
   printf("Stats\n");
   printf("=====\n");
   printf("Node Count: %i\n", mpc_nodecount_unretained(p, 1));
+  mpc_stats_memo(p, &seen, &n);
+  free(seen);
 }
 
 static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
@@ -4066,3 +4891,407 @@ void mpc_optimise(mpc_parser_t *p) {
   mpc_optimise_unretained(p, 1);
 }
 
+
+/*
+** Tables
+**
+** A set of parsers can be written out as C source
+** for a table of their nodes, and built again from
+** that table without parsing any grammar or regex.
+** Nodes refer to each other and to the functions
+** they use by index. So only parsers made from the
+** functions listed here can be written out, with
+** tags as the only data given to mpc_apply_to.
+**
+** New functions go at the end of the list, so that
+** tables already written keep their meaning.
+*/
+
+typedef void (*mpc_table_fn_t)(void);
+
+static const struct { const char *name; mpc_table_fn_t f; } mpc_table_fns[] = {
+  { "NULL",                        NULL },
+  { "free",                        (mpc_table_fn_t)free },
+  { "mpcf_free",                   (mpc_table_fn_t)mpcf_free },
+  { "mpcf_dtor_null",              (mpc_table_fn_t)mpcf_dtor_null },
+  { "mpcf_ctor_null",              (mpc_table_fn_t)mpcf_ctor_null },
+  { "mpcf_ctor_str",               (mpc_table_fn_t)mpcf_ctor_str },
+  { "mpcf_null",                   (mpc_table_fn_t)mpcf_null },
+  { "mpcf_fst",                    (mpc_table_fn_t)mpcf_fst },
+  { "mpcf_snd",                    (mpc_table_fn_t)mpcf_snd },
+  { "mpcf_trd",                    (mpc_table_fn_t)mpcf_trd },
+  { "mpcf_fst_free",               (mpc_table_fn_t)mpcf_fst_free },
+  { "mpcf_snd_free",               (mpc_table_fn_t)mpcf_snd_free },
+  { "mpcf_trd_free",               (mpc_table_fn_t)mpcf_trd_free },
+  { "mpcf_freefold",               (mpc_table_fn_t)mpcf_freefold },
+  { "mpcf_strfold",                (mpc_table_fn_t)mpcf_strfold },
+  { "mpcf_int",                    (mpc_table_fn_t)mpcf_int },
+  { "mpcf_hex",                    (mpc_table_fn_t)mpcf_hex },
+  { "mpcf_oct",                    (mpc_table_fn_t)mpcf_oct },
+  { "mpcf_float",                  (mpc_table_fn_t)mpcf_float },
+  { "mpcf_strtriml",               (mpc_table_fn_t)mpcf_strtriml },
+  { "mpcf_strtrimr",               (mpc_table_fn_t)mpcf_strtrimr },
+  { "mpcf_strtrim",                (mpc_table_fn_t)mpcf_strtrim },
+  { "mpcf_escape",                 (mpc_table_fn_t)mpcf_escape },
+  { "mpcf_unescape",               (mpc_table_fn_t)mpcf_unescape },
+  { "mpcf_escape_regex",           (mpc_table_fn_t)mpcf_escape_regex },
+  { "mpcf_unescape_regex",         (mpc_table_fn_t)mpcf_unescape_regex },
+  { "mpcf_escape_string_raw",      (mpc_table_fn_t)mpcf_escape_string_raw },
+  { "mpcf_unescape_string_raw",    (mpc_table_fn_t)mpcf_unescape_string_raw },
+  { "mpcf_escape_char_raw",        (mpc_table_fn_t)mpcf_escape_char_raw },
+  { "mpcf_unescape_char_raw",      (mpc_table_fn_t)mpcf_unescape_char_raw },
+  { "mpcf_fold_ast",               (mpc_table_fn_t)mpcf_fold_ast },
+  { "mpcf_str_ast",                (mpc_table_fn_t)mpcf_str_ast },
+  { "mpcf_state_ast",              (mpc_table_fn_t)mpcf_state_ast },
+  { "mpc_ast_delete",              (mpc_table_fn_t)mpc_ast_delete },
+  { "mpc_ast_copy",                (mpc_table_fn_t)mpc_ast_copy },
+  { "mpc_ast_tag",                 (mpc_table_fn_t)mpc_ast_tag },
+  { "mpc_ast_add_tag",             (mpc_table_fn_t)mpc_ast_add_tag },
+  { "mpc_ast_add_root",            (mpc_table_fn_t)mpc_ast_add_root },
+  { "mpc_boundary_anchor",         (mpc_table_fn_t)mpc_boundary_anchor },
+  { "mpc_boundary_newline_anchor", (mpc_table_fn_t)mpc_boundary_newline_anchor }
+};
+
+enum {
+  MPC_TABLE_FNS = sizeof(mpc_table_fns) / sizeof(mpc_table_fns[0])
+};
+
+static int mpc_table_fn(mpc_table_fn_t f) {
+  int i;
+  for (i = 0; i < MPC_TABLE_FNS; i++) {
+    if (mpc_table_fns[i].f == f) { return i; }
+  }
+  return -1;
+}
+
+typedef struct {
+  int num;
+  mpc_parser_t **ps;
+  mpc_table_node_t *nodes;
+  int links_num;
+  int *links;
+} mpc_table_st_t;
+
+static int mpc_table_find(mpc_table_st_t *st, mpc_parser_t *p) {
+
+  /* Parsers are numbered as they are found, and the only
+     retained ones allowed are those being written out */
+
+  int i;
+  for (i = 0; i < st->num; i++) {
+    if (st->ps[i] == p) { return i; }
+  }
+  if (p->retained) { return -1; }
+
+  st->ps = realloc(st->ps, sizeof(mpc_parser_t*) * (st->num + 1));
+  st->ps[st->num] = p;
+  return st->num++;
+}
+
+static void mpc_table_link(mpc_table_st_t *st, int x) {
+  st->links = realloc(st->links, sizeof(int) * (st->links_num + 1));
+  st->links[st->links_num++] = x;
+}
+
+static int mpc_table_node(mpc_table_st_t *st, mpc_parser_t *p, mpc_table_node_t *t) {
+
+  int i, x;
+
+  t->type = p->type;
+  t->n = 0; t->x = 0; t->f = 0; t->d = 0;
+  t->s = NULL; t->t = NULL;
+
+  if (p->memo_copy) { return 0; }
+
+  switch (p->type) {
+
+    case MPC_TYPE_PASS:
+    case MPC_TYPE_ANY:
+    case MPC_TYPE_STATE:
+    case MPC_TYPE_SOI:
+    case MPC_TYPE_EOI:
+      return 1;
+
+    case MPC_TYPE_FAIL:   t->s = p->data.fail.m; return 1;
+    case MPC_TYPE_LIFT:   t->f = mpc_table_fn((mpc_table_fn_t)p->data.lift.lf); break;
+    case MPC_TYPE_ANCHOR: t->f = mpc_table_fn((mpc_table_fn_t)p->data.anchor.f); break;
+    case MPC_TYPE_SINGLE: t->s = &p->data.single.x; t->n = 1; return 1;
+    case MPC_TYPE_RANGE:  t->s = &p->data.range.x; t->n = 2; return 1;
+
+    case MPC_TYPE_ONEOF:
+    case MPC_TYPE_NONEOF:
+    case MPC_TYPE_STRING:
+      t->s = p->data.string.x;
+      return 1;
+
+    case MPC_TYPE_EXPECT:
+      t->x = mpc_table_find(st, p->data.expect.x);
+      t->s = p->data.expect.m;
+      break;
+
+    case MPC_TYPE_APPLY:
+      t->x = mpc_table_find(st, p->data.apply.x);
+      t->f = mpc_table_fn((mpc_table_fn_t)p->data.apply.f);
+      break;
+
+    case MPC_TYPE_APPLY_TO:
+      if (p->data.apply_to.f != (mpc_apply_to_t)mpc_ast_tag
+      &&  p->data.apply_to.f != (mpc_apply_to_t)mpc_ast_add_tag) { return 0; }
+      t->x = mpc_table_find(st, p->data.apply_to.x);
+      t->f = mpc_table_fn((mpc_table_fn_t)p->data.apply_to.f);
+      t->s = p->data.apply_to.d;
+      break;
+
+    case MPC_TYPE_PREDICT: t->x = mpc_table_find(st, p->data.predict.x); break;
+    case MPC_TYPE_SPAN:    t->x = mpc_table_find(st, p->data.span.x); break;
+
+    case MPC_TYPE_NOT:
+    case MPC_TYPE_MAYBE:
+      t->x = mpc_table_find(st, p->data.not.x);
+      t->f = mpc_table_fn((mpc_table_fn_t)p->data.not.lf);
+      t->d = mpc_table_fn((mpc_table_fn_t)p->data.not.dx);
+      break;
+
+    case MPC_TYPE_MANY:
+    case MPC_TYPE_MANY1:
+    case MPC_TYPE_COUNT:
+      t->n = p->data.repeat.n;
+      t->x = mpc_table_find(st, p->data.repeat.x);
+      t->f = mpc_table_fn((mpc_table_fn_t)p->data.repeat.f);
+      t->d = mpc_table_fn((mpc_table_fn_t)p->data.repeat.dx);
+      break;
+
+    case MPC_TYPE_OR:
+      t->n = p->data.or.n;
+      t->x = st->links_num;
+      for (i = 0; i < p->data.or.n; i++) {
+        x = mpc_table_find(st, p->data.or.xs[i]);
+        if (x < 0) { return 0; }
+        mpc_table_link(st, x);
+      }
+      return 1;
+
+    case MPC_TYPE_AND:
+      t->n = p->data.and.n;
+      t->x = st->links_num;
+      t->f = mpc_table_fn((mpc_table_fn_t)p->data.and.f);
+      for (i = 0; i < p->data.and.n; i++) {
+        x = mpc_table_find(st, p->data.and.xs[i]);
+        if (x < 0) { return 0; }
+        mpc_table_link(st, x);
+      }
+      for (i = 0; i < p->data.and.n-1; i++) {
+        x = mpc_table_fn((mpc_table_fn_t)p->data.and.dxs[i]);
+        if (x < 0) { return 0; }
+        mpc_table_link(st, x);
+      }
+      break;
+
+    case MPC_TYPE_DFA:
+      t->n = p->data.dfa.n;
+      t->x = mpc_table_find(st, p->data.dfa.x);
+      t->s = p->data.dfa.accept;
+      t->t = p->data.dfa.trans;
+      break;
+
+    default: return 0;
+  }
+
+  return t->x >= 0 && t->f >= 0 && t->d >= 0;
+}
+
+static void mpc_table_print_str(FILE *f, const char *s, size_t n) {
+
+  /* Anything but plain characters is written in octal,
+     and '?' too so as not to form trigraphs */
+
+  size_t i;
+  unsigned char c;
+
+  fputc('"', f);
+  for (i = 0; i < n; i++) {
+    c = s[i];
+    if (c >= ' ' && c <= '~' && c != '"' && c != '\\' && c != '?') { fputc(c, f); }
+    else { fprintf(f, "\\%03o", c); }
+  }
+  fputc('"', f);
+}
+
+int mpc_table_print(FILE *f, const char *name, int n, ...) {
+
+  int i, j;
+  va_list va;
+  mpc_table_node_t *t;
+  mpc_table_st_t st;
+
+  st.num = 0; st.ps = NULL; st.nodes = NULL;
+  st.links_num = 0; st.links = NULL;
+
+  va_start(va, n);
+  for (i = 0; i < n; i++) {
+    st.ps = realloc(st.ps, sizeof(mpc_parser_t*) * (st.num + 1));
+    st.ps[st.num++] = va_arg(va, mpc_parser_t*);
+  }
+  va_end(va);
+
+  /* More parsers are found as each node is looked at */
+
+  for (i = 0; i < st.num; i++) {
+    st.nodes = realloc(st.nodes, sizeof(mpc_table_node_t) * (i + 1));
+    if (!mpc_table_node(&st, st.ps[i], &st.nodes[i])) {
+      free(st.ps); free(st.nodes); free(st.links);
+      return 0;
+    }
+  }
+
+  fprintf(f, "/* Parser table written by mpc_table_print */\n\n");
+
+  fprintf(f, "static const int %s_links[] = {", name);
+  for (i = 0; i < st.links_num; i++) {
+    fprintf(f, "%s%d,", i % 16 == 0 ? "\n  " : " ", st.links[i]);
+  }
+  fprintf(f, "%s\n};\n\n", st.links_num ? "" : "\n  0");
+
+  fprintf(f, "static const mpc_table_node_t %s_nodes[] = {\n", name);
+  for (i = 0; i < st.num; i++) {
+    t = &st.nodes[i];
+    fprintf(f, "  { %d, %d, %d, %d, %d, ", t->type, t->n, t->x, t->f, t->d);
+    if (t->type == MPC_TYPE_DFA) {
+      mpc_table_print_str(f, t->s, t->n);
+      fprintf(f, ",\n    (const unsigned char *)");
+      for (j = 0; j < t->n; j++) {
+        fprintf(f, "\n    ");
+        mpc_table_print_str(f, (const char*)t->t + j * 256, 256);
+      }
+      fprintf(f, " },");
+    } else if (t->s) {
+      mpc_table_print_str(f, t->s, t->n && t->type != MPC_TYPE_COUNT ? (size_t)t->n : strlen(t->s));
+      fprintf(f, ", NULL },");
+    } else {
+      fprintf(f, "NULL, NULL },");
+    }
+    if (st.ps[i]->name) { fprintf(f, " /* %s */", st.ps[i]->name); }
+    else if (t->f) { fprintf(f, " /* %s */", mpc_table_fns[t->f].name); }
+    fprintf(f, "\n");
+  }
+  fprintf(f, "};\n\n");
+
+  fprintf(f, "static const mpc_table_t %s = { %d, %d, %s_nodes, %s_links };\n",
+    name, n, st.num, name, name);
+
+  free(st.ps); free(st.nodes); free(st.links);
+  return 1;
+}
+
+static char *mpc_table_str(const char *s, size_t n) {
+  char *x = malloc(n + 1);
+  memcpy(x, s, n);
+  x[n] = '\0';
+  return x;
+}
+
+int mpc_table_load(const mpc_table_t *t, int n, ...) {
+
+  int i, j;
+  va_list va;
+  mpc_parser_t *p, **ps;
+  const mpc_table_node_t *x;
+  const int *l;
+
+  if (n != t->roots) { return 0; }
+
+  ps = malloc(sizeof(mpc_parser_t*) * t->nodes_num);
+  va_start(va, n);
+  for (i = 0; i < t->nodes_num; i++) {
+    ps[i] = i < n ? va_arg(va, mpc_parser_t*) : mpc_undefined();
+  }
+  va_end(va);
+
+  for (i = 0; i < t->nodes_num; i++) {
+
+    p = ps[i];
+    x = &t->nodes[i];
+    l = t->links + x->x;
+    p->type = x->type;
+
+    switch (x->type) {
+
+      case MPC_TYPE_FAIL:   p->data.fail.m = mpc_table_str(x->s, strlen(x->s)); break;
+      case MPC_TYPE_LIFT:   p->data.lift.lf = (mpc_ctor_t)mpc_table_fns[x->f].f; p->data.lift.x = NULL; break;
+      case MPC_TYPE_ANCHOR: p->data.anchor.f = (int(*)(char,char))mpc_table_fns[x->f].f; break;
+      case MPC_TYPE_SINGLE: p->data.single.x = x->s[0]; break;
+      case MPC_TYPE_RANGE:  p->data.range.x = x->s[0]; p->data.range.y = x->s[1]; break;
+
+      case MPC_TYPE_ONEOF:
+      case MPC_TYPE_NONEOF:
+      case MPC_TYPE_STRING:
+        p->data.string.x = mpc_table_str(x->s, strlen(x->s));
+        break;
+
+      case MPC_TYPE_EXPECT:
+        p->data.expect.x = ps[x->x];
+        p->data.expect.m = mpc_table_str(x->s, strlen(x->s));
+        break;
+
+      case MPC_TYPE_APPLY:
+        p->data.apply.x = ps[x->x];
+        p->data.apply.f = (mpc_apply_t)mpc_table_fns[x->f].f;
+        break;
+
+      case MPC_TYPE_APPLY_TO:
+        p->data.apply_to.x = ps[x->x];
+        p->data.apply_to.f = (mpc_apply_to_t)mpc_table_fns[x->f].f;
+        p->data.apply_to.d = (void*)x->s;
+        break;
+
+      case MPC_TYPE_PREDICT: p->data.predict.x = ps[x->x]; break;
+      case MPC_TYPE_SPAN:    p->data.span.x = ps[x->x]; break;
+
+      case MPC_TYPE_NOT:
+      case MPC_TYPE_MAYBE:
+        p->data.not.x = ps[x->x];
+        p->data.not.lf = (mpc_ctor_t)mpc_table_fns[x->f].f;
+        p->data.not.dx = (mpc_dtor_t)mpc_table_fns[x->d].f;
+        break;
+
+      case MPC_TYPE_MANY:
+      case MPC_TYPE_MANY1:
+      case MPC_TYPE_COUNT:
+        p->data.repeat.n = x->n;
+        p->data.repeat.x = ps[x->x];
+        p->data.repeat.f = (mpc_fold_t)mpc_table_fns[x->f].f;
+        p->data.repeat.dx = (mpc_dtor_t)mpc_table_fns[x->d].f;
+        break;
+
+      case MPC_TYPE_OR:
+        p->data.or.n = x->n;
+        p->data.or.xs = malloc(sizeof(mpc_parser_t*) * x->n);
+        for (j = 0; j < x->n; j++) { p->data.or.xs[j] = ps[l[j]]; }
+        break;
+
+      case MPC_TYPE_AND:
+        p->data.and.n = x->n;
+        p->data.and.f = (mpc_fold_t)mpc_table_fns[x->f].f;
+        p->data.and.xs = malloc(sizeof(mpc_parser_t*) * x->n);
+        p->data.and.dxs = malloc(sizeof(mpc_dtor_t) * (x->n - 1));
+        for (j = 0; j < x->n; j++) { p->data.and.xs[j] = ps[l[j]]; }
+        for (j = 0; j < x->n-1; j++) {
+          p->data.and.dxs[j] = (mpc_dtor_t)mpc_table_fns[l[x->n + j]].f;
+        }
+        break;
+
+      case MPC_TYPE_DFA:
+        p->data.dfa.x = ps[x->x];
+        p->data.dfa.n = x->n;
+        p->data.dfa.trans = malloc(x->n * 256);
+        memcpy(p->data.dfa.trans, x->t, x->n * 256);
+        p->data.dfa.accept = mpc_table_str(x->s, x->n);
+        break;
+
+      default: break;
+    }
+  }
+
+  free(ps);
+  return 1;
+}
@@ -68,6 +68,7 @@ typedef struct mpc_parser_t mpc_parser_t;
 int mpc_parse(const char *filename, const char *string, mpc_parser_t *p, mpc_result_t *r);
 int mpc_nparse(const char *filename, const char *string, size_t length, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r);
+int mpc_parse_mmap(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result_t *r);
 int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r);
 
@@ -92,6 +93,7 @@ typedef int(*mpc_check_with_t)(mpc_val_t**,void*);
 mpc_parser_t *mpc_new(const char *name);
 mpc_parser_t *mpc_copy(mpc_parser_t *a);
 mpc_parser_t *mpc_define(mpc_parser_t *p, mpc_parser_t *a);
+mpc_parser_t *mpc_memoise(mpc_parser_t *p, mpc_apply_t copy, mpc_dtor_t d);
 mpc_parser_t *mpc_undefine(mpc_parser_t *p);
 
 void mpc_delete(mpc_parser_t *p);
@@ -297,10 +299,37 @@ mpc_ast_t *mpc_ast_add_root_tag(mpc_ast_t *a, const char *t);
 mpc_ast_t *mpc_ast_tag(mpc_ast_t *a, const char *t);
 mpc_ast_t *mpc_ast_state(mpc_ast_t *a, mpc_state_t s);
 
+mpc_ast_t *mpc_ast_copy(mpc_ast_t *a);
 void mpc_ast_delete(mpc_ast_t *a);
 void mpc_ast_print(mpc_ast_t *a);
 void mpc_ast_print_to(mpc_ast_t *a, FILE *fp);
 
+/*
+** Arenas
+*/
+
+/* Storage class of state kept per thread, such as the arena in use, so
+** that separate threads may parse with the same parsers at once */
+#ifndef MPC_THREAD_LOCAL
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define MPC_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define MPC_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define MPC_THREAD_LOCAL __declspec(thread)
+#else
+#define MPC_THREAD_LOCAL
+#endif
+#endif
+
+typedef struct mpc_arena_t mpc_arena_t;
+
+mpc_arena_t *mpc_arena_new(size_t chunk);
+mpc_arena_t *mpc_arena_use(mpc_arena_t *a);
+size_t mpc_arena_used(mpc_arena_t *a);
+void mpc_arena_clear(mpc_arena_t *a);
+void mpc_arena_delete(mpc_arena_t *a);
+
 int mpc_ast_get_index(mpc_ast_t *ast, const char *tag);
 int mpc_ast_get_index_lb(mpc_ast_t *ast, const char *tag, int lb);
 mpc_ast_t *mpc_ast_get_child(mpc_ast_t *ast, const char *tag);
@@ -340,6 +369,7 @@ mpc_parser_t *mpca_root(mpc_parser_t *a);
 mpc_parser_t *mpca_state(mpc_parser_t *a);
 mpc_parser_t *mpca_total(mpc_parser_t *a);
 
+mpc_parser_t *mpca_memoise(mpc_parser_t *a);
 mpc_parser_t *mpca_not(mpc_parser_t *a);
 mpc_parser_t *mpca_maybe(mpc_parser_t *a);
 
@@ -353,7 +383,8 @@ mpc_parser_t *mpca_and(int n, ...);
 enum {
   MPCA_LANG_DEFAULT              = 0,
   MPCA_LANG_PREDICTIVE           = 1,
-  MPCA_LANG_WHITESPACE_SENSITIVE = 2
+  MPCA_LANG_WHITESPACE_SENSITIVE = 2,
+  MPCA_LANG_MEMOISE              = 4
 };
 
 mpc_parser_t *mpca_grammar(int flags, const char *grammar, ...);
@@ -363,6 +394,27 @@ mpc_err_t *mpca_lang_file(int flags, FILE *f, ...);
 mpc_err_t *mpca_lang_pipe(int flags, FILE *f, ...);
 mpc_err_t *mpca_lang_contents(int flags, const char *filename, ...);
 
+/*
+** Tables
+*/
+
+typedef struct {
+  char type;
+  int n, x, f, d;
+  const char *s;
+  const unsigned char *t;
+} mpc_table_node_t;
+
+typedef struct {
+  int roots;
+  int nodes_num;
+  const mpc_table_node_t *nodes;
+  const int *links;
+} mpc_table_t;
+
+int mpc_table_print(FILE *f, const char *name, int n, ...);
+int mpc_table_load(const mpc_table_t *t, int n, ...);
+
 /*
 ** Misc
 */
@@ -1,5 +1,11 @@
+/* Expose mmap and friends when compiling with -std=c99 */
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
 
 #include "mpc.h"
 #include "hash_table/hash_table.h"
@@ -27,14 +33,39 @@ void add_history(char* unused) {}
 #else
 #include <editline/readline.h>
 /* #include <editline/history.h> */
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* The JIT emits x86-64 code into mmap'd memory */
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_X86_64
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+/* Files given on the command line can be read on worker threads */
+#ifndef _WIN32
+#define READ_THREADS
+#include <pthread.h>
 #endif
 
 /* Forward environment and variable declarations */
 
 struct lval;
 struct lenv;
+struct lmemo;
+struct ljit;
+struct lfile;
+struct lseq;
 typedef struct lval lval;
 typedef struct lenv lenv;
+typedef struct lmemo lmemo;
+typedef struct ljit ljit;
+typedef struct lfile lfile;
+typedef struct lseq lseq;
 
 /* Forward parser declarations */
 
@@ -53,7 +84,8 @@ mpc_parser_t* Lispy;
 /* type enumerations */
 
 enum { LVAL_ERR, LVAL_NUM,  LVAL_DEC, LVAL_SYM, LVAL_BOOL, LVAL_OK,
-       LVAL_STR, LVAL_USTR, LVAL_FUN, LVAL_SEXPR, LVAL_QEXPR };
+       LVAL_STR, LVAL_USTR, LVAL_FUN, LVAL_SEXPR, LVAL_QEXPR,
+       LVAL_RECUR, LVAL_FILE, LVAL_SEQ };
 
 enum { LVAL_FALSE, LVAL_TRUE };
 
@@ -77,6 +109,14 @@ struct lval {
   lenv* env;
   lval* formals;
   lval* body;
+  lmemo* memo;
+  ljit* jit;
+
+  /* File */
+  lfile* file;
+
+  /* Lazy sequence */
+  lseq* seq;
 
   /* Expression */
   int count;
@@ -90,6 +130,85 @@ struct lenv {
   int count;
   char** syms;
   lval** vals;
+
+  /* Whether this is a global environment, and otherwise how many of the
+   * names watched by lwatch_has it binds */
+  int global;
+  int shadows;
+};
+
+/* Result cache for a memoised function. Entries live in a chained hash
+ * table keyed by the structural hash of the argument list, and in a
+ * doubly linked list ordered from most to least recently used. */
+typedef struct lmemo_entry lmemo_entry;
+struct lmemo_entry {
+  unsigned long hash;
+  lval* args;
+  lval* result;
+  lmemo_entry* chain;
+  lmemo_entry* prev;
+  lmemo_entry* next;
+};
+
+struct lmemo {
+  int refs;
+  int capacity;
+  int count;
+  int size;
+  lmemo_entry** buckets;
+  lmemo_entry* head;
+  lmemo_entry* tail;
+
+  /* Statistics */
+  long hits;
+  long misses;
+  long evictions;
+};
+
+/* Call profile and compiled code shared by all copies of a lambda */
+struct ljit {
+  int refs;
+  int state;
+  long calls;
+  long runs;
+  long bails;
+
+  /* Argument types the code is specialised for and type it returns */
+  int nargs;
+  int* sig;
+  int ret;
+
+  void* code;
+  size_t size;
+
+  /* Body compiled ahead of time by --emit-c */
+  lbuiltin aot;
+
+  /* Body as written, when the one run was optimised, and lenv_version
+   * when the lambda was made */
+  lval* source;
+  unsigned long version;
+};
+
+/* Lazy sequence, shared by all copies of it */
+struct lseq {
+  int refs;
+  int kind;
+
+  /* Sequence drawn from, by map, filter and the takes */
+  lseq* src;
+
+  /* Function applied, by map, filter, take-while and iterate */
+  lval* f;
+
+  /* Q-Expression of a list, first value of iterate, and the file name or
+   * handle of lines */
+  lval* x;
+
+  /* Bounds of a range, and in end the count of a take */
+  long start;
+  long end;
+  long step;
 };
 
 /* We now define functions to manipulate types, some of these also manipulate the environment so we forward declare these operations here */
@@ -98,6 +217,13 @@ void lenv_del(lenv*);
 lenv* lenv_copy(lenv*);
 void lenv_put(lenv*, lval*, lval*);
 lval* lenv_get(lenv*, lval*);
+void lmemo_release(lmemo*);
+ljit* ljit_new(void);
+void ljit_release(ljit*);
+void lfile_release(lfile*);
+void lseq_release(lseq*);
+char* lseq_name(lseq*);
+lbuiltin ty_unspecialise(lbuiltin);
 
 /* Creation ops */
 lval* lval_num(long x) {
@@ -182,6 +308,8 @@ lval* lval_fun(lbuiltin func, char* name) {
 	lval* v = malloc(sizeof(lval));
 	v->type = LVAL_FUN;
 	v->builtin = func;
+	v->memo = NULL;
+	v->jit = NULL;
 	v->fun_name = malloc(strlen(name) + 1);
 	strcpy(v->fun_name, name);
 	return v;
@@ -191,8 +319,12 @@ lval* lval_lambda(lval* formals, lval* body) {
 	lval* v = malloc(sizeof(lval));
 	v->type = LVAL_FUN;
 
-	/* Set Builtin to Null */
+	/* Set Builtin and result cache to Null */
 	v->builtin = NULL;
+	v->memo = NULL;
+
+	/* Start counting calls for the JIT */
+	v->jit = ljit_new();
 
 	/* Build new environment */
 	v->env = lenv_new();
@@ -214,6 +346,9 @@ char* ltype_name(int t) {
 		case LVAL_STR: return "String";
 		case LVAL_SEXPR: return "S-Expression";
 		case LVAL_QEXPR: return "Q-Expression";
+		case LVAL_RECUR: return "Recur";
+		case LVAL_FILE: return "File";
+		case LVAL_SEQ: return "Sequence";
 		default: return "Unknown";
 	}
 }
@@ -234,6 +369,8 @@ void lval_del(lval* v) {
 				lval_del(v->formals);
 				lval_del(v->body);
 			}
+			if (v->memo) { lmemo_release(v->memo); }
+			if (v->jit) { ljit_release(v->jit); }
 			break;
 
 
@@ -242,9 +379,14 @@ void lval_del(lval* v) {
 		case LVAL_SYM: free(v->sym); break;
 		case LVAL_STR: free(v->str); break;
 
+		/* Files are closed once no copy holds them */
+		case LVAL_FILE: lfile_release(v->file); break;
+		case LVAL_SEQ: lseq_release(v->seq); break;
+
 		/* If Qexpr or Sexpr then delete all elements inside */
 		case LVAL_QEXPR:
 		case LVAL_SEXPR:
+		case LVAL_RECUR:
 			for (int i = 0; i < v->count; i++) {
 				lval_del(v->cell[i]);
 			}
@@ -256,17 +398,82 @@ void lval_del(lval* v) {
 	free(v);
 }
 
-lval* lval_read_num(mpc_ast_t* t) {
+/* Number literals are read by hand rather than by strtol and strtod, as
+ * the grammar allows only an optional minus sign and decimal digits with
+ * at most one point. Integers are accumulated without a sign and checked
+ * for overflow digit by digit. Decimals whose digits make an integer of at
+ * most 2^53, with at most 22 of them after the point, are almost all of
+ * them. Both that integer and the power of ten dividing it are exact as
+ * doubles, and IEEE division rounds their quotient correctly. Anything
+ * else falls back to strtod. */
+
+int lread_long(char* s, char* end, long* x) {
+	/* Read the integer from s to end into x, returning 0 on overflow */
+	int neg = *s == '-';
+	if (neg) { s++; }
+	unsigned long max = neg ? (unsigned long)LONG_MAX + 1 : LONG_MAX;
+	unsigned long n = 0;
+	for (; s < end; s++) {
+		unsigned d = *s - '0';
+		if (n > (max - d) / 10) { return 0; }
+		n = n * 10 + d;
+	}
+	*x = neg ? (long)(0 - n) : (long)n;
+	return 1;
+}
+
+static const double lread_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+int lread_double(char* s, char* end, double* x) {
+	/* Read the decimal from s to end into x, returning 0 if out of range */
+	char* start = s;
+	int neg = *s == '-';
+	if (neg) { s++; }
+
+	/* Trailing zeros after the point change nothing */
+	char* point = memchr(s, '.', end - s);
+	if (point) { while (end > point + 1 && end[-1] == '0') { end--; } }
+
+	/* Collect the significant digits, while they fit */
+	unsigned long long m = 0;
+	int digits = 0;
+	int frac = 0;
+	for (; s < end; s++) {
+		if (*s == '.') { continue; }
+		if (point && s > point) { frac++; }
+		if (m == 0 && *s == '0') { continue; }
+		if (++digits > 19) { break; }
+		m = m * 10 + (*s - '0');
+	}
+	if (digits <= 19 && m <= 1ULL << 53 && frac <= 22) {
+		double d = (double)m / lread_pow10[frac];
+		*x = neg ? -d : d;
+		return 1;
+	}
+
+	/* Otherwise leave it to strtod, on a copy ending with the literal */
+	size_t n = end - start;
+	char* copy = malloc(n + 1);
+	memcpy(copy, start, n);
+	copy[n] = '\0';
 	errno = 0;
-	long x = strtol(t->contents, NULL, 10);
-	return errno != ERANGE ?
+	*x = strtod(copy, NULL);
+	free(copy);
+	return errno != ERANGE;
+}
+
+lval* lval_read_num(mpc_ast_t* t) {
+	long x;
+	return lread_long(t->contents, t->contents + strlen(t->contents), &x) ?
 		lval_num(x) : lval_err("invalid number");
 }
 
 lval* lval_read_dec(mpc_ast_t* t) {
-	errno = 0;
-	double x = strtof(t->contents, NULL);
-	return errno != ERANGE ?
+	double x;
+	return lread_double(t->contents, t->contents + strlen(t->contents), &x) ?
 		lval_dec(x): lval_err("invalid decimal");
 }
 
@@ -331,1186 +538,6310 @@ lval* lval_read(mpc_ast_t* t) {
 	return x;
 }
 
-void lval_print_str(lval* v) {
-	/* Allocate new space for escaped string and print between quotes */
-	char* escaped = malloc(strlen(v->str)+1);
-	strcpy(escaped, v->str);
-	escaped = mpcf_escape(escaped);
+/* Hand written reader for the same grammar, building lvals straight from
+ * the input without an mpc_ast_t in between. It follows the grammar as mpc
+ * runs it, trying each kind of expression in order and taking the longest
+ * match of each, so "12x" is still read as 12 then x. On a syntax error it
+ * gives up and the input is read again by mpc, so error messages and their
+ * positions are exactly those of the grammar. */
+
+/* Whether to read with mpc rather than the hand written reader */
+int reader_mpc = 0;
+
+/* The AST of each parse by mpc is built in this arena and released in one
+ * go once read, with the bytes it took kept for reporting. Every thread
+ * reading has its own. */
+#define READER_ARENA_CHUNK (64 * 1024)
+MPC_THREAD_LOCAL mpc_arena_t* reader_arena;
+MPC_THREAD_LOCAL size_t reader_arena_used = 0;
+
+typedef struct {
+	char* s;
+	char* end;
+
+	/* Scratch space for copying out tokens */
+	char* buf;
+	size_t size;
+
+	/* Whether input may carry on past the end, and set when reading ran
+	 * into the end */
+	int partial;
+	int more;
+} lreader;
+
+int lread_space(char c) {
+	return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f' || c == '\v';
+}
 
-	printf("\"%s\"", escaped);
-	free(escaped);
+int lread_digit(char c) {
+	return c >= '0' && c <= '9';
 }
 
-void lval_print_ustr(lval* v) {
-	/* Used for builtin show, does not escape string */
-	printf("\"%s\"", v->str);
+int lread_symbol(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || lread_digit(c)
+		|| (c != '\0' && strchr("_+-*/\\=<>!&|", c));
 }
 
-void lval_print (lval* v);
+void lread_skip(lreader* r) {
+	/* Skip whitespace and comments */
+	while (1) {
+		while (lread_space(*r->s)) { r->s++; }
+		if (*r->s != ';') { break; }
+
+		/* Stop at the start of a comment that may carry on past the end */
+		char* c = r->s;
+		while (*c != '\0' && *c != '\r' && *c != '\n') { c++; }
+		if (c == r->end && r->partial) { r->more = 1; return; }
+		r->s = c;
+	}
+	if (r->s == r->end) { r->more = 1; }
+}
 
-void lval_expr_print(lval* v, char open, char close) {
-	putchar(open);
-	for (int i = 0; i < v->count; i++) {
-		lval_print(v->cell[i]);
+char* lread_token(lreader* r, char* start) {
+	/* Copy the token from start up to the current position */
+	size_t n = r->s - start;
+	if (n + 1 > r->size) {
+		r->size = n + 1;
+		r->buf = realloc(r->buf, r->size);
+	}
+	memcpy(r->buf, start, n);
+	r->buf[n] = '\0';
+	return r->buf;
+}
 
-		/* Don't print trailing space if last element */
-		if (i != (v->count-1)) {
-			putchar(' ');
+lval* lread_list(lreader* r, lval* x, char close);
+
+lval* lread_value(lreader* r) {
+	/* Read the expression at the current position, NULL if there is none */
+	char* start = r->s;
+	char* c = r->s;
+
+	/* Decimals and numbers */
+	if (*c == '-') { c++; }
+	if (lread_digit(*c)) {
+		while (lread_digit(*c)) { c++; }
+		if (*c == '.') {
+			c++;
+			while (lread_digit(*c)) { c++; }
+			r->s = c;
+			double x;
+			return lread_double(start, c, &x) ? lval_dec(x) : lval_err("invalid decimal");
 		}
+		r->s = c;
+		long x;
+		return lread_long(start, c, &x) ? lval_num(x) : lval_err("invalid number");
 	}
-	putchar(close);
-}
 
-void lval_print(lval* v){
-	switch (v->type){
-		case LVAL_NUM: printf("%li", v->num); break;
-		case LVAL_DEC: printf("%lf", v->dec); break;
-		case LVAL_BOOL:
-			if (v->boo == LVAL_TRUE) { printf("true"); }
-			else { printf("false"); }; break;
-		case LVAL_OK: break;
-		case LVAL_ERR: printf("Error: %s", v->err); break;
-		case LVAL_SYM: printf("%s", v->sym); break;
-		case LVAL_STR: lval_print_str(v); break;
-		case LVAL_USTR: lval_print_ustr(v); break;
-		case LVAL_FUN:
-			if (v->builtin) {
-				printf("<builtin>: %s", v->fun_name); break;
-			} else {
-				printf("(\\ "); lval_print(v->formals);
-				putchar(' '); lval_print(v->body); putchar(')');
-			}
-			break;
-		case LVAL_SEXPR: lval_expr_print(v, '(', ')'); break;
-		case LVAL_QEXPR: lval_expr_print(v, '{', '}'); break;
+	if (strncmp(start, "true", 4) == 0) { r->s += 4; return lval_bool(LVAL_TRUE); }
+	if (strncmp(start, "false", 5) == 0) { r->s += 5; return lval_bool(LVAL_FALSE); }
+
+	if (lread_symbol(*start)) {
+		while (lread_symbol(*r->s)) { r->s++; }
+		return lval_sym(lread_token(r, start));
 	}
+
+	if (*start == '"') {
+		int escaped = 0;
+		c = start + 1;
+		while (*c != '"') {
+			if (c == r->end) { r->more = 1; return NULL; }
+			if (*c == '\\' && c+1 != r->end && c[1] != '\n') { escaped = 1; c++; }
+			c++;
+		}
+		/* Copy the contents missing out the quotes, unescaping if needed */
+		r->s = c;
+		char* s = lread_token(r, start + 1);
+		r->s = c + 1;
+		if (!escaped) { return lval_str(s); }
+		char* unescaped = malloc(strlen(s) + 1);
+		strcpy(unescaped, s);
+		unescaped = mpcf_unescape(unescaped);
+		lval* str = lval_str(unescaped);
+		free(unescaped);
+		return str;
+	}
+
+	if (*start == '(') { r->s++; return lread_list(r, lval_sexpr(), ')'); }
+	if (*start == '{') { r->s++; return lread_list(r, lval_qexpr(), '}'); }
+	return NULL;
 }
 
-void lval_println(lval* v) { lval_print(v); putchar('\n'); }
+lval* lread_expr(lreader* r) {
+	lval* x = lread_value(r);
+	/* A token running up to the end might carry on past it */
+	if (r->s == r->end) { r->more = 1; }
+	return x;
+}
 
-lval* lval_copy(lval* v) {
+lval* lread_list(lreader* r, lval* x, char close) {
+	/* Read expressions into x until the closing character, or the end of
+	 * the input if close is '\0' */
+	lread_skip(r);
+	while (*r->s != close) {
+		if (r->s == r->end) { lval_del(x); return NULL; }
+		lval* y = lread_expr(r);
+		if (!y) { lval_del(x); return NULL; }
+		lval_add(x, y);
+		lread_skip(r);
+	}
+	if (close == '\0' && r->s != r->end) { lval_del(x); return NULL; }
+	r->s++;
+	return x;
+}
 
-  lval* x = malloc(sizeof(lval));
-  x->type = v->type;
+lval* lread(char* input, size_t length) {
+	/* Read all expressions in input, NULL on any syntax error */
+	lreader r;
+	r.s = input;
+	r.end = input + length;
+	r.buf = NULL;
+	r.size = 0;
+	r.partial = 0;
+	r.more = 0;
+	lval* x = lread_list(&r, lval_sexpr(), '\0');
+	free(r.buf);
+	return x;
+}
 
-  switch (v->type) {
+lval* lval_read_mpc(mpc_result_t* r, int ok, char** err) {
+	/* Convert the result of parsing with mpc in the reader arena, then
+	 * release the arena */
+	lval* x = NULL;
+	if (ok) {
+		x = lval_read(r->output);
+	} else {
+		*err = mpc_err_string(r->error);
+		mpc_err_delete(r->error);
+	}
+	mpc_arena_use(NULL);
+	reader_arena_used = mpc_arena_used(reader_arena);
+	mpc_arena_clear(reader_arena);
+	return x;
+}
 
-    /* Copy Functions and Numbers Directly */
-    case LVAL_DEC: x->dec = v->dec; break;
-    case LVAL_NUM: x->num = v->num; break;
-    case LVAL_BOOL: x->boo = v->boo; break;
+lval* lval_read_string(char* filename, char* input, char** err) {
+	/* Read every expression in input as an S-Expression, or return NULL
+	 * and set err to the parse error */
+	if (!reader_mpc) {
+		lval* x = lread(input, strlen(input));
+		if (x) { return x; }
+	}
+	mpc_result_t r;
+	mpc_arena_use(reader_arena);
+	return lval_read_mpc(&r, mpc_parse(filename, input, Lispy, &r), err);
+}
 
-    case LVAL_FUN:
-      if (v->builtin) {
-	      x->builtin = v->builtin;
-      	      x->fun_name = malloc(strlen(v->fun_name + 1));
-	      strcpy(x->fun_name, v->fun_name);
-      } else {
-	      x->builtin = NULL;
-	      x->env = lenv_copy(v->env);
-	      x->formals = lval_copy(v->formals);
-	      x->body = lval_copy(v->body);
-      }
-      break;
+lval* lval_read_file(char* filename, char** err) {
+	/* Read every expression in file as an S-Expression */
+	if (!reader_mpc) {
+		FILE* f = fopen(filename, "rb");
+		if (f) {
+			fseek(f, 0, SEEK_END);
+			long n = ftell(f);
+			fseek(f, 0, SEEK_SET);
+			char* input = malloc(n + 1);
+			n = fread(input, 1, n, f);
+			input[n] = '\0';
+			fclose(f);
+
+			lval* x = lread(input, n);
+			free(input);
+			if (x) { return x; }
+		}
+	}
+	mpc_result_t r;
+	mpc_arena_use(reader_arena);
+	return lval_read_mpc(&r, mpc_parse_contents(filename, Lispy, &r), err);
+}
 
-    /* Copy Strings using malloc and strcpy */
-    case LVAL_ERR:
-      x->err = malloc(strlen(v->err) + 1);
-      strcpy(x->err, v->err); break;
+/* Stream of top level expressions read from a file a chunk at a time, so
+ * that loading never holds more than the expression being read. Regular
+ * files are instead mapped into memory and read in place, with pages handed
+ * back to the kernel once read past */
 
-    case LVAL_SYM:
-      x->sym = malloc(strlen(v->sym) + 1);
-      strcpy(x->sym, v->sym); break;
+#define LSTREAM_CHUNK 65536
 
-    case LVAL_STR:
-      x->str = malloc(strlen(v->str) + 1);
-      strcpy(x->str, v->str); break;
+typedef struct {
+	FILE* f;
+	char* filename;
+	int eof;
 
+	/* Buffered input from pos to len, followed by a '\0' */
+	char* buf;
+	size_t pos;
+	size_t len;
+	size_t size;
 
-    /* Copy Lists by copying each sub-expression */
-    case LVAL_SEXPR:
-    case LVAL_QEXPR:
-      x->count = v->count;
-      x->cell = malloc(sizeof(lval*) * x->count);
-      for (int i = 0; i < x->count; i++) {
-        x->cell[i] = lval_copy(v->cell[i]);
-      }
-    break;
-  }
+	/* Position in the file of the start of the buffer */
+	long row;
+	long col;
 
-  return x;
-}
+	/* Start of the last expression read when it was a number, decimal,
+	 * boolean or symbol, which mpc could have read on into what follows,
+	 * kept in the buffer to describe a syntax error straight after it */
+	int marked;
+	size_t mark;
 
-lval* lval_pop(lval* v, int i) {
-	/* Find item and shift memory over the top */
-	lval* x = v->cell[i];
-	memmove(&v->cell[i], &v->cell[i+1],
-		sizeof(lval*) * (v->count-i-1));
-	/* Decrease count and reallocate */
-	v->count--;
-	v->cell = realloc(v->cell, sizeof(lval*) * v->count);
+	/* Whether buf is a mapping of the whole file, and how much of it has
+	 * been released */
+	int mapped;
+	size_t released;
 
-	return x;
+	lreader r;
+} lstream;
+
+int lstream_map(lstream* s) {
+#ifdef _WIN32
+	return 0;
+#else
+	/* The reader needs a '\0' after the input, which the zero filled end
+	 * of the last page gives for free unless the file fills it exactly */
+	struct stat st;
+	long page = sysconf(_SC_PAGESIZE);
+	if (fstat(fileno(s->f), &st) != 0 || !S_ISREG(st.st_mode)) { return 0; }
+	if (st.st_size == 0 || st.st_size % page == 0) { return 0; }
+
+	void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(s->f), 0);
+	if (map == MAP_FAILED) { return 0; }
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	s->buf = map;
+	s->len = st.st_size;
+	s->size = st.st_size;
+	s->eof = 1;
+	s->mapped = 1;
+	return 1;
+#endif
 }
 
-lval* lval_take(lval* v, int i) {
-	/* Grab item from lval list and delete the rest of the structure */
-	lval* x = lval_pop(v, i);
-	lval_del(v);
-	return x;
+lstream* lstream_open(char* filename, int map) {
+	FILE* f = fopen(filename, "rb");
+	if (!f) { return NULL; }
+
+	lstream* s = malloc(sizeof(lstream));
+	s->f = f;
+	s->filename = malloc(strlen(filename) + 1);
+	strcpy(s->filename, filename);
+	s->eof = 0;
+	s->pos = 0;
+	s->len = 0;
+	s->row = 0;
+	s->col = 0;
+	s->marked = 0;
+	s->mark = 0;
+	s->mapped = 0;
+	s->released = 0;
+	s->r.buf = NULL;
+	s->r.size = 0;
+	if (!map || !lstream_map(s)) {
+		s->size = LSTREAM_CHUNK;
+		s->buf = malloc(s->size + 1);
+		s->buf[0] = '\0';
+	}
+	return s;
 }
 
+void lstream_close(lstream* s) {
+#ifndef _WIN32
+	if (s->mapped) { munmap(s->buf, s->size); } else { free(s->buf); }
+#else
+	free(s->buf);
+#endif
+	fclose(s->f);
+	free(s->filename);
+	free(s->r.buf);
+	free(s);
+}
 
-lval* lval_join(lval* x, lval* y) {
-	/* Join two lval lists */
-	while (y->count) {
-		x = lval_add(x, lval_pop(y, 0));
+void lstream_release(lstream* s) {
+#ifndef _WIN32
+	/* Drop mapped pages already read so a long load keeps a small footprint */
+	if (s->mapped && s->pos - s->released >= LSTREAM_CHUNK * 16) {
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t upto = s->pos / page * page;
+		madvise(s->buf + s->released, upto - s->released, MADV_DONTNEED);
+		s->released = upto;
 	}
+#endif
+}
 
-	lval_del(y);
-	return x;
+void lstream_advance(lstream* s, char* from, char* to) {
+	/* Track the row and column as input is discarded, a line at a time */
+	char* nl;
+	while ((nl = memchr(from, '\n', to - from))) {
+		s->row++;
+		s->col = 0;
+		from = nl + 1;
+	}
+	s->col += to - from;
 }
 
-lval* lval_str_join(lval* x, lval* y) {
-	x->str = realloc(x->str, strlen(x->str) + strlen(y->str) + 1);
-	strcat(x->str, y->str);
+void lstream_fill(lstream* s) {
+	/* Drop consumed input and read the next chunk, growing the buffer
+	 * only when an expression is larger than it */
+	size_t drop = s->marked ? s->mark : s->pos;
+	lstream_advance(s, s->buf, s->buf + drop);
+	memmove(s->buf, s->buf + drop, s->len - drop);
+	s->len -= drop;
+	s->pos -= drop;
+	s->mark -= s->marked ? drop : 0;
+
+	if (s->size - s->len < LSTREAM_CHUNK) {
+		s->size = s->size * 2;
+		s->buf = realloc(s->buf, s->size + 1);
+	}
+	size_t n = fread(s->buf + s->len, 1, s->size - s->len, s->f);
+	if (n == 0) { s->eof = 1; }
+	s->len += n;
+	s->buf[s->len] = '\0';
+}
 
-	lval_del(y);
-	return x;
+char* lstream_error(lstream* s) {
+	/* Describe a syntax error at the current expression by parsing the rest
+	 * of the buffer with mpc, placed at its position in the file. Parsing
+	 * starts from a number, decimal, boolean or symbol just before it, so
+	 * mpc expects what could have carried that on as when reading the
+	 * whole file */
+	size_t from = s->marked ? s->mark : s->pos;
+	lstream_advance(s, s->buf, s->buf + from);
+	mpc_result_t r;
+	mpc_arena_use(reader_arena);
+	int ok = mpc_nparse(s->filename, s->buf + from, s->len - from, Lispy, &r);
+	mpc_arena_use(NULL);
+	mpc_arena_clear(reader_arena);
+	if (ok) {
+		char* err = malloc(strlen(s->filename) + 32);
+		sprintf(err, "%s: error: Unreadable input\n", s->filename);
+		return err;
+	}
+	if (r.error->state.row == 0) { r.error->state.col += s->col; }
+	r.error->state.row += s->row;
+	char* err = mpc_err_string(r.error);
+	mpc_err_delete(r.error);
+	return err;
 }
 
-int lval_eq(lval* x, lval* y) {
-	/* Check whether two lvals are equal */
-	if (x->type != y->type) {
-		/* If the type isn't equal, check the types are not numerical */
-		if (!(x->type == LVAL_NUM || x->type == LVAL_DEC || x->type == LVAL_BOOL)) {
-			return 0;
+lval* lstream_next(lstream* s, char** err) {
+	/* Read the next top level expression, returning NULL at the end of the
+	 * file, or on a syntax error with err set */
+	*err = NULL;
+	while (1) {
+		lreader* r = &s->r;
+		r->s = s->buf + s->pos;
+		r->end = s->buf + s->len;
+		r->partial = !s->eof;
+		r->more = 0;
+
+		lread_skip(r);
+		s->pos = r->s - s->buf;
+		if (r->more && !s->eof) { lstream_fill(s); continue; }
+		if (r->s == r->end) { return NULL; }
+
+		/* Read again with more input if the expression could be cut off */
+		lval* x = lread_expr(r);
+		if (r->more && !s->eof) {
+			if (x) { lval_del(x); }
+			lstream_fill(s);
+			continue;
 		}
-		if (!(y->type == LVAL_NUM || y->type == LVAL_DEC || y->type == LVAL_BOOL)) {
-			return 0;
+		if (!x) {
+			*err = lstream_error(s);
+			return NULL;
 		}
+		s->marked = x->type == LVAL_NUM || x->type == LVAL_DEC
+			|| x->type == LVAL_BOOL || x->type == LVAL_SYM;
+		s->mark = s->pos;
+		s->pos = r->s - s->buf;
+		lstream_release(s);
+		return x;
 	}
+}
 
-	switch (x->type) {
-		/* Compare Number/Decimal/Boolean Value */
-		case LVAL_NUM:
-			switch (y->type) {
-				case LVAL_NUM:
-					return (x->num == y->num);
-				case LVAL_DEC:
-					return (x->num == y->dec);
-				case LVAL_BOOL:
-					return (x->num == y->boo);
-			}
-		case LVAL_DEC:
-			switch (y->type) {
-				case LVAL_NUM:
-					return (x->dec == y->num);
-				case LVAL_DEC:
-					return (x->dec == y->dec);
-				case LVAL_BOOL:
-					return (x->dec == y->boo);
-			}
-		case LVAL_BOOL:
-			switch (y->type) {
-				case LVAL_NUM:
-					return (x->boo == y->num);
-				case LVAL_DEC:
-					return (x->boo == y->dec);
-				case LVAL_BOOL:
-					return (x->boo == y->boo);
-			}
-		/* Compare String values */
-		case LVAL_ERR: return (strcmp(x->err, y->err) == 0);
-		case LVAL_SYM: return (strcmp(x->sym, y->sym) == 0);
-		case LVAL_STR: return (strcmp(x->str, y->str) == 0);
+/* Files opened from the language. A handle is shared by every copy of the
+ * lval holding it, so reading a line through one copy moves them all on,
+ * and is closed by close or once the last copy is deleted. Reading goes
+ * through an lstream, so regular files are mapped and their pages handed
+ * back as lines are read past, and anything else is read in large chunks.
+ * Writing goes through stdio with a buffer of LFILE_BUFFER bytes, which
+ * stdio flushes at exit for files never closed. */
+
+#define LFILE_BUFFER (1 << 20)
+
+struct lfile {
+	int refs;
+	char* path;
+	lstream* in;
+	FILE* out;
+	char* buf;
+};
 
-		/* If builtin compare, otherwise compare formals and body */
-		case LVAL_FUN:
-			if (x->builtin || y->builtin) {
-				return x->builtin == y->builtin;
-			} else {
-				return lval_eq(x->formals, y-> formals)
-					&& lval_eq(x->body, y->body);
-			}
-		/* If list, compare every individual element */
-		case LVAL_QEXPR:
-		case LVAL_SEXPR:
-			if (x->count != y->count) { return 0; }
-			for (int i = 0; i < x->count; i++) {
-				if (!lval_eq(x->cell[i], y->cell[i])) { return 0; }
-			}
-			return 1;
-		break;
+lfile* lfile_open(char* path, char* mode) {
+	/* Open path for reading with mode "r", or for writing with "w" or
+	 * appending with "a", returning NULL if it cannot be */
+	lstream* in = NULL;
+	FILE* out = NULL;
+	if (strcmp(mode, "r") == 0) {
+		in = lstream_open(path, 1);
+		if (!in) { return NULL; }
+	} else {
+		out = fopen(path, strcmp(mode, "a") == 0 ? "ab" : "wb");
+		if (!out) { return NULL; }
 	}
-	return 0;
-}
 
-lval* lval_eval(lenv* e, lval* a);
-lval* lval_call(lenv* e, lval* f, lval* a);
-lval* lval_eval_sexpr(lenv* e, lval* v) {
+	lfile* h = malloc(sizeof(lfile));
+	h->refs = 1;
+	h->path = malloc(strlen(path) + 1);
+	strcpy(h->path, path);
+	h->in = in;
+	h->out = out;
+	h->buf = NULL;
+	if (out) {
+		h->buf = malloc(LFILE_BUFFER);
+		setvbuf(out, h->buf, _IOFBF, LFILE_BUFFER);
+	}
+	return h;
+}
 
-	/* Evalutate Children */
-	for (int i = 0; i < v->count; i++) {
-		v->cell[i] = lval_eval(e, v->cell[i]);
+int lfile_close(lfile* h) {
+	/* Close the file if still open, returning 0 if writing it failed */
+	int ok = 1;
+	if (h->in) {
+		lstream_close(h->in);
+		h->in = NULL;
 	}
+	if (h->out) {
+		if (ferror(h->out)) { ok = 0; }
+		if (fclose(h->out) != 0) { ok = 0; }
+		h->out = NULL;
+		free(h->buf);
+		h->buf = NULL;
+	}
+	return ok;
+}
 
-	/* Error Checking */
-	for (int i = 0; i < v->count; i++) {
-		if (v->cell[i]->type == LVAL_ERR) {return lval_take(v, i);}
+void lfile_release(lfile* h) {
+	h->refs--;
+	if (h->refs > 0) { return; }
+	lfile_close(h);
+	free(h->path);
+	free(h);
+}
+
+lval* lval_file(lfile* h) {
+	lval* v = malloc(sizeof(lval));
+	v->type = LVAL_FILE;
+	v->file = h;
+	return v;
+}
+
+lval* lfile_line(lfile* h) {
+	/* Read the next line as a string without its line ending, found a
+	 * buffer at a time, or return NULL at the end of the file */
+	lstream* s = h->in;
+	char* nl;
+	while (!(nl = memchr(s->buf + s->pos, '\n', s->len - s->pos))) {
+		if (s->eof) { break; }
+		lstream_fill(s);
 	}
 
-	/* Empty Expression */
-	if (v->count == 0) { return v; }
+	char* start = s->buf + s->pos;
+	char* end = nl ? nl : s->buf + s->len;
+	if (!nl && end == start) { return NULL; }
+	s->pos = (nl ? nl + 1 : end) - s->buf;
+	if (end > start && end[-1] == '\r') { end--; }
 
-	/* Single Expression */
-	if (v->count == 1) { return lval_take(v, 0); }
+	lval* v = malloc(sizeof(lval));
+	v->type = LVAL_STR;
+	v->str = malloc(end - start + 1);
+	memcpy(v->str, start, end - start);
+	v->str[end - start] = '\0';
+	lstream_release(s);
+	return v;
+}
 
-	/* Ensure First Element is Symbol */
-	lval* f = lval_pop(v, 0);
-	if (f->type != LVAL_FUN) {
-		lval* err = lval_err(
-				"S-Expression starts with incorrect type. "
-				"Got %s, Expected %s. ",
-				ltype_name(f->type), ltype_name(LVAL_FUN));
-		lval_del(f); lval_del(v);
-		return err;
+/* Numbers are printed by hand rather than by printf, which parses its format
+ * and consults the locale for every number. Integers are written two digits
+ * at a time from a table. Decimals are written with the fewest digits that
+ * read back as the same double, found by Ulf Adams' Ryu algorithm, and
+ * always with a point and no exponent so the reader takes them as decimals
+ * again. Ryu multiplies by 128 bit approximations of powers of five, which
+ * are made here from every 26th of them and a two bit correction, as in
+ * Ryu's small table variant. Both write into a buffer of LFMT_SIZE bytes
+ * and return the length written. */
+
+/* Long enough for the longest decimal, such as -2.2250738585072014e-308 */
+#define LFMT_SIZE 336
+
+static const char lfmt_digit_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+int lfmt_ulong(char* buf, unsigned long long x) {
+	/* Write the digits backwards, then move them to the front */
+	char tmp[20];
+	char* p = tmp + sizeof(tmp);
+	while (x >= 100) {
+		const char* d = lfmt_digit_pairs + (x % 100) * 2;
+		x /= 100;
+		*--p = d[1];
+		*--p = d[0];
 	}
-
-	/* Call builtin with operator */
-	lval* result = lval_call(e, f, v);
-	lval_del(f);
-	return result;
+	if (x >= 10) {
+		*--p = lfmt_digit_pairs[x * 2 + 1];
+		*--p = lfmt_digit_pairs[x * 2];
+	} else {
+		*--p = '0' + x;
+	}
+	int n = tmp + sizeof(tmp) - p;
+	memcpy(buf, p, n);
+	buf[n] = '\0';
+	return n;
 }
 
-lval* lval_eval(lenv* e, lval* v) {
-	if (v->type == LVAL_SYM) {
-	    	lval* x = lenv_get(e, v);
-	    	lval_del(v);
-		return x;
- 	}
-	/* Evalutate Sexpressions */
-	if (v->type == LVAL_SEXPR) { return lval_eval_sexpr(e, v); }
-	/* All other lval types remain the same */
-	return v;
+int lfmt_long(char* buf, long x) {
+	if (x < 0) {
+		buf[0] = '-';
+		return 1 + lfmt_ulong(buf + 1, -(unsigned long)x);
+	}
+	return lfmt_ulong(buf, x);
 }
 
-lval* builtin_eval(lenv* e, lval* a);
-lval* lval_call(lenv* e, lval* f, lval* a) {
-	/* Apply function f to variable a */
-	/* If Builtin then simply apply that */
-	if (f->builtin) { return f->builtin(e, a); }
+static const unsigned long long lfmt_pow5_split[13][2] = {
+	{ 0x0000000000000000u, 0x1000000000000000u },
+	{ 0x0000000000000000u, 0x14adf4b7320334b9u },
+	{ 0x0e549208b31adb10u, 0x1aba4714957d300du },
+	{ 0x6dc6ad264d8f0866u, 0x1145b7e285bf98f5u },
+	{ 0xeb1dbd923d8596cau, 0x1652efdc6018a1fcu },
+	{ 0xb4c1b80b22ae923cu, 0x1cda62055b2d9d83u },
+	{ 0x5bb28b4e8f7e4c30u, 0x12a5568b9f52f416u },
+	{ 0xf08aed437682d4fbu, 0x1819651531f9e78fu },
+	{ 0xb4ee134ad99bf150u, 0x1f25c186a6f04c28u },
+	{ 0x16499ecb70c25f03u, 0x1420eb449c8842e6u },
+	{ 0x85a56ead360865b0u, 0x1a03fde214caf085u },
+	{ 0x093db1d57999890bu, 0x10cfeb353a97dad8u },
+	{ 0xcf38bb735e3f36acu, 0x15baaf44fa52673eu },
+};
+static const unsigned int lfmt_pow5_offsets[21] = {
+	0x00000000, 0x00000000, 0x00000000, 0x00000000,
+	0x40000000, 0x59695995, 0x55545555, 0x56555515,
+	0x41150504, 0x40555410, 0x44555145, 0x44504540,
+	0x45555550, 0x40004000, 0x96440440, 0x55565565,
+	0x54454045, 0x40154151, 0x55559155, 0x51405555,
+	0x00000105,
+};
+static const unsigned long long lfmt_pow5_inv_split[15][2] = {
+	{ 0x0000000000000001u, 0x2000000000000000u },
+	{ 0x52a6c95fc0655034u, 0x18c240c4aecb13bbu },
+	{ 0x7ca8d50071dfc806u, 0x1327fc58da0f6ff5u },
+	{ 0x6520247d3556476eu, 0x1da48ce468e7c702u },
+	{ 0x6139cdd76802e6e9u, 0x16ef5b40c2fc7779u },
+	{ 0xf951a7ff43de8c79u, 0x11bebdf578b2f391u },
+	{ 0x7be8bee8d6e957e8u, 0x1b758d848fac54b0u },
+	{ 0x8bd3f9e999a423eau, 0x153eda614071a3b7u },
+	{ 0x0848f973cb3ee3ceu, 0x10701bd527b4978cu },
+	{ 0x153285ebb9efbfa2u, 0x196fbb9bb44db44du },
+	{ 0xadeee7f86c07b696u, 0x13ae3591f5b4d936u },
+	{ 0x4d686a4eaf182222u, 0x1e74404f3daada91u },
+	{ 0x98c0a106e09ebd9fu, 0x17900ea4fda7c257u },
+	{ 0x8f20e37371497d0eu, 0x123b140576d820b2u },
+	{ 0xb043138134743d85u, 0x1c35f4275f7a29adu },
+};
+static const unsigned int lfmt_pow5_inv_offsets[22] = {
+	0x54544554, 0x04055545, 0x10041000, 0x00400414,
+	0x40010000, 0x41155555, 0x00000454, 0x00010044,
+	0x40000000, 0x44000041, 0x50454450, 0x55550054,
+	0x51655554, 0x40004000, 0x01000001, 0x00010500,
+	0x51515411, 0x05555554, 0x50411500, 0x40040000,
+	0x05040110, 0x00000000,
+};
 
-	/* Loop through all arguments in a */
-	int given = a->count;
-	int total = f->formals->count;
-	while (a->count) {
-		/* We bind each argument to a formal, if we run out, pass an error */
-		if (f->formals->count == 0) {
-			lval_del(a); return lval_err(
-					"Function passed too many arguments. "
-					"Got %i, Expected %i.", given, total);
-		}
+#define LFMT_POW5_STEP 26
+#define LFMT_POW5_BITS 125
 
-		/* Pop the first symbol from the formals */
-		lval* sym = lval_pop(f->formals, 0);
+static const unsigned long long lfmt_pow5_small[LFMT_POW5_STEP] = {
+	1u, 5u, 25u, 125u, 625u, 3125u, 15625u, 78125u, 390625u, 1953125u,
+	9765625u, 48828125u, 244140625u, 1220703125u, 6103515625u,
+	30517578125u, 152587890625u, 762939453125u, 3814697265625u,
+	19073486328125u, 95367431640625u, 476837158203125u,
+	2384185791015625u, 11920928955078125u, 59604644775390625u,
+	298023223876953125u,
+};
 
-		/* '&' denotes a variable number of arguments */
-		if (strcmp(sym->sym, "&") == 0) {
-			if (f->formals->count != 1) {
-				lval_del(a);
-				return lval_err("Function format invalid. "
-						"symbol '&' not followed by single symbol.");
-			}
+unsigned long long lfmt_umul128(unsigned long long a, unsigned long long b,
+		unsigned long long* hi) {
+	/* Multiply in 32 bit halves where there is no 128 bit type,
+	 * returning the low word */
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 p = (unsigned __int128)a * b;
+	*hi = p >> 64;
+	return p;
+#else
+	unsigned long long a0 = a & 0xffffffffu, a1 = a >> 32;
+	unsigned long long b0 = b & 0xffffffffu, b1 = b >> 32;
+	unsigned long long p00 = a0 * b0, p01 = a0 * b1;
+	unsigned long long p10 = a1 * b0, p11 = a1 * b1;
+	unsigned long long mid = (p00 >> 32) + (p01 & 0xffffffffu) + (p10 & 0xffffffffu);
+	*hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+	return (mid << 32) | (p00 & 0xffffffffu);
+#endif
+}
 
-			/* Next formal should be bound to remaining arguments */
-			lval* nsym = lval_pop(f->formals, 0);
-			a->type = LVAL_QEXPR;
-			lenv_put(f->env, nsym, a);
-			lval_del(sym); lval_del(nsym);
-			break;
-		}
+unsigned long long lfmt_shr128(unsigned long long lo, unsigned long long hi, int n) {
+	/* Shift right by 0 < n < 64 */
+	return (hi << (64 - n)) | (lo >> n);
+}
 
-		/* Bind a copy into the function's environment */
-		lval* val = lval_pop(a, 0);
-		lenv_put(f->env, sym, val);
+int lfmt_pow5_bits(int e) {
+	/* The bits in 5^e, for e up to 3528 */
+	return ((e * 1217359) >> 19) + 1;
+}
 
-		lval_del(sym); lval_del(val);
+void lfmt_pow5(int i, int inv, unsigned long long* r) {
+	/* Take the nearest stored power and scale it by an exact small one.
+	 * For 5^i that power is below, for 2^k / 5^i it is above */
+	int base = inv ? (i + LFMT_POW5_STEP - 1) / LFMT_POW5_STEP : i / LFMT_POW5_STEP;
+	int offset = inv ? base * LFMT_POW5_STEP - i : i - base * LFMT_POW5_STEP;
+	const unsigned long long* mul = inv ? lfmt_pow5_inv_split[base] : lfmt_pow5_split[base];
+	if (offset == 0) {
+		r[0] = mul[0];
+		r[1] = mul[1];
+		return;
 	}
+	unsigned long long m = lfmt_pow5_small[offset];
+	unsigned long long high1, high0;
+	unsigned long long low1 = lfmt_umul128(m, mul[1], &high1);
+	unsigned long long low0 = lfmt_umul128(m, mul[0] - inv, &high0);
+	unsigned long long sum = high0 + low1;
+	if (sum < high0) { high1++; }
+	int shift = inv ? lfmt_pow5_bits(base * LFMT_POW5_STEP) - lfmt_pow5_bits(i)
+		: lfmt_pow5_bits(i) - lfmt_pow5_bits(base * LFMT_POW5_STEP);
+	const unsigned int* fix = inv ? lfmt_pow5_inv_offsets : lfmt_pow5_offsets;
+	r[0] = lfmt_shr128(low0, sum, shift) + inv + ((fix[i / 16] >> ((i % 16) * 2)) & 3);
+	r[1] = lfmt_shr128(sum, high1, shift);
+}
 
-	/* Argument list is now bound so can be cleaned up */
-	lval_del(a);
+unsigned long long lfmt_mul_shift(unsigned long long m, unsigned long long* mul, int j) {
+	/* The top of m * mul shifted right by j, with j at least 64 */
+	unsigned long long high1, high0;
+	unsigned long long low1 = lfmt_umul128(m, mul[1], &high1);
+	lfmt_umul128(m, mul[0], &high0);
+	unsigned long long sum = high0 + low1;
+	if (sum < high0) { high1++; }
+	return lfmt_shr128(sum, high1, j - 64);
+}
 
-	/* If '&' is remaining, bind to empty list */
-	if (f->formals->count > 0 && strcmp(f->formals->cell[0]->sym, "&") ==0) {
+int lfmt_pow5_factor(unsigned long long x) {
+	int n = 0;
+	while (x % 5 == 0) { x /= 5; n++; }
+	return n;
+}
 
-		/* Check to ensure that & is not passed invalidly. */
-		if (f->formals->count != 2) {
-			return lval_err("Function format invalid. "
-					"Symbol '&' not followed by single symbol. ");
+void lfmt_shortest(unsigned long long mant, int exp, unsigned long long* digits, int* e10) {
+	/* Find the shortest digits that lie strictly between the halfway points
+	 * to the neighbouring doubles, or on them when mant is even, and which
+	 * are nearest to the value itself. Three values are scaled together:
+	 * the value vr and the bounds vm below and vp above it, all times four
+	 * so the bounds are whole numbers */
+	int e2;
+	unsigned long long m2;
+	if (exp == 0) {
+		e2 = 1 - 1023 - 52 - 2;
+		m2 = mant;
+	} else {
+		e2 = exp - 1023 - 52 - 2;
+		m2 = (1ull << 52) | mant;
+	}
+	int even = (m2 & 1) == 0;
+	unsigned long long mv = 4 * m2;
+	/* The gap below is half as wide at a power of two */
+	int mm_shift = mant != 0 || exp <= 1;
+
+	unsigned long long vr, vp, vm;
+	unsigned long long pow[2];
+	int e;
+	int vm_zeros = 0, vr_zeros = 0;
+	if (e2 >= 0) {
+		/* Divide by 10^q, which is multiplying by 2^-q and 1 / 5^q */
+		int q = ((e2 * 78913) >> 18) - (e2 > 3);
+		e = q;
+		int i = -e2 + q + LFMT_POW5_BITS + lfmt_pow5_bits(q) - 1;
+		lfmt_pow5(q, 1, pow);
+		vr = lfmt_mul_shift(4 * m2, pow, i);
+		vp = lfmt_mul_shift(4 * m2 + 2, pow, i);
+		vm = lfmt_mul_shift(4 * m2 - 1 - mm_shift, pow, i);
+		if (q <= 21) {
+			/* Only these can be exact, so check whether digits were cut */
+			if (mv % 5 == 0) {
+				vr_zeros = lfmt_pow5_factor(mv) >= q;
+			} else if (even) {
+				vm_zeros = lfmt_pow5_factor(mv - 1 - mm_shift) >= q;
+			} else {
+				vp -= lfmt_pow5_factor(mv + 2) >= q;
+			}
+		}
+	} else {
+		/* Multiply by 5^(-e2-q) and divide by 2^..., leaving 10^(e2+q) */
+		int q = ((-e2 * 732923) >> 20) - (-e2 > 1);
+		e = q + e2;
+		int i = -e2 - q;
+		int j = q - (lfmt_pow5_bits(i) - LFMT_POW5_BITS);
+		lfmt_pow5(i, 0, pow);
+		vr = lfmt_mul_shift(4 * m2, pow, j);
+		vp = lfmt_mul_shift(4 * m2 + 2, pow, j);
+		vm = lfmt_mul_shift(4 * m2 - 1 - mm_shift, pow, j);
+		if (q <= 1) {
+			vr_zeros = 1;
+			if (even) { vm_zeros = mm_shift == 1; } else { vp--; }
+		} else if (q < 63) {
+			vr_zeros = (mv & ((1ull << q) - 1)) == 0;
 		}
-		/* Pop and delete '&' symbol */
-		lval_del(lval_pop(f->formals, 0));
-
-		/* Pop next symbol and create empty list */
-		lval* sym = lval_pop(f->formals, 0);
-		lval* val = lval_qexpr();
-
-		/* Bind to environment and delete */
-		lenv_put(f->env, sym, val);
-		lval_del(sym); lval_del(val);
 	}
 
-	/* If all formals have been bound evaluate */
-	if (f->formals->count == 0) {
+	/* Drop digits while the bounds still differ, rounding the last */
+	int removed = 0;
+	int last = 0;
+	if (vm_zeros || vr_zeros) {
+		/* Exact cases, which need care to round half to even */
+		while (vp / 10 > vm / 10) {
+			vm_zeros &= vm % 10 == 0;
+			vr_zeros &= last == 0;
+			last = vr % 10;
+			vr /= 10; vp /= 10; vm /= 10;
+			removed++;
+		}
+		if (vm_zeros) {
+			while (vm % 10 == 0) {
+				vr_zeros &= last == 0;
+				last = vr % 10;
+				vr /= 10; vp /= 10; vm /= 10;
+				removed++;
+			}
+		}
+		if (vr_zeros && last == 5 && vr % 2 == 0) { last = 4; }
+		*digits = vr + ((vr == vm && (!even || !vm_zeros)) || last >= 5);
+	} else {
+		int round_up = 0;
+		if (vp / 100 > vm / 100) {
+			round_up = vr % 100 >= 50;
+			vr /= 100; vp /= 100; vm /= 100;
+			removed += 2;
+		}
+		while (vp / 10 > vm / 10) {
+			round_up = vr % 10 >= 5;
+			vr /= 10; vp /= 10; vm /= 10;
+			removed++;
+		}
+		*digits = vr + (vr == vm || round_up);
+	}
+	*e10 = e + removed;
+}
 
-		/* Set environment parent to evaluation environment */
-		f->env->par = e;
-		lval* v = lval_add(lval_sexpr(), lval_copy(f->body));
-		v->cell[0]->type = LVAL_SEXPR;
+int lfmt_double(char* buf, double x) {
+	unsigned long long bits;
+	memcpy(&bits, &x, sizeof(bits));
+	unsigned long long mant = bits & ((1ull << 52) - 1);
+	int exp = (bits >> 52) & 0x7ff;
+	char* p = buf;
+	if (exp == 0x7ff) {
+		strcpy(buf, mant ? "nan" : x < 0 ? "-inf" : "inf");
+		return strlen(buf);
+	}
+	if (bits >> 63) { *p++ = '-'; }
+
+	/* Whole numbers that fit a double exactly need no searching */
+	double a = fabs(x);
+	if (a < 9007199254740992.0 && a == (double)(unsigned long long)a) {
+		p += lfmt_ulong(p, (unsigned long long)a);
+		strcpy(p, ".0");
+		return p + 2 - buf;
+	}
 
-		return lval_eval(f->env, v);
+	unsigned long long out;
+	int e;
+	lfmt_shortest(mant, exp, &out, &e);
+	char digits[20];
+	int n = lfmt_ulong(digits, out);
+	if (e >= 0) {
+		/* All digits before the point, then zeros */
+		memcpy(p, digits, n); p += n;
+		memset(p, '0', e); p += e;
+		strcpy(p, ".0");
+		return p + 2 - buf;
+	} else if (n + e > 0) {
+		/* The point falls within the digits */
+		memcpy(p, digits, n + e); p += n + e;
+		*p++ = '.';
+		memcpy(p, digits + n + e, -e); p += -e;
 	} else {
-		/* Otherwise return partially evaluated function */
-		return lval_copy(f);
+		/* The point and zeros come before the digits */
+		*p++ = '0';
+		*p++ = '.';
+		memset(p, '0', -e - n); p += -e - n;
+		memcpy(p, digits, n); p += n;
 	}
+	*p = '\0';
+	return p - buf;
 }
 
+/* Printing writes into an output buffer rather than calling stdio for each
+ * token. A buffer given a FILE is written out to it in blocks as it fills
+ * and when a print is done. One without a FILE grows to hold all that is
+ * written, which lout_take returns as a string. */
 
-/* We now define methods to manipulate the environment */
-lenv* lenv_new(void) {
-	lenv* e = malloc(sizeof(lenv));
-	e->par = NULL;
-	e->quit = 0;
-	e->count = 0;
-	e->syms = NULL;
-	e->vals = NULL;
-	return e;
+/* Bytes held before a FILE's buffer is written out */
+#define LOUT_SIZE 16384
+
+typedef struct {
+	FILE* f;
+	char* buf;
+	size_t len;
+	size_t size;
+} lout;
+
+lout lout_file(FILE* f, char* buf, size_t size) {
+	lout o = { f, buf, 0, size };
+	return o;
 }
 
-void lenv_del(lenv* e) {
-	for (int i = 0; i < e->count; i++) {
-		free(e->syms[i]);
-		lval_del(e->vals[i]);
+lout lout_string(void) {
+	lout o = { NULL, malloc(64), 0, 64 };
+	return o;
+}
+
+void lout_flush(lout* o) {
+	if (o->f && o->len) {
+		fwrite(o->buf, 1, o->len, o->f);
+		o->len = 0;
 	}
-	free(e->syms);
-	free(e->vals);
-	free(e);
 }
 
-lenv* lenv_copy(lenv* e) {
-	lenv* n = malloc(sizeof(lenv));
-	n->par = e->par;
-	n->count = e->count;
-	n->syms = malloc(sizeof(char*) * n->count);
-	n->vals = malloc(sizeof(lval*) * n->count);
-	for (int i = 0; i < e->count; i++) {
-		n->syms[i] = malloc(strlen(e->syms[i]) + 1);
-		strcpy(n->syms[i], e->syms[i]);
-		n->vals[i] = lval_copy(e->vals[i]);
+void lout_write(lout* o, const char* s, size_t n) {
+	if (o->len + n > o->size) {
+		if (o->f) {
+			/* Anything bigger than the buffer is written straight out */
+			lout_flush(o);
+			if (n > o->size) { fwrite(s, 1, n, o->f); return; }
+		} else {
+			while (o->len + n > o->size) { o->size *= 2; }
+			o->buf = realloc(o->buf, o->size);
+		}
 	}
-	return n;
+	memcpy(o->buf + o->len, s, n);
+	o->len += n;
 }
 
-lval* lenv_get(lenv* e, lval* k) {
+void lout_putc(lout* o, char c) {
+	if (o->len == o->size) { lout_write(o, &c, 1); return; }
+	o->buf[o->len++] = c;
+}
 
-	/* Iterate over all items in environment */
-	for (int i = 0; i < e->count; i++) {
-		/* Check if the stored string matches the symbol string */
-		/* If it does, return a copy of the value */
-		if (strcmp(e->syms[i], k->sym) == 0) {
-			return lval_copy(e->vals[i]);
-		}
+void lout_puts(lout* o, const char* s) { lout_write(o, s, strlen(s)); }
+
+char* lout_take(lout* o) {
+	/* Finish a string buffer, returning its contents */
+	lout_putc(o, '\0');
+	return o->buf;
+}
+
+char lout_escape(char c) {
+	/* The letter escaping c, for those mpc unescapes, or 0 */
+	switch (c) {
+		case '\a': return 'a';
+		case '\b': return 'b';
+		case '\f': return 'f';
+		case '\n': return 'n';
+		case '\r': return 'r';
+		case '\t': return 't';
+		case '\v': return 'v';
+		case '\\': return '\\';
+		case '\'': return '\'';
+		case '"': return '"';
 	}
-	/* If no symbol check in parent otherwise error*/
-	if (e->par) {
-		return lenv_get(e->par, k);
-	} else {
-		return lval_err("Unbound Symbol '%s'", k->sym);
+	return 0;
+}
+
+void lval_write_str(lout* o, lval* v) {
+	/* Write the string escaped between quotes, a run of plain characters
+	 * at a time */
+	lout_putc(o, '"');
+	char* s = v->str;
+	char* run = s;
+	for (; *s; s++) {
+		char c = lout_escape(*s);
+		if (!c) { continue; }
+		lout_write(o, run, s - run);
+		lout_putc(o, '\\');
+		lout_putc(o, c);
+		run = s + 1;
 	}
+	lout_write(o, run, s - run);
+	lout_putc(o, '"');
 }
 
+void lval_write_ustr(lout* o, lval* v) {
+	/* Used for builtin show, does not escape string */
+	lout_putc(o, '"');
+	lout_puts(o, v->str);
+	lout_putc(o, '"');
+}
 
-void lenv_put(lenv* e, lval* k, lval* v) {
+void lval_write(lout* o, lval* v);
 
-	/* Iterate over all items in environment */
-	/* This is to see if variable already exists */
-	for (int i = 0; i < e->count; i++) {
-		/* If variable is found delete item at that position */
-		/* And replace with variable supplied by user */
-		if (strcmp(e->syms[i], k->sym) == 0) {
-			lval_del(e->vals[i]);
-			e->vals[i] = lval_copy(v);
-			return;
+void lval_expr_write(lout* o, lval* v, char open, char close) {
+	lout_putc(o, open);
+	for (int i = 0; i < v->count; i++) {
+		lval_write(o, v->cell[i]);
+
+		/* Don't print trailing space if last element */
+		if (i != (v->count-1)) {
+			lout_putc(o, ' ');
 		}
 	}
-	/* If no existing entry found allocate space for new entry */
-	e->count++;
-	e->vals = realloc(e->vals, sizeof(lval*) * e->count);
-	e->syms = realloc(e->syms, sizeof(char*) * e->count);
-	/* Copy contents of lval and symbol string into new location */
-	e->vals[e->count-1] = lval_copy(v);
-	e->syms[e->count-1] = malloc(strlen(k->sym)+1);
-	strcpy(e->syms[e->count-1], k->sym);
+	lout_putc(o, close);
 }
 
-void lenv_def(lenv* e, lval* k, lval* v) {
-	/* ITerate till e has no parent */
-	while (e->par) { e = e->par; }
-	/* Put value in e */
-	lenv_put(e, k, v);
+void lval_write(lout* o, lval* v){
+	char buf[LFMT_SIZE];
+	switch (v->type){
+		case LVAL_NUM: lout_write(o, buf, lfmt_long(buf, v->num)); break;
+		case LVAL_DEC: lout_write(o, buf, lfmt_double(buf, v->dec)); break;
+		case LVAL_BOOL:
+			if (v->boo == LVAL_TRUE) { lout_puts(o, "true"); }
+			else { lout_puts(o, "false"); }; break;
+		case LVAL_OK: break;
+		case LVAL_ERR: lout_puts(o, "Error: "); lout_puts(o, v->err); break;
+		case LVAL_SYM: lout_puts(o, v->sym); break;
+		case LVAL_STR: lval_write_str(o, v); break;
+		case LVAL_USTR: lval_write_ustr(o, v); break;
+		case LVAL_FUN:
+			if (v->builtin && ty_unspecialise(v->builtin) != v->builtin) {
+				/* Specialised by type inference, print as written */
+				lout_puts(o, v->fun_name); break;
+			} else if (v->builtin) {
+				lout_puts(o, "<builtin>: "); lout_puts(o, v->fun_name); break;
+			} else {
+				lout_puts(o, "(\\ "); lval_write(o, v->formals);
+				lout_putc(o, ' '); lval_write(o, v->body); lout_putc(o, ')');
+			}
+			break;
+		case LVAL_SEXPR: lval_expr_write(o, v, '(', ')'); break;
+		case LVAL_QEXPR: lval_expr_write(o, v, '{', '}'); break;
+		case LVAL_RECUR: lout_puts(o, "<recur>: "); lval_expr_write(o, v, '(', ')'); break;
+		case LVAL_FILE: lout_puts(o, "<file>: "); lout_puts(o, v->file->path); break;
+		case LVAL_SEQ: lout_puts(o, "<sequence>: "); lout_puts(o, lseq_name(v->seq)); break;
+	}
 }
 
-lval* builtin_eval(lenv*, lval*);
-lval* builtin_list(lenv*, lval*);
+void lval_print(lval* v) {
+	char buf[LOUT_SIZE];
+	lout o = lout_file(stdout, buf, sizeof(buf));
+	lval_write(&o, v);
+	lout_flush(&o);
+}
 
+void lval_println(lval* v) {
+	char buf[LOUT_SIZE];
+	lout o = lout_file(stdout, buf, sizeof(buf));
+	lval_write(&o, v);
+	lout_putc(&o, '\n');
+	lout_flush(&o);
+}
 
+/* JSON, read a top level value at a time from a stream and written through
+ * an output buffer. Arrays read as Q-Expressions, objects as Q-Expressions
+ * of {key value} pairs with each key a symbol, null as the empty
+ * S-Expression, integers that fit as numbers and other numbers as
+ * decimals. Writing takes a Q-Expression as an object when it is not empty
+ * and every element is such a pair, so an empty object writes back as an
+ * empty array. Values are read from a stream like expressions are, from
+ * their start again with more input whenever they could have been cut off,
+ * and strings are made straight from the input unless they hold escapes. */
+
+typedef struct {
+	char* s;
+	char* end;
+
+	/* Scratch space for unescaping strings and copying numbers */
+	char* buf;
+	size_t size;
+
+	/* Whether input may carry on past the end, and set when reading ran
+	 * into the end */
+	int partial;
+	int more;
+
+	/* What went wrong, on a syntax error */
+	char* err;
+} jreader;
+
+void json_skip(jreader* r) {
+	while (*r->s == ' ' || *r->s == '\n' || *r->s == '\t' || *r->s == '\r') { r->s++; }
+}
 
-/* We now define builtin methods for the user, we use macros to check whether the builtin is being used correctly */
-#define LASSERT(args, cond, fmt, ...) \
-	if (!(cond)) { \
-		lval* err = lval_err(fmt, ##__VA_ARGS__); \
-		lval_del(args);  \
-		return err; \
+lval* json_fail(jreader* r, char* at, char* err) {
+	/* Give up on a value at the given position, where running into the end
+	 * of partial input only means more is needed */
+	r->s = at;
+	if (at == r->end) {
+		r->more = 1;
+		err = "unexpected end of input";
 	}
-#define TYPE_CHECK(args, num, lval_type, fun_name) \
-	LASSERT(args, args->cell[num]->type == lval_type, \
-			"Function %s passed incorrect type for argument %i. " \
-			"Got %s, Expected %s", \
-			fun_name, num, \
-			ltype_name(args->cell[num]->type), ltype_name(lval_type))
+	if (!r->partial || at != r->end) { r->err = err; }
+	return NULL;
+}
 
-#define NUM_CHECK(args, num, fun_name) \
-	if (!(args->cell[num]->type == LVAL_DEC || args->cell[num]->type == LVAL_NUM)) { \
-		lval* err = lval_err("Function %s expected either number or decimal type " \
-				     "for argument %i. Got %s." \
-				     fun_name, num, ltype_name(args->cell[num]->type)); \
-		lval_del(args); \
-		return err; \
+void json_reserve(jreader* r, size_t n) {
+	if (n > r->size) {
+		r->size = n * 2;
+		r->buf = realloc(r->buf, r->size);
 	}
+}
 
-#define CHECK_ARG_NUM(args, num, fun_name) \
-	if (!(args->count == num)) { \
-		lval* err = lval_err("Function %s passed incorrect number of arguments. " \
-				"Got %i, Expected %i", \
-				fun_name, args->count, num); \
-		lval_del(args);  \
-		return err; \
+int json_hex(char* h, unsigned long* u) {
+	/* Read up to four hex digits, returning how many there were */
+	*u = 0;
+	for (int i = 0; i < 4; i++) {
+		char c = h[i];
+		int d = c >= '0' && c <= '9' ? c - '0'
+			: c >= 'a' && c <= 'f' ? c - 'a' + 10
+			: c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+		if (d < 0) { return i; }
+		*u = *u * 16 + d;
 	}
+	return 4;
+}
 
-# define CHECK_EMPTY(args, fun_name) \
-	if (!(args->cell[0]->count > 0)) { \
-		lval* err = lval_err("Function %s was passed empty argument", \
-				fun_name); \
-		lval_del(args); \
-		return err; \
-       	}
+int json_utf8(char* s, unsigned long u) {
+	/* Encode code point u, returning the bytes taken */
+	if (u < 0x80) {
+		s[0] = u;
+		return 1;
+	} else if (u < 0x800) {
+		s[0] = 0xc0 | (u >> 6);
+		s[1] = 0x80 | (u & 0x3f);
+		return 2;
+	} else if (u < 0x10000) {
+		s[0] = 0xe0 | (u >> 12);
+		s[1] = 0x80 | ((u >> 6) & 0x3f);
+		s[2] = 0x80 | (u & 0x3f);
+		return 3;
+	}
+	s[0] = 0xf0 | (u >> 18);
+	s[1] = 0x80 | ((u >> 12) & 0x3f);
+	s[2] = 0x80 | ((u >> 6) & 0x3f);
+	s[3] = 0x80 | (u & 0x3f);
+	return 4;
+}
 
-lval* dec_op(lval* a, char* op){
-	/* Numerical operation function for decimal types */
-	lval* x = lval_pop(a, 0);
+lval* json_string(jreader* r, int type) {
+	/* Read the string at the opening quote as an LVAL_STR or LVAL_SYM */
+	char* start = r->s + 1;
+	char* c = start;
+	while (*c != '"' && *c != '\\' && (unsigned char)*c >= 0x20) { c++; }
+	char* s = start;
+	size_t n = c - start;
+
+	if (*c != '"') {
+		/* Unescape into scratch space, after what came before */
+		json_reserve(r, n + 4);
+		memcpy(r->buf, start, n);
+		while (*c != '"') {
+			json_reserve(r, n + 4);
+			if ((unsigned char)*c < 0x20) { return json_fail(r, c, "control character in string"); }
+			if (*c != '\\') { r->buf[n++] = *c++; continue; }
+			c++;
+			switch (*c) {
+				case '"': case '\\': case '/': r->buf[n++] = *c; break;
+				case 'b': r->buf[n++] = '\b'; break;
+				case 'f': r->buf[n++] = '\f'; break;
+				case 'n': r->buf[n++] = '\n'; break;
+				case 'r': r->buf[n++] = '\r'; break;
+				case 't': r->buf[n++] = '\t'; break;
+				case 'u': {
+					unsigned long u, lo;
+					int k = json_hex(c + 1, &u);
+					if (k < 4) { return json_fail(r, c + 1 + k, "invalid \\u escape in string"); }
+					c += 4;
+					if (u >= 0xdc00 && u <= 0xdfff) {
+						return json_fail(r, c, "invalid surrogate pair in string");
+					}
+					if (u >= 0xd800 && u <= 0xdbff) {
+						/* Beyond the first plane, as a pair of surrogates */
+						if (c[1] != '\\') { return json_fail(r, c + 1, "invalid surrogate pair in string"); }
+						if (c[2] != 'u') { return json_fail(r, c + 2, "invalid surrogate pair in string"); }
+						k = json_hex(c + 3, &lo);
+						if (k < 4) { return json_fail(r, c + 3 + k, "invalid \\u escape in string"); }
+						if (lo < 0xdc00 || lo > 0xdfff) {
+							return json_fail(r, c + 3, "invalid surrogate pair in string");
+						}
+						u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+						c += 6;
+					}
+					if (u == 0) { return json_fail(r, c, "null character in string"); }
+					n += json_utf8(r->buf + n, u);
+					break;
+				}
+				default: return json_fail(r, c, "invalid escape in string");
+			}
+			c++;
+		}
+		s = r->buf;
+	}
 
-	/* If no arguments and sub then perform unary negation */
-	if ((strcmp(op, "-") == 0) && a->count == 0) {
-		x->dec = -x->dec;
+	lval* v = malloc(sizeof(lval));
+	v->type = type;
+	char* x = malloc(n + 1);
+	memcpy(x, s, n);
+	x[n] = '\0';
+	if (type == LVAL_SYM) { v->sym = x; } else { v->str = x; }
+	r->s = c + 1;
+	return v;
+}
+
+lval* json_number(jreader* r) {
+	char* start = r->s;
+	char* c = start;
+	int frac = 0;
+	int exp = 0;
+	if (*c == '-') { c++; }
+	if (*c == '0') {
+		c++;
+	} else if (lread_digit(*c)) {
+		while (lread_digit(*c)) { c++; }
+	} else {
+		return json_fail(r, c, "invalid number");
 	}
-	/* If no arguments and not op, then reverse boolean */
-	if (strcmp(op, "!") == 0) {
-		x->type = LVAL_BOOL;
-		if (x->dec == 0) {
-			x->boo = 1;
+	if (*c == '.') {
+		frac = 1;
+		c++;
+		if (!lread_digit(*c)) { return json_fail(r, c, "invalid number"); }
+		while (lread_digit(*c)) { c++; }
+	}
+	if (*c == 'e' || *c == 'E') {
+		exp = 1;
+		c++;
+		if (*c == '+' || *c == '-') { c++; }
+		if (!lread_digit(*c)) { return json_fail(r, c, "invalid number"); }
+		while (lread_digit(*c)) { c++; }
+	}
+	r->s = c;
+
+	long n;
+	double x;
+	if (!frac && !exp && lread_long(start, c, &n)) { return lval_num(n); }
+	if (frac && !exp && lread_double(start, c, &x)) { return lval_dec(x); }
+
+	/* Exponents, and numbers too large for the others */
+	json_reserve(r, c - start + 1);
+	memcpy(r->buf, start, c - start);
+	r->buf[c - start] = '\0';
+	return lval_dec(strtod(r->buf, NULL));
+}
+
+lval* json_literal(jreader* r, char* word, lval* v) {
+	int i = 0;
+	while (word[i] && r->s[i] == word[i]) { i++; }
+	if (word[i]) {
+		lval_del(v);
+		return json_fail(r, r->s + i, "expected a value");
+	}
+	r->s += i;
+	return v;
+}
+
+lval* json_value(jreader* r);
+
+lval* json_list(jreader* r, int object) {
+	/* Read the elements of an array or the members of an object at its
+	 * opening bracket, growing the cells by doubling */
+	char close = object ? '}' : ']';
+	lval* x = lval_qexpr();
+	int size = 0;
+	r->s++;
+	json_skip(r);
+	if (*r->s == close) {
+		r->s++;
+		return x;
+	}
+	while (1) {
+		lval* y;
+		if (object) {
+			if (*r->s != '"') {
+				lval_del(x);
+				return json_fail(r, r->s, "expected a string key");
+			}
+			lval* key = json_string(r, LVAL_SYM);
+			if (!key) { lval_del(x); return NULL; }
+			json_skip(r);
+			if (*r->s != ':') {
+				lval_del(key); lval_del(x);
+				return json_fail(r, r->s, "expected ':'");
+			}
+			r->s++;
+			json_skip(r);
+			lval* val = json_value(r);
+			if (!val) { lval_del(key); lval_del(x); return NULL; }
+			y = lval_add(lval_add(lval_qexpr(), key), val);
 		} else {
-			x->boo = 0;
+			y = json_value(r);
+			if (!y) { lval_del(x); return NULL; }
+		}
+
+		if (x->count == size) {
+			size = size ? size * 2 : 4;
+			x->cell = realloc(x->cell, sizeof(lval*) * size);
+		}
+		x->cell[x->count++] = y;
+
+		json_skip(r);
+		if (*r->s == close) {
+			r->s++;
+			x->cell = realloc(x->cell, sizeof(lval*) * x->count);
+			return x;
+		}
+		if (*r->s != ',') {
+			lval_del(x);
+			return json_fail(r, r->s, object ? "expected ',' or '}'" : "expected ',' or ']'");
+		}
+		r->s++;
+		json_skip(r);
+	}
+}
+
+lval* json_value(jreader* r) {
+	/* Read the value at the current position, NULL on a syntax error */
+	switch (*r->s) {
+		case '{': return json_list(r, 1);
+		case '[': return json_list(r, 0);
+		case '"': return json_string(r, LVAL_STR);
+		case 't': return json_literal(r, "true", lval_bool(LVAL_TRUE));
+		case 'f': return json_literal(r, "false", lval_bool(LVAL_FALSE));
+		case 'n': return json_literal(r, "null", lval_sexpr());
+	}
+	if (*r->s == '-' || lread_digit(*r->s)) { return json_number(r); }
+	return json_fail(r, r->s, "expected a value");
+}
+
+char* json_error(lstream* s, char* at, char* what) {
+	/* Describe a syntax error at a position in the stream's buffer */
+	long row = s->row;
+	long col = s->col;
+	for (char* c = s->buf; c < at; c++) {
+		if (*c == '\n') { row++; col = 0; } else { col++; }
+	}
+	char* err = malloc(strlen(s->filename) + strlen(what) + 64);
+	sprintf(err, "%s:%li:%li: error: %s", s->filename, row + 1, col + 1, what);
+	return err;
+}
+
+lval* json_next(lstream* s, char** err) {
+	/* Read the next top level value, returning NULL at the end of the
+	 * file, or on a syntax error with err set */
+	*err = NULL;
+	while (1) {
+		jreader r;
+		r.s = s->buf + s->pos;
+		r.end = s->buf + s->len;
+		r.buf = s->r.buf;
+		r.size = s->r.size;
+		r.partial = !s->eof;
+		r.more = 0;
+		r.err = NULL;
+
+		json_skip(&r);
+		s->pos = r.s - s->buf;
+		if (r.s == r.end) {
+			if (s->eof) { return NULL; }
+			lstream_fill(s);
+			continue;
+		}
+
+		/* Read again with more input if the value could be cut off */
+		lval* x = json_value(&r);
+		s->r.buf = r.buf;
+		s->r.size = r.size;
+		if (r.s == r.end) { r.more = 1; }
+		if (r.more && !s->eof) {
+			if (x) { lval_del(x); }
+			lstream_fill(s);
+			continue;
+		}
+		if (!x) {
+			*err = json_error(s, r.s, r.err);
+			return NULL;
+		}
+		s->pos = r.s - s->buf;
+		lstream_release(s);
+		return x;
+	}
+}
+
+int json_object(lval* v) {
+	/* Whether a Q-Expression is written as an object */
+	if (v->count == 0) { return 0; }
+	for (int i = 0; i < v->count; i++) {
+		lval* p = v->cell[i];
+		if (p->type != LVAL_QEXPR || p->count != 2 || p->cell[0]->type != LVAL_SYM) { return 0; }
+	}
+	return 1;
+}
+
+void json_write_str(lout* o, char* s) {
+	/* Write a string between quotes, a run of plain characters at a time */
+	lout_putc(o, '"');
+	char* run = s;
+	for (; *s; s++) {
+		unsigned char c = *s;
+		if (c >= 0x20 && c != '"' && c != '\\') { continue; }
+		lout_write(o, run, s - run);
+		switch (c) {
+			case '"': lout_puts(o, "\\\""); break;
+			case '\\': lout_puts(o, "\\\\"); break;
+			case '\b': lout_puts(o, "\\b"); break;
+			case '\f': lout_puts(o, "\\f"); break;
+			case '\n': lout_puts(o, "\\n"); break;
+			case '\r': lout_puts(o, "\\r"); break;
+			case '\t': lout_puts(o, "\\t"); break;
+			default: {
+				char u[8];
+				sprintf(u, "\\u%04x", c);
+				lout_puts(o, u);
+			}
+		}
+		run = s + 1;
+	}
+	lout_write(o, run, s - run);
+	lout_putc(o, '"');
+}
+
+char* json_write(lout* o, lval* v) {
+	/* Write v as JSON, returning the name of any type that cannot be */
+	char buf[LFMT_SIZE];
+	switch (v->type) {
+		case LVAL_NUM: lout_write(o, buf, lfmt_long(buf, v->num)); return NULL;
+		case LVAL_DEC:
+			if (isnan(v->dec) || isinf(v->dec)) { break; }
+			lout_write(o, buf, lfmt_double(buf, v->dec));
+			return NULL;
+		case LVAL_BOOL: lout_puts(o, v->boo == LVAL_TRUE ? "true" : "false"); return NULL;
+		case LVAL_STR: json_write_str(o, v->str); return NULL;
+		case LVAL_SEXPR:
+			if (v->count != 0) { break; }
+			lout_puts(o, "null");
+			return NULL;
+		case LVAL_QEXPR: {
+			int object = json_object(v);
+			lout_putc(o, object ? '{' : '[');
+			for (int i = 0; i < v->count; i++) {
+				if (i) { lout_putc(o, ','); }
+				lval* x = v->cell[i];
+				if (object) {
+					json_write_str(o, x->cell[0]->sym);
+					lout_putc(o, ':');
+					x = x->cell[1];
+				}
+				char* err = json_write(o, x);
+				if (err) { return err; }
+			}
+			lout_putc(o, object ? '}' : ']');
+			return NULL;
+		}
+	}
+	return ltype_name(v->type);
+}
+
+lval* lval_copy(lval* v) {
+
+  lval* x = malloc(sizeof(lval));
+  x->type = v->type;
+
+  switch (v->type) {
+
+    /* Copy Functions and Numbers Directly */
+    case LVAL_DEC: x->dec = v->dec; break;
+    case LVAL_NUM: x->num = v->num; break;
+    case LVAL_BOOL: x->boo = v->boo; break;
+
+    case LVAL_FUN:
+      if (v->builtin) {
+	      x->builtin = v->builtin;
+      	      x->fun_name = malloc(strlen(v->fun_name) + 1);
+	      strcpy(x->fun_name, v->fun_name);
+      } else {
+	      x->builtin = NULL;
+	      x->env = lenv_copy(v->env);
+	      x->formals = lval_copy(v->formals);
+	      x->body = lval_copy(v->body);
+      }
+      /* Copies of a memoised function share its result cache */
+      x->memo = v->memo;
+      if (x->memo) { x->memo->refs++; }
+      x->jit = v->jit;
+      if (x->jit) { x->jit->refs++; }
+      break;
+
+    /* Copy Strings using malloc and strcpy */
+    case LVAL_ERR:
+      x->err = malloc(strlen(v->err) + 1);
+      strcpy(x->err, v->err); break;
+
+    case LVAL_SYM:
+      x->sym = malloc(strlen(v->sym) + 1);
+      strcpy(x->sym, v->sym); break;
+
+    case LVAL_STR:
+      x->str = malloc(strlen(v->str) + 1);
+      strcpy(x->str, v->str); break;
+
+    /* Copies of a file share its handle */
+    case LVAL_FILE:
+      x->file = v->file;
+      x->file->refs++;
+      break;
+
+    /* Sequences never change once made, so copies share them */
+    case LVAL_SEQ:
+      x->seq = v->seq;
+      x->seq->refs++;
+      break;
+
+    /* Copy Lists by copying each sub-expression */
+    case LVAL_SEXPR:
+    case LVAL_QEXPR:
+    case LVAL_RECUR:
+      x->count = v->count;
+      x->cell = malloc(sizeof(lval*) * x->count);
+      for (int i = 0; i < x->count; i++) {
+        x->cell[i] = lval_copy(v->cell[i]);
+      }
+    break;
+  }
+
+  return x;
+}
+
+lval* lval_pop(lval* v, int i) {
+	/* Find item and shift memory over the top */
+	lval* x = v->cell[i];
+	memmove(&v->cell[i], &v->cell[i+1],
+		sizeof(lval*) * (v->count-i-1));
+	/* Decrease count and reallocate */
+	v->count--;
+	v->cell = realloc(v->cell, sizeof(lval*) * v->count);
+
+	return x;
+}
+
+lval* lval_take(lval* v, int i) {
+	/* Grab item from lval list and delete the rest of the structure */
+	lval* x = lval_pop(v, i);
+	lval_del(v);
+	return x;
+}
+
+
+lval* lval_join(lval* x, lval* y) {
+	/* Join two lval lists */
+	while (y->count) {
+		x = lval_add(x, lval_pop(y, 0));
+	}
+
+	lval_del(y);
+	return x;
+}
+
+lval* lval_str_join(lval* x, lval* y) {
+	x->str = realloc(x->str, strlen(x->str) + strlen(y->str) + 1);
+	strcat(x->str, y->str);
+
+	lval_del(y);
+	return x;
+}
+
+int lval_eq(lval* x, lval* y) {
+	/* Check whether two lvals are equal */
+	if (x->type != y->type) {
+		/* If the type isn't equal, check the types are not numerical */
+		if (!(x->type == LVAL_NUM || x->type == LVAL_DEC || x->type == LVAL_BOOL)) {
+			return 0;
+		}
+		if (!(y->type == LVAL_NUM || y->type == LVAL_DEC || y->type == LVAL_BOOL)) {
+			return 0;
+		}
+	}
+
+	switch (x->type) {
+		/* Compare Number/Decimal/Boolean Value */
+		case LVAL_NUM:
+			switch (y->type) {
+				case LVAL_NUM:
+					return (x->num == y->num);
+				case LVAL_DEC:
+					return (x->num == y->dec);
+				case LVAL_BOOL:
+					return (x->num == y->boo);
+			}
+		case LVAL_DEC:
+			switch (y->type) {
+				case LVAL_NUM:
+					return (x->dec == y->num);
+				case LVAL_DEC:
+					return (x->dec == y->dec);
+				case LVAL_BOOL:
+					return (x->dec == y->boo);
+			}
+		case LVAL_BOOL:
+			switch (y->type) {
+				case LVAL_NUM:
+					return (x->boo == y->num);
+				case LVAL_DEC:
+					return (x->boo == y->dec);
+				case LVAL_BOOL:
+					return (x->boo == y->boo);
+			}
+		/* Compare String values */
+		case LVAL_ERR: return (strcmp(x->err, y->err) == 0);
+		case LVAL_SYM: return (strcmp(x->sym, y->sym) == 0);
+		case LVAL_STR: return (strcmp(x->str, y->str) == 0);
+
+		/* If builtin compare, otherwise compare formals and body */
+		case LVAL_FUN:
+			if (x->builtin || y->builtin) {
+				return x->builtin == y->builtin;
+			} else {
+				return lval_eq(x->formals, y-> formals)
+					&& lval_eq(x->body, y->body);
+			}
+		/* Files are only equal to copies of themselves */
+		case LVAL_FILE: return x->file == y->file;
+		case LVAL_SEQ: return x->seq == y->seq;
+		/* If list, compare every individual element */
+		case LVAL_QEXPR:
+		case LVAL_SEXPR:
+		case LVAL_RECUR:
+			if (x->count != y->count) { return 0; }
+			for (int i = 0; i < x->count; i++) {
+				if (!lval_eq(x->cell[i], y->cell[i])) { return 0; }
+			}
+			return 1;
+		break;
+	}
+	return 0;
+}
+
+unsigned long lval_hash_bytes(unsigned long h, const void* p, size_t n) {
+	/* FNV-1a over n bytes, continuing from h */
+	const unsigned char* b = p;
+	for (size_t i = 0; i < n; i++) {
+		h ^= b[i];
+		h *= 1099511628211UL;
+	}
+	return h;
+}
+
+/* Names the optimiser, type inference and the JIT may resolve in the global
+ * environment ahead of a call, those of the builtins and of opt_constants.
+ * Code resolved that way is only run while none of them has been rebound in
+ * a global environment since, which bumps lenv_version, and none is bound
+ * in a local one, counted by lenv_shadows, as a caller's bindings are seen
+ * by the functions it calls. */
+#define LWATCH_SIZE 256
+char* lwatch[LWATCH_SIZE];
+unsigned long lenv_version = 0;
+long lenv_shadows = 0;
+
+void lwatch_add(char* s) {
+	int i = lval_hash_bytes(14695981039346656037UL, s, strlen(s)) & (LWATCH_SIZE - 1);
+	for (; lwatch[i]; i = (i + 1) & (LWATCH_SIZE - 1)) {
+		if (strcmp(lwatch[i], s) == 0) { return; }
+	}
+	lwatch[i] = s;
+}
+
+int lwatch_has(char* s) {
+	int i = lval_hash_bytes(14695981039346656037UL, s, strlen(s)) & (LWATCH_SIZE - 1);
+	for (; lwatch[i]; i = (i + 1) & (LWATCH_SIZE - 1)) {
+		if (strcmp(lwatch[i], s) == 0) { return 1; }
+	}
+	return 0;
+}
+
+int lwatch_valid(ljit* j) {
+	/* Whether code resolved when the lambda was made can still be run */
+	return j->version == lenv_version && lenv_shadows == 0;
+}
+
+int lval_same(lval* x, lval* y) {
+	/* Check whether two lvals can stand in for each other as arguments,
+	 * which unlike lval_eq tells apart numbers, decimals and booleans of
+	 * equal value, and 0.0 from -0.0 */
+	if (x->type != y->type) { return 0; }
+
+	switch (x->type) {
+		case LVAL_NUM: return x->num == y->num;
+		case LVAL_DEC: return memcmp(&x->dec, &y->dec, sizeof(double)) == 0;
+		case LVAL_BOOL: return x->boo == y->boo;
+
+		/* Lambdas also need the same partially applied arguments */
+		case LVAL_FUN:
+			if (x->builtin || y->builtin) { return x->builtin == y->builtin; }
+			if (x->env->count != y->env->count) { return 0; }
+			for (int i = 0; i < x->env->count; i++) {
+				if (strcmp(x->env->syms[i], y->env->syms[i]) != 0
+					|| !lval_same(x->env->vals[i], y->env->vals[i])) { return 0; }
+			}
+			return lval_same(x->formals, y->formals) && lval_same(x->body, y->body);
+
+		case LVAL_QEXPR:
+		case LVAL_SEXPR:
+		case LVAL_RECUR:
+			if (x->count != y->count) { return 0; }
+			for (int i = 0; i < x->count; i++) {
+				if (!lval_same(x->cell[i], y->cell[i])) { return 0; }
+			}
+			return 1;
+	}
+	return lval_eq(x, y);
+}
+
+unsigned long lval_hash(lval* v) {
+	/* Structural hash, consistent with lval_same so that values which
+	 * are the same always hash equally */
+	unsigned long h = 14695981039346656037UL;
+
+	switch (v->type) {
+		case LVAL_NUM: return lval_hash_bytes(h ^ v->type, &v->num, sizeof(long));
+		case LVAL_DEC: return lval_hash_bytes(h ^ v->type, &v->dec, sizeof(double));
+		case LVAL_BOOL: return lval_hash_bytes(h ^ v->type, &v->boo, sizeof(v->boo));
+
+		case LVAL_ERR: return lval_hash_bytes(h ^ v->type, v->err, strlen(v->err));
+		case LVAL_SYM: return lval_hash_bytes(h ^ v->type, v->sym, strlen(v->sym));
+		case LVAL_STR: return lval_hash_bytes(h ^ v->type, v->str, strlen(v->str));
+
+		case LVAL_FUN:
+			if (v->builtin) {
+				return lval_hash_bytes(h ^ v->type, &v->builtin, sizeof(lbuiltin));
+			}
+			h = ((h ^ v->type) * 1099511628211UL) ^ lval_hash(v->formals);
+			return (h * 1099511628211UL) ^ lval_hash(v->body);
+
+		case LVAL_QEXPR:
+		case LVAL_SEXPR:
+		case LVAL_RECUR:
+			h = lval_hash_bytes(h ^ v->type, &v->count, sizeof(int));
+			for (int i = 0; i < v->count; i++) {
+				h = (h ^ lval_hash(v->cell[i])) * 1099511628211UL;
+			}
+			return h;
+
+		default: return h ^ v->type;
+	}
+}
+
+/* Largest number of results a cache can be asked to hold. Buckets start
+ * few and grow with the entries, so a large capacity costs nothing until
+ * it is used */
+#define MEMO_MAX_CAPACITY INT_MAX
+#define MEMO_BUCKETS 16
+
+lmemo* lmemo_new(int capacity) {
+	/* A cache for up to capacity results, or NULL if out of memory */
+	lmemo* m = malloc(sizeof(lmemo));
+	if (!m) { return NULL; }
+	m->refs = 1;
+	m->capacity = capacity;
+	m->count = 0;
+
+	/* Use a power of two number of buckets */
+	m->size = MEMO_BUCKETS;
+	m->buckets = calloc(m->size, sizeof(lmemo_entry*));
+	if (!m->buckets) {
+		free(m);
+		return NULL;
+	}
+
+	m->head = NULL;
+	m->tail = NULL;
+	m->hits = 0;
+	m->misses = 0;
+	m->evictions = 0;
+	return m;
+}
+
+void lmemo_unlink(lmemo* m, lmemo_entry* x) {
+	/* Remove entry from the recently used list */
+	if (x->prev) { x->prev->next = x->next; } else { m->head = x->next; }
+	if (x->next) { x->next->prev = x->prev; } else { m->tail = x->prev; }
+}
+
+void lmemo_push(lmemo* m, lmemo_entry* x) {
+	/* Insert entry at the most recently used end of the list */
+	x->prev = NULL;
+	x->next = m->head;
+	if (m->head) { m->head->prev = x; } else { m->tail = x; }
+	m->head = x;
+}
+
+void lmemo_evict(lmemo* m) {
+	/* Remove the least recently used entry */
+	lmemo_entry* x = m->tail;
+	lmemo_entry** b = &m->buckets[x->hash & (m->size-1)];
+	while (*b != x) { b = &(*b)->chain; }
+	*b = x->chain;
+
+	lmemo_unlink(m, x);
+	lval_del(x->args);
+	lval_del(x->result);
+	free(x);
+	m->count--;
+	m->evictions++;
+}
+
+lval* lmemo_get(lmemo* m, unsigned long hash, lval* args) {
+	/* Find cached result for args, marking it as most recently used */
+	for (lmemo_entry* x = m->buckets[hash & (m->size-1)]; x; x = x->chain) {
+		if (x->hash == hash && lval_same(x->args, args)) {
+			lmemo_unlink(m, x);
+			lmemo_push(m, x);
+			return x->result;
+		}
+	}
+	return NULL;
+}
+
+void lmemo_grow(lmemo* m) {
+	/* Double the buckets, keeping the old ones if that cannot be done */
+	if (m->size > INT_MAX / 2) { return; }
+	int size = m->size * 2;
+	lmemo_entry** buckets = calloc(size, sizeof(lmemo_entry*));
+	if (!buckets) { return; }
+	for (int i = 0; i < m->size; i++) {
+		lmemo_entry* x = m->buckets[i];
+		while (x) {
+			lmemo_entry* next = x->chain;
+			x->chain = buckets[x->hash & (size-1)];
+			buckets[x->hash & (size-1)] = x;
+			x = next;
+		}
+	}
+	free(m->buckets);
+	m->buckets = buckets;
+	m->size = size;
+}
+
+void lmemo_put(lmemo* m, unsigned long hash, lval* args, lval* result) {
+	/* Takes ownership of args and result */
+	if (m->count >= m->capacity) { lmemo_evict(m); }
+	if (m->count >= m->size) { lmemo_grow(m); }
+
+	lmemo_entry* x = malloc(sizeof(lmemo_entry));
+	x->hash = hash;
+	x->args = args;
+	x->result = result;
+	x->chain = m->buckets[hash & (m->size-1)];
+	m->buckets[hash & (m->size-1)] = x;
+	lmemo_push(m, x);
+	m->count++;
+}
+
+void lmemo_release(lmemo* m) {
+	/* Drop one reference, freeing the cache when none remain */
+	if (--m->refs > 0) { return; }
+	while (m->count) { lmemo_evict(m); }
+	free(m->buckets);
+	free(m);
+}
+
+lval* lval_call(lenv* e, lval* f, lval* a);
+lval* lval_call_memo(lenv* e, lval* f, lval* a) {
+	/* Look for a cached result before calling the function */
+	lmemo* m = f->memo;
+	unsigned long hash = lval_hash(a);
+	lval* r = lmemo_get(m, hash, a);
+	if (r) {
+		m->hits++;
+		lval_del(a);
+		return lval_copy(r);
+	}
+	m->misses++;
+
+	/* Call with the cache detached, keeping the arguments as its key */
+	lval* args = lval_copy(a);
+	f->memo = NULL;
+	r = lval_call(e, f, a);
+	f->memo = m;
+
+	/* Errors are not cached so they are reported on every call */
+	if (r->type == LVAL_ERR || r->type == LVAL_RECUR) {
+		lval_del(args);
+		return r;
+	}
+	lmemo_put(m, hash, args, lval_copy(r));
+	return r;
+}
+
+lval* lval_eval(lenv* e, lval* a);
+lval* lval_call(lenv* e, lval* f, lval* a);
+lval* lval_apply(lenv* e, lval* v);
+lval* builtin_do(lenv* e, lval* a);
+
+int lval_recur_tail(lval* v, int i) {
+	/* Whether a recur evaluated as child i of v is the result of v */
+	if (i != v->count-1) { return 0; }
+	return v->count == 1 || (v->cell[0]->type == LVAL_FUN && v->cell[0]->builtin == builtin_do);
+}
+
+lval* lval_eval_sexpr(lenv* e, lval* v) {
+
+	/* Evalutate Children */
+	for (int i = 0; i < v->count; i++) {
+		v->cell[i] = lval_eval(e, v->cell[i]);
+
+		/* A recur anywhere but the tail of a loop body is an error rather
+		 * than a value to be passed around */
+		if (v->cell[i]->type == LVAL_RECUR && !lval_recur_tail(v, i)) {
+			lval_del(v->cell[i]);
+			v->cell[i] = lval_err("Function recur used outside of tail position of loop");
+		}
+	}
+	return lval_apply(e, v);
+}
+
+lval* lval_apply_builtin(lenv* e, lbuiltin f, lval* a) {
+	/* Call builtin on evaluated arguments, unless one is an error */
+	for (int i = 0; i < a->count; i++) {
+		if (a->cell[i]->type == LVAL_ERR) { return lval_take(a, i); }
+	}
+	return f(e, a);
+}
+
+lval* lval_apply(lenv* e, lval* v) {
+	/* Apply an S-Expression whose children have been evaluated */
+
+	/* Error Checking */
+	for (int i = 0; i < v->count; i++) {
+		if (v->cell[i]->type == LVAL_ERR) {return lval_take(v, i);}
+	}
+
+	/* Empty Expression */
+	if (v->count == 0) { return v; }
+
+	/* Single Expression */
+	if (v->count == 1) { return lval_take(v, 0); }
+
+	/* Ensure First Element is Symbol */
+	lval* f = lval_pop(v, 0);
+	if (f->type != LVAL_FUN) {
+		lval* err = lval_err(
+				"S-Expression starts with incorrect type. "
+				"Got %s, Expected %s. ",
+				ltype_name(f->type), ltype_name(LVAL_FUN));
+		lval_del(f); lval_del(v);
+		return err;
+	}
+
+	/* Call builtin with operator */
+	lval* result = lval_call(e, f, v);
+	lval_del(f);
+	return result;
+}
+
+lval* lval_eval(lenv* e, lval* v) {
+	if (v->type == LVAL_SYM) {
+	    	lval* x = lenv_get(e, v);
+	    	lval_del(v);
+		return x;
+ 	}
+	/* Evalutate Sexpressions */
+	if (v->type == LVAL_SEXPR) { return lval_eval_sexpr(e, v); }
+	/* All other lval types remain the same */
+	return v;
+}
+
+lval* builtin_eval(lenv* e, lval* a);
+lval* jit_call(lenv* e, lval* f, lval* a);
+/* Number of loops currently being evaluated in the running function, recur
+ * is only valid inside one */
+int loop_depth = 0;
+
+lval* lval_call_lambda(lenv* e, lval* f, lval* a);
+
+lval* lval_call(lenv* e, lval* f, lval* a) {
+	/* Apply function f to variable a */
+	/* If Builtin then simply apply that */
+	if (f->builtin) { return f->builtin(e, a); }
+
+	/* The body of a function is outside any loop of its caller, so a recur
+	 * in it cannot restart the caller's loop */
+	int depth = loop_depth;
+	loop_depth = 0;
+	lval* r = lval_call_lambda(e, f, a);
+	loop_depth = depth;
+	return r;
+}
+
+lval* lval_call_lambda(lenv* e, lval* f, lval* a) {
+	/* If memoised then go through the result cache */
+	if (f->memo) { return lval_call_memo(e, f, a); }
+
+	/* Code resolved ahead of the call is only run while still valid,
+	 * otherwise the body as written is */
+	int valid = !f->jit || lwatch_valid(f->jit);
+	lval* body = valid || !f->jit->source ? f->body : f->jit->source;
+
+	/* Run compiled code if the function is hot */
+	if (f->jit) {
+		lval* r = jit_call(e, f, a);
+		if (r) { return r; }
+
+		/* Otherwise the body compiled ahead of time, given all arguments */
+		if (valid && f->jit->aot && f->env->count == 0 && a->count == f->formals->count) {
+			return f->jit->aot(e, a);
+		}
+	}
+
+	/* Loop through all arguments in a */
+	int given = a->count;
+	int total = f->formals->count;
+	while (a->count) {
+		/* We bind each argument to a formal, if we run out, pass an error */
+		if (f->formals->count == 0) {
+			lval_del(a); return lval_err(
+					"Function passed too many arguments. "
+					"Got %i, Expected %i.", given, total);
+		}
+
+		/* Pop the first symbol from the formals */
+		lval* sym = lval_pop(f->formals, 0);
+
+		/* '&' denotes a variable number of arguments */
+		if (strcmp(sym->sym, "&") == 0) {
+			if (f->formals->count != 1) {
+				lval_del(a);
+				return lval_err("Function format invalid. "
+						"symbol '&' not followed by single symbol.");
+			}
+
+			/* Next formal should be bound to remaining arguments */
+			lval* nsym = lval_pop(f->formals, 0);
+			a->type = LVAL_QEXPR;
+			lenv_put(f->env, nsym, a);
+			lval_del(sym); lval_del(nsym);
+			break;
+		}
+
+		/* Bind a copy into the function's environment */
+		lval* val = lval_pop(a, 0);
+		lenv_put(f->env, sym, val);
+
+		lval_del(sym); lval_del(val);
+	}
+
+	/* Argument list is now bound so can be cleaned up */
+	lval_del(a);
+
+	/* If '&' is remaining, bind to empty list */
+	if (f->formals->count > 0 && strcmp(f->formals->cell[0]->sym, "&") ==0) {
+
+		/* Check to ensure that & is not passed invalidly. */
+		if (f->formals->count != 2) {
+			return lval_err("Function format invalid. "
+					"Symbol '&' not followed by single symbol. ");
+		}
+		/* Pop and delete '&' symbol */
+		lval_del(lval_pop(f->formals, 0));
+
+		/* Pop next symbol and create empty list */
+		lval* sym = lval_pop(f->formals, 0);
+		lval* val = lval_qexpr();
+
+		/* Bind to environment and delete */
+		lenv_put(f->env, sym, val);
+		lval_del(sym); lval_del(val);
+	}
+
+	/* If all formals have been bound evaluate */
+	if (f->formals->count == 0) {
+
+		/* Set environment parent to evaluation environment */
+		f->env->par = e;
+		lval* v = lval_add(lval_sexpr(), lval_copy(body));
+		v->cell[0]->type = LVAL_SEXPR;
+
+		return lval_eval(f->env, v);
+	} else {
+		/* Otherwise return partially evaluated function, which
+		 * can't share compiled code as its formals differ, nor the
+		 * optimised body as nothing then guards it */
+		lval* p = lval_copy(f);
+		if (p->jit) {
+			if (p->jit->source) {
+				lval_del(p->body);
+				p->body = lval_copy(p->jit->source);
+			}
+			ljit_release(p->jit);
+			p->jit = NULL;
+		}
+		return p;
+	}
+}
+
+
+/* We now define methods to manipulate the environment */
+lenv* lenv_new(void) {
+	lenv* e = malloc(sizeof(lenv));
+	e->par = NULL;
+	e->quit = 0;
+	e->count = 0;
+	e->syms = NULL;
+	e->vals = NULL;
+	e->global = 0;
+	e->shadows = 0;
+	return e;
+}
+
+void lenv_del(lenv* e) {
+	lenv_shadows -= e->shadows;
+	for (int i = 0; i < e->count; i++) {
+		free(e->syms[i]);
+		lval_del(e->vals[i]);
+	}
+	free(e->syms);
+	free(e->vals);
+	free(e);
+}
+
+lenv* lenv_copy(lenv* e) {
+	lenv* n = malloc(sizeof(lenv));
+	n->par = e->par;
+	n->quit = e->quit;
+	n->count = e->count;
+	n->global = e->global;
+	n->shadows = e->shadows;
+	lenv_shadows += n->shadows;
+	n->syms = malloc(sizeof(char*) * n->count);
+	n->vals = malloc(sizeof(lval*) * n->count);
+	for (int i = 0; i < e->count; i++) {
+		n->syms[i] = malloc(strlen(e->syms[i]) + 1);
+		strcpy(n->syms[i], e->syms[i]);
+		n->vals[i] = lval_copy(e->vals[i]);
+	}
+	return n;
+}
+
+lval* lenv_get(lenv* e, lval* k) {
+
+	/* Iterate over all items in environment */
+	for (int i = 0; i < e->count; i++) {
+		/* Check if the stored string matches the symbol string */
+		/* If it does, return a copy of the value */
+		if (strcmp(e->syms[i], k->sym) == 0) {
+			return lval_copy(e->vals[i]);
+		}
+	}
+	/* If no symbol check in parent otherwise error*/
+	if (e->par) {
+		return lenv_get(e->par, k);
+	} else {
+		return lval_err("Unbound Symbol '%s'", k->sym);
+	}
+}
+
+
+void lenv_put(lenv* e, lval* k, lval* v) {
+
+	/* Iterate over all items in environment */
+	/* This is to see if variable already exists */
+	for (int i = 0; i < e->count; i++) {
+		/* If variable is found delete item at that position */
+		/* And replace with variable supplied by user */
+		if (strcmp(e->syms[i], k->sym) == 0) {
+			if (e->global && lwatch_has(k->sym)) { lenv_version++; }
+			lval_del(e->vals[i]);
+			e->vals[i] = lval_copy(v);
+			return;
+		}
+	}
+	/* A local binding of a watched name hides the global one */
+	if (!e->global && lwatch_has(k->sym)) {
+		e->shadows++;
+		lenv_shadows++;
+	}
+	/* If no existing entry found allocate space for new entry */
+	e->count++;
+	e->vals = realloc(e->vals, sizeof(lval*) * e->count);
+	e->syms = realloc(e->syms, sizeof(char*) * e->count);
+	/* Copy contents of lval and symbol string into new location */
+	e->vals[e->count-1] = lval_copy(v);
+	e->syms[e->count-1] = malloc(strlen(k->sym)+1);
+	strcpy(e->syms[e->count-1], k->sym);
+}
+
+void lenv_def(lenv* e, lval* k, lval* v) {
+	/* ITerate till e has no parent */
+	while (e->par) { e = e->par; }
+	/* Put value in e */
+	lenv_put(e, k, v);
+}
+
+lval* builtin_eval(lenv*, lval*);
+lval* builtin_list(lenv*, lval*);
+
+
+
+/* We now define builtin methods for the user, we use macros to check whether the builtin is being used correctly */
+#define LASSERT(args, cond, fmt, ...) \
+	if (!(cond)) { \
+		lval* err = lval_err(fmt, ##__VA_ARGS__); \
+		lval_del(args);  \
+		return err; \
+	}
+#define TYPE_CHECK(args, num, lval_type, fun_name) \
+	LASSERT(args, args->cell[num]->type == lval_type, \
+			"Function %s passed incorrect type for argument %i. " \
+			"Got %s, Expected %s", \
+			fun_name, num, \
+			ltype_name(args->cell[num]->type), ltype_name(lval_type))
+
+#define NUM_CHECK(args, num, fun_name) \
+	if (!(args->cell[num]->type == LVAL_DEC || args->cell[num]->type == LVAL_NUM)) { \
+		lval* err = lval_err("Function %s expected either number or decimal type " \
+				     "for argument %i. Got %s.", \
+				     fun_name, num, ltype_name(args->cell[num]->type)); \
+		lval_del(args); \
+		return err; \
+	}
+
+#define CHECK_ARG_NUM(args, num, fun_name) \
+	if (!(args->count == num)) { \
+		lval* err = lval_err("Function %s passed incorrect number of arguments. " \
+				"Got %i, Expected %i", \
+				fun_name, args->count, num); \
+		lval_del(args);  \
+		return err; \
+	}
+
+# define CHECK_EMPTY(args, fun_name) \
+	if (!(args->cell[0]->count > 0)) { \
+		lval* err = lval_err("Function %s was passed empty argument", \
+				fun_name); \
+		lval_del(args); \
+		return err; \
+       	}
+
+lval* dec_op(lval* a, char* op){
+	/* Numerical operation function for decimal types */
+	lval* x = lval_pop(a, 0);
+
+	/* If no arguments and sub then perform unary negation */
+	if ((strcmp(op, "-") == 0) && a->count == 0) {
+		x->dec = -x->dec;
+	}
+	/* If no arguments and not op, then reverse boolean */
+	if (strcmp(op, "!") == 0) {
+		x->type = LVAL_BOOL;
+		if (x->dec == 0) {
+			x->boo = 1;
+		} else {
+			x->boo = 0;
+		}
+	}
+
+	/* Otherwise, process each argument individually */
+	while (a->count > 0) {
+
+		lval* y = lval_pop(a, 0);
+
+		/* Arithmetic ops */
+		if (strcmp(op, "+") == 0) { x->dec += y->dec; }
+		if (strcmp(op, "-") == 0) { x->dec -= y->dec; }
+		if (strcmp(op, "*") == 0) { x->dec *= y->dec; }
+		if (strcmp(op, "/") == 0) {
+			if (y->dec == 0) {
+				lval_del(x); lval_del(y);
+				x = lval_err("Division By Zero!"); break;
+			}
+			x->dec /= y->dec;
+		}
+		if (strcmp(op, "%") == 0) { return lval_err("Can't compute remainder on decimal types!");}
+
+		/* Comparison ops */
+		if (strcmp(op, ">") == 0) {
+			x->type = LVAL_BOOL;
+			x->boo = (x->dec > y->dec);
+		}
+		if (strcmp(op, "<") == 0) {
+			x->type = LVAL_BOOL;
+			x->boo = (x->dec < y->dec);
+		}
+		if (strcmp(op, ">=") == 0) {
+			x->type = LVAL_BOOL;
+			x->boo = (x->dec >= y->dec);
+		}
+		if (strcmp(op, "<=") == 0) {
+			x->type = LVAL_BOOL;
+			x->boo = (x->dec <= y->dec);
+		}
+		if (strcmp(op, "||") == 0) {
+			x->type = LVAL_BOOL;
+			x->boo = (x->dec || y->dec);
+		}
+		if (strcmp(op, "&&") == 0) {
+			x->type = LVAL_BOOL;
+			x->boo = (x->dec && y->dec);
+		}
+		lval_del(y);
+	}
+	lval_del(a); return x;
+
+}
+
+lval* num_op(lval* a, char* op) {
+	/* Numerical operation function for decimal types */
+	lval* x = lval_pop(a, 0);
+
+	/* If no arguments and sub then perform unary negation */
+	if ((strcmp(op, "-") == 0) && a->count == 0) {
+		x->num = -x->num;
+	}
+	/* If no arguments and not op, then reverse boolean */
+	if (strcmp(op, "!") == 0) {
+		x->type = LVAL_BOOL;
+		if (x->num == 0) {
+			x->boo = LVAL_FALSE;
+		} else {
+			x->boo = LVAL_TRUE;
+		}
+	}
+
+	/* Otherwise, process each argument individually */
+	while (a->count > 0) {
+
+		lval* y = lval_pop(a, 0);
+
+		/* Arithmetic ops */
+		if (strcmp(op, "+") == 0) { x->num += y->num; }
+		if (strcmp(op, "-") == 0) { x->num -= y->num; }
+		if (strcmp(op, "*") == 0) { x->num *= y->num; }
+		if (strcmp(op, "/") == 0) {
+			if (y->num == 0) {
+				lval_del(x); lval_del(y);
+				x = lval_err("Division By Zero!"); break;
+			}
+			x->num /= y->num;
+		}
+		if (strcmp(op, "%") == 0) {
+			/* Check there are no more elements */
+			if (a->count > 0) { return lval_err("Remainder operator takes only two arguments!"); }
+			x->num %= y->num;
+		}
+
+		/* Comparison ops */
+		if (strcmp(op, ">") == 0) {
+			x->type = LVAL_BOOL;
+			x->boo = (x->num > y->num);
+		}
+		if (strcmp(op, "<") == 0) {
+			x->type = LVAL_BOOL;
+			x->boo = (x->num < y->num);
+		}
+		if (strcmp(op, ">=") == 0) {
+			x->type = LVAL_BOOL;
+			x->boo = (x->num >= y->num);
+		}
+		if (strcmp(op, "<=") == 0) {
+			x->type = LVAL_BOOL;
+			x->boo = (x->num <= y->num);
+		}
+		if (strcmp(op, "||") == 0) {
+			x->type = LVAL_BOOL;
+			x->boo = (x->num || y->num);
+		}
+		if (strcmp(op, "&&") == 0) {
+			x->type = LVAL_BOOL;
+			x->boo = (x->num && y->num);
+		}
+		lval_del(y);
+	}
+	lval_del(a); return x;
+
+}
+
+
+lval* builtin_op(lenv* e, lval* a, char* op) {
+	/* If decimal is present we convert everything to decimal type */
+	int is_dec = 0;
+	for (int i = 0; i < a->count; i++) {
+		if (a->cell[i]->type != LVAL_NUM) {
+			/* If boolean, convert to num for the purpose of the operation */
+			if (a->cell[i]->type == LVAL_BOOL) {
+				a->cell[i]->type = LVAL_NUM;
+				a->cell[i]->num = (long) a->cell[i]->boo;
+				continue;
+			}
+			/* If a decimal, make a note of this and continue */
+			if (a->cell[i]->type == LVAL_DEC) {
+				is_dec = 1;
+				continue;
+			}
+			return lval_err("Function %s passsed incorrect type for argument %i. "
+					"Got %s, expected %s or %s",
+					op, i, ltype_name(a->cell[i]->type),
+					ltype_name(LVAL_NUM), ltype_name(LVAL_DEC));
+			lval_del(a);
+		}
+	}
+
+	/* If decimal exists convert everything and run dec_op */
+	if (is_dec) {
+		for (int i = 0; i < a->count; i++) {
+			if (a->cell[i]->type == LVAL_NUM) {
+				a->cell[i]->type = LVAL_DEC;
+				a->cell[i]->dec = (double) a->cell[i]->num;
+			}
+		}
+		return dec_op(a, op);
+	}
+
+	/* If no decimal then run num_op */
+	return num_op(a, op);
+
+}
+
+/* Builtin arithmetic operations */
+lval* builtin_add(lenv* e, lval* a) {
+	return builtin_op(e, a, "+");
+}
+
+lval* builtin_sub(lenv* e, lval*a) {
+	return builtin_op(e, a, "-");
+}
+
+lval* builtin_mul(lenv* e, lval* a) {
+	return builtin_op(e, a, "*");
+}
+
+lval* builtin_div(lenv* e, lval* a) {
+	return builtin_op(e, a, "/");
+}
+
+/* Builtin comparison operations */
+lval* builtin_gt(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 2, ">")
+	return builtin_op(e, a, ">");
+}
+
+lval* builtin_lt(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 2, "<")
+	return builtin_op(e, a, "<");
+}
+
+lval* builtin_ge(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 2, ">=")
+	return builtin_op(e, a, ">=");
+}
+
+lval* builtin_le(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 2, "<=")
+	return builtin_op(e, a, "<=");
+}
+
+lval* builtin_or(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 2, "||")
+	return builtin_op(e, a, "||");
+}
+
+lval* builtin_and(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 2, "&&")
+	return builtin_op(e, a, "&&");
+}
+
+lval* builtin_not(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 1, "!")
+	return builtin_op(e, a, "!");
+}
+
+/* Arithmetic and comparisons specialised by type inference, for call sites
+ * whose arguments are proven to be all numbers or all decimals. These skip
+ * the type checks and conversions of builtin_op. */
+lval* num_op_typed(lval* a, char op) {
+	long x = a->cell[0]->num;
+	if (op == '-' && a->count == 1) { x = -x; }
+
+	for (int i = 1; i < a->count; i++) {
+		long y = a->cell[i]->num;
+		switch (op) {
+			case '+': x += y; break;
+			case '-': x -= y; break;
+			case '*': x *= y; break;
+			case '/':
+				if (y == 0) {
+					lval_del(a);
+					return lval_err("Division By Zero!");
+				}
+				x /= y;
+				break;
+		}
+	}
+	lval_del(a);
+	return lval_num(x);
+}
+
+lval* dec_op_typed(lval* a, char op) {
+	double x = a->cell[0]->dec;
+	if (op == '-' && a->count == 1) { x = -x; }
+
+	for (int i = 1; i < a->count; i++) {
+		double y = a->cell[i]->dec;
+		switch (op) {
+			case '+': x += y; break;
+			case '-': x -= y; break;
+			case '*': x *= y; break;
+			case '/':
+				if (y == 0) {
+					lval_del(a);
+					return lval_err("Division By Zero!");
+				}
+				x /= y;
+				break;
+		}
+	}
+	lval_del(a);
+	return lval_dec(x);
+}
+
+lval* builtin_add_num(lenv* e, lval* a) { return num_op_typed(a, '+'); }
+lval* builtin_sub_num(lenv* e, lval* a) { return num_op_typed(a, '-'); }
+lval* builtin_mul_num(lenv* e, lval* a) { return num_op_typed(a, '*'); }
+lval* builtin_div_num(lenv* e, lval* a) { return num_op_typed(a, '/'); }
+
+lval* builtin_add_dec(lenv* e, lval* a) { return dec_op_typed(a, '+'); }
+lval* builtin_sub_dec(lenv* e, lval* a) { return dec_op_typed(a, '-'); }
+lval* builtin_mul_dec(lenv* e, lval* a) { return dec_op_typed(a, '*'); }
+lval* builtin_div_dec(lenv* e, lval* a) { return dec_op_typed(a, '/'); }
+
+lval* cmp_typed(lval* a, int r) {
+	lval_del(a);
+	return lval_bool(r);
+}
+
+lval* builtin_gt_num(lenv* e, lval* a) { return cmp_typed(a, a->cell[0]->num > a->cell[1]->num); }
+lval* builtin_lt_num(lenv* e, lval* a) { return cmp_typed(a, a->cell[0]->num < a->cell[1]->num); }
+lval* builtin_ge_num(lenv* e, lval* a) { return cmp_typed(a, a->cell[0]->num >= a->cell[1]->num); }
+lval* builtin_le_num(lenv* e, lval* a) { return cmp_typed(a, a->cell[0]->num <= a->cell[1]->num); }
+
+lval* builtin_gt_dec(lenv* e, lval* a) { return cmp_typed(a, a->cell[0]->dec > a->cell[1]->dec); }
+lval* builtin_lt_dec(lenv* e, lval* a) { return cmp_typed(a, a->cell[0]->dec < a->cell[1]->dec); }
+lval* builtin_ge_dec(lenv* e, lval* a) { return cmp_typed(a, a->cell[0]->dec >= a->cell[1]->dec); }
+lval* builtin_le_dec(lenv* e, lval* a) { return cmp_typed(a, a->cell[0]->dec <= a->cell[1]->dec); }
+
+
+
+lval* builtin_cmp(lenv* e, lval* a, char* op) {
+	CHECK_ARG_NUM(a, 2, op);
+	int r;
+	if (strcmp(op, "==") == 0) {
+		r = lval_eq(a->cell[0], a->cell[1]);
+	}
+	if (strcmp(op, "!=") == 0) {
+		r = !lval_eq(a->cell[0], a->cell[1]);
+	}
+	lval_del(a);
+	return lval_bool(r);
+}
+
+lval* builtin_eq(lenv* e, lval* a) {
+	return builtin_cmp(e, a, "==");
+}
+
+lval* builtin_ne(lenv* e, lval* a) {
+	return builtin_cmp(e, a, "!=");
+}
+
+lval* builtin_if(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 3, "if")
+	/* Convert first argument to boolean type if numerical */
+	if (a->cell[0]->type == LVAL_NUM) {
+		a->cell[0]->type = LVAL_BOOL;
+		if (a->cell[0]->num) {
+			a->cell[0]->boo = LVAL_TRUE;
+		} else {
+			a->cell[0]->boo = LVAL_FALSE;
+		}
+	} else if (a->cell[0]->type == LVAL_DEC) {
+		a->cell[0]->type = LVAL_BOOL;
+		if (a->cell[0]->dec) {
+			a->cell[0]->boo = LVAL_TRUE;
+		} else {
+			a->cell[0]->boo = LVAL_FALSE;
+		}
+	} else if (a->cell[0]->type != LVAL_BOOL) {
+		return lval_err("Function if pass incorrected type for argument 0"
+				"Got %s, Expected Number, Decimal or Bool",
+				ltype_name(a->cell[0]->type));
+	}
+	TYPE_CHECK(a, 1, LVAL_QEXPR, "if")
+	TYPE_CHECK(a, 2, LVAL_QEXPR, "if")
+	lval* v;
+	a->cell[1]->type = LVAL_SEXPR;
+	a->cell[2]->type = LVAL_SEXPR;
+
+	/* To evaluate expressions, add to sexpr and run eval */
+	if (a->cell[0]->boo) {
+		v = lval_eval(e, lval_pop(a, 1));
+	} else {
+		v = lval_eval(e, lval_pop(a, 2));
+	}
+	lval_del(a);
+	return v;
+}
+
+int lval_truth(lval* v) {
+	/* Truth value of a condition, or -1 if it is not numerical or boolean */
+	switch (v->type) {
+		case LVAL_NUM: return v->num != 0;
+		case LVAL_DEC: return v->dec != 0;
+		case LVAL_BOOL: return v->boo == LVAL_TRUE;
+	}
+	return -1;
+}
+
+#define CHECK_CLAUSES(args, first, fun_name) \
+	for (int i = first; i < args->count; i++) { \
+		TYPE_CHECK(args, i, LVAL_QEXPR, fun_name) \
+		LASSERT(args, args->cell[i]->count == 2, \
+				"Function %s passed invalid clause %i. " \
+				"Got %i elements, Expected 2", \
+				fun_name, i, args->cell[i]->count) \
+	}
+
+lval* builtin_select(lenv* e, lval* a) {
+	/* Clauses are {condition value}, conditions are evaluated in order
+	 * and only the value of the first true clause is evaluated */
+	CHECK_CLAUSES(a, 0, "select")
+
+	for (int i = 0; i < a->count; i++) {
+		lval* c = lval_eval(e, lval_pop(a->cell[i], 0));
+		if (c->type == LVAL_ERR) { lval_del(a); return c; }
+
+		int t = lval_truth(c);
+		if (t == -1) {
+			lval* err = lval_err("Function select passed incorrect type "
+					"for condition %i. Got %s, Expected Number, "
+					"Decimal or Bool", i, ltype_name(c->type));
+			lval_del(c); lval_del(a);
+			return err;
+		}
+		lval_del(c);
+
+		if (t) {
+			lval* v = lval_eval(e, lval_pop(a->cell[i], 0));
+			lval_del(a);
+			return v;
+		}
+	}
+	lval_del(a);
+	return lval_err("No Selection Found");
+}
+
+lval* builtin_case(lenv* e, lval* a) {
+	/* First argument is compared against the key of each {key value}
+	 * clause in order, keys are only evaluated when reached */
+	LASSERT(a, a->count > 0, "Function case passed no arguments")
+	CHECK_CLAUSES(a, 1, "case")
+
+	lval* x = a->cell[0];
+	for (int i = 1; i < a->count; i++) {
+		lval* k = lval_eval(e, lval_pop(a->cell[i], 0));
+		if (k->type == LVAL_ERR) { lval_del(a); return k; }
+
+		int match = lval_eq(x, k);
+		lval_del(k);
+
+		if (match) {
+			lval* v = lval_eval(e, lval_pop(a->cell[i], 0));
+			lval_del(a);
+			return v;
+		}
+	}
+	lval_del(a);
+	return lval_err("No Case Found");
+}
+
+lval* builtin_do(lenv* e, lval* a) {
+	/* Arguments have already been evaluated in order, keep the last */
+	if (a->count == 0) {
+		lval_del(a);
+		return lval_qexpr();
+	}
+	return lval_take(a, a->count-1);
+}
+
+lval* builtin_let(lenv* e, lval* a) {
+	/* Evaluate expression in a new scope on top of the current one */
+	CHECK_ARG_NUM(a, 1, "let")
+	TYPE_CHECK(a, 0, LVAL_QEXPR, "let")
+
+	lenv* scope = lenv_new();
+	scope->par = e;
+
+	lval* x = lval_take(a, 0);
+	x->type = LVAL_SEXPR;
+	lval* v = lval_eval(scope, x);
+
+	lenv_del(scope);
+	return v;
+}
+
+lval* builtin_recur(lenv* e, lval* a) {
+	/* Hand the new loop values back up to the enclosing loop */
+	LASSERT(a, loop_depth > 0, "Function recur used outside of loop")
+	a->type = LVAL_RECUR;
+	return a;
+}
+
+lval* builtin_loop(lenv* e, lval* a) {
+	/* loop {syms} inits... {body}, the body is evaluated with the symbols
+	 * bound to the initial values, until it returns something other than
+	 * a recur, whose arguments rebind the symbols for the next iteration */
+	LASSERT(a, a->count >= 2, "Function loop passed incorrect number of arguments. "
+			"Got %i, Expected at least 2", a->count)
+	TYPE_CHECK(a, 0, LVAL_QEXPR, "loop")
+	TYPE_CHECK(a, a->count-1, LVAL_QEXPR, "loop")
+
+	lval* syms = a->cell[0];
+	for (int i = 0; i < syms->count; i++) {
+		LASSERT(a, syms->cell[i]->type == LVAL_SYM,
+				"Function loop cannot bind non-symbol. "
+				"Got %s, Expected %s.",
+				ltype_name(syms->cell[i]->type), ltype_name(LVAL_SYM));
+	}
+	LASSERT(a, syms->count == a->count-2,
+			"Function loop passed incorrect number of initial values. "
+			"Got %i symbols and %i values", syms->count, a->count-2);
+
+	/* A single frame is reused by every iteration */
+	lenv* frame = lenv_new();
+	frame->par = e;
+	for (int i = 0; i < syms->count; i++) {
+		lenv_put(frame, syms->cell[i], a->cell[i+1]);
+	}
+
+	lval* body = a->cell[a->count-1];
+	lval* v;
+	loop_depth++;
+	while (1) {
+		lval* x = lval_copy(body);
+		x->type = LVAL_SEXPR;
+		v = lval_eval(frame, x);
+		if (v->type != LVAL_RECUR) { break; }
+
+		if (v->count != syms->count) {
+			lval* err = lval_err("Function recur passed incorrect number of arguments. "
+					"Got %i, Expected %i", v->count, syms->count);
+			lval_del(v);
+			v = err;
+			break;
+		}
+		for (int i = 0; i < syms->count; i++) {
+			lenv_put(frame, syms->cell[i], v->cell[i]);
+		}
+		lval_del(v);
+	}
+	loop_depth--;
+
+	lenv_del(frame);
+	lval_del(a);
+	return v;
+}
+
+lval* builtin_while(lenv* e, lval* a) {
+	/* Evaluate body in the current scope for as long as condition holds */
+	CHECK_ARG_NUM(a, 2, "while")
+	TYPE_CHECK(a, 0, LVAL_QEXPR, "while")
+	TYPE_CHECK(a, 1, LVAL_QEXPR, "while")
+
+	/* Neither the condition nor the body is the tail of a loop */
+	int depth = loop_depth;
+	loop_depth = 0;
+	lval* r = lval_sexpr();
+	while (1) {
+		lval* c = lval_copy(a->cell[0]);
+		c->type = LVAL_SEXPR;
+		c = lval_eval(e, c);
+		if (c->type == LVAL_ERR) { lval_del(r); r = c; break; }
+
+		int t = lval_truth(c);
+		if (t == -1) {
+			lval* err = lval_err("Function while passed incorrect type "
+					"for condition. Got %s, Expected Number, "
+					"Decimal or Bool", ltype_name(c->type));
+			lval_del(c); lval_del(r);
+			r = err;
+			break;
+		}
+		lval_del(c);
+		if (!t) { break; }
+
+		lval* x = lval_copy(a->cell[1]);
+		x->type = LVAL_SEXPR;
+		x = lval_eval(e, x);
+		if (x->type == LVAL_ERR) { lval_del(r); r = x; break; }
+		lval_del(x);
+	}
+	loop_depth = depth;
+	lval_del(a);
+	return r;
+}
+
+lval* builtin_for(lenv* e, lval* a) {
+	/* for {i} start end [step] {body}, bind i to each number in the half
+	 * open range [start, end) and evaluate body */
+	LASSERT(a, a->count == 4 || a->count == 5,
+			"Function for passed incorrect number of arguments. "
+			"Got %i, Expected 4 or 5", a->count)
+	TYPE_CHECK(a, 0, LVAL_QEXPR, "for")
+	LASSERT(a, a->cell[0]->count == 1 && a->cell[0]->cell[0]->type == LVAL_SYM,
+			"Function for expects a single symbol to bind")
+	TYPE_CHECK(a, 1, LVAL_NUM, "for")
+	TYPE_CHECK(a, 2, LVAL_NUM, "for")
+	long step = 1;
+	if (a->count == 5) {
+		TYPE_CHECK(a, 3, LVAL_NUM, "for")
+		step = a->cell[3]->num;
+		LASSERT(a, step != 0, "Function for passed a step of zero")
+	}
+	TYPE_CHECK(a, a->count-1, LVAL_QEXPR, "for")
+
+	lval* sym = a->cell[0]->cell[0];
+	lval* body = a->cell[a->count-1];
+	long end = a->cell[2]->num;
+
+	/* A single frame and counter are reused by every iteration */
+	lenv* frame = lenv_new();
+	frame->par = e;
+	lval* k = lval_num(a->cell[1]->num);
+
+	/* The body is not the tail of a loop */
+	int depth = loop_depth;
+	loop_depth = 0;
+	lval* r = lval_sexpr();
+	while (step > 0 ? k->num < end : k->num > end) {
+		lenv_put(frame, sym, k);
+
+		lval* x = lval_copy(body);
+		x->type = LVAL_SEXPR;
+		x = lval_eval(frame, x);
+		if (x->type == LVAL_ERR) { lval_del(r); r = x; break; }
+		lval_del(x);
+
+		/* Stop once the next step would reach end, before it can overflow */
+		unsigned long left = step > 0 ? (unsigned long)end - k->num : (unsigned long)k->num - end;
+		if (left <= (step > 0 ? (unsigned long)step : 0UL - step)) { break; }
+		k->num += step;
+	}
+	loop_depth = depth;
+
+	lval_del(k);
+	lenv_del(frame);
+	lval_del(a);
+	return r;
+}
+
+lval* builtin_qexpr_head(lenv* e, lval* a) {
+	TYPE_CHECK(a, 0, LVAL_QEXPR, "head")
+	CHECK_EMPTY(a, "head")
+
+	lval* v = lval_take(a, 0);
+	while (v->count > 1) { lval_del(lval_pop(v, 1)); }
+	return v;
+}
+
+lval* builtin_str_head(lenv* e, lval* a) {
+	TYPE_CHECK(a, 0, LVAL_STR, "head")
+
+	lval* v = lval_take(a, 0);
+	v->str = realloc(v->str, 2);
+	v->str[1] = '\0';
+	return v;
+}
+
+lval* builtin_head(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 1, "head");
+	if (a->cell[0]->type == LVAL_QEXPR) {
+		return builtin_qexpr_head(e, a);
+	} else {
+		return builtin_str_head(e, a);
+	}
+}
+
+lval* builtin_qexpr_tail(lenv* e, lval* a) {
+	TYPE_CHECK(a, 0, LVAL_QEXPR, "tail");
+	CHECK_EMPTY(a,	"tail");
+
+	lval* v = lval_take(a, 0);
+	lval_del(lval_pop(v, 0));
+	return v;
+}
+
+lval* builtin_str_tail(lenv* e, lval* a) {
+	TYPE_CHECK(a, 0, LVAL_STR, "tail");
+
+	lval* v = lval_take(a, 0);
+	char tail = v->str[strlen(v->str) - 1];
+	v->str = realloc(v->str, 2);
+	v->str[0] = tail;
+	v->str[1] = '\0';
+	return v;
+}
+
+lval* builtin_tail(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 1, "tail");
+	if (a->cell[0]->type == LVAL_QEXPR) {
+		return builtin_qexpr_tail(e, a);
+	} else {
+		return builtin_str_tail(e, a);
+	}
+}
+
+lval* builtin_cons(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 2, "cons")
+	TYPE_CHECK(a, 1, LVAL_QEXPR, "cons");
+
+	lval* v = lval_qexpr();
+	v = lval_add(v, a->cell[0]);
+	v = lval_join(v, a->cell[1]);
+	return v;
+}
+
+lval* builtin_len(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 1, "len")
+	TYPE_CHECK(a, 0, LVAL_QEXPR, "len");
+
+	return lval_num(a->cell[0]->count);
+}
+
+lval* builtin_init(lenv* e, lval* a) {
+	/* returns all but the final element of a qexpr */
+	CHECK_ARG_NUM(a, 1, "init")
+	TYPE_CHECK(a, 0, LVAL_QEXPR, "init");
+
+	lval* v = lval_take(a, 0);
+	lval_del(lval_pop(v, v->count-1));
+	return v;
+}
+
+lval* builtin_list(lenv* e, lval* a) {
+	a->type = LVAL_QEXPR;
+	return a;
+}
+
+lval* builtin_read(lenv* e, lval* a) {
+	TYPE_CHECK(a, 0, LVAL_STR, "read")
+	CHECK_ARG_NUM(a, 1, "read")
+
+	char* err_msg;
+	lval* expr = lval_read_string("<stdin>", a->cell[0]->str, &err_msg);
+	if (expr) {
+		expr->type = LVAL_QEXPR;
+
+		/* Delete arguments */
+		lval_del(a);
+
+		return expr;
+	} else {
+		/* Create error message using parse error */
+		lval* err = lval_err("Could not read: %s", err_msg);
+
+		free(err_msg);
+		lval_del(a);
+		return err;
+	}
+}
+
+lval* builtin_show(lenv* e, lval* a) {
+	/* Prints string in unescaped form */
+	TYPE_CHECK(a, 0, LVAL_STR, "show")
+	CHECK_ARG_NUM(a, 1, "show")
+
+	lval* v = lval_take(a, 0);
+	v->type = LVAL_USTR;
+
+	lval_println(v);
+
+	lval_del(v);
+	return lval_ok();
+}
+
+/* Optimiser run over function bodies when they are defined. It folds calls
+ * to pure builtins whose arguments are all literals, inlines the constants
+ * below and drops dead branches of ifs with constant conditions. Only
+ * Q-expressions passed to known control flow forms are treated as code,
+ * all others are left as data. Builtins and constants are resolved in the
+ * global environment at definition time and never through symbols that the
+ * function binds itself. The body as written is kept and run instead once
+ * any of them is rebound, see lwatch_valid. */
+
+/* Whether bodies are optimised when functions are defined */
+int opt_enabled = 1;
+
+/* Global symbols the optimiser may replace by their value */
+char* opt_constants[] = { "otherwise", "nil" };
+
+lval* builtin_join(lenv* e, lval* a);
+
+/* Builtins without side effects which are safe to run at definition time */
+lbuiltin opt_pure[] = {
+	builtin_add, builtin_sub, builtin_mul, builtin_div,
+	builtin_gt, builtin_lt, builtin_ge, builtin_le,
+	builtin_eq, builtin_ne, builtin_or, builtin_and, builtin_not,
+	builtin_head, builtin_tail, builtin_join, builtin_cons,
+	builtin_len, builtin_init, builtin_list,
+};
+
+int opt_is_literal(lval* v) {
+	switch (v->type) {
+		case LVAL_NUM: case LVAL_DEC: case LVAL_BOOL:
+		case LVAL_STR: case LVAL_QEXPR:
+			return 1;
+	}
+	return 0;
+}
+
+int opt_is_pure(lval* f) {
+	if (f == NULL || f->type != LVAL_FUN || !f->builtin) { return 0; }
+	for (int i = 0; i < sizeof(opt_pure) / sizeof(lbuiltin); i++) {
+		if (f->builtin == opt_pure[i]) { return 1; }
+	}
+	return 0;
+}
+
+void opt_shadowed(lval* shadow, lval* v) {
+	/* Collect every symbol the code in v could bind, wherever it appears */
+	if (!(v->type == LVAL_SEXPR || v->type == LVAL_QEXPR)) { return; }
+
+	if (v->count >= 2 && v->cell[0]->type == LVAL_SYM
+			&& v->cell[1]->type == LVAL_QEXPR) {
+		char* s = v->cell[0]->sym;
+		if (strcmp(s, "=") == 0 || strcmp(s, "def") == 0
+				|| strcmp(s, "fun") == 0 || strcmp(s, "\\") == 0
+				|| strcmp(s, "loop") == 0 || strcmp(s, "for") == 0) {
+			lval* syms = v->cell[1];
+			for (int i = 0; i < syms->count; i++) {
+				if (syms->cell[i]->type == LVAL_SYM) {
+					lval_add(shadow, lval_copy(syms->cell[i]));
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < v->count; i++) {
+		opt_shadowed(shadow, v->cell[i]);
+	}
+}
+
+lval* opt_global(lenv* e, lval* shadow, lval* s) {
+	/* Value of symbol s in the global environment, NULL if unbound, if
+	 * the function could bind s itself or if rebinding s is not watched */
+	if (s->type != LVAL_SYM || !lwatch_has(s->sym)) { return NULL; }
+	for (int i = 0; i < shadow->count; i++) {
+		if (strcmp(shadow->cell[i]->sym, s->sym) == 0) { return NULL; }
+	}
+
+	while (e->par) { e = e->par; }
+	for (int i = 0; i < e->count; i++) {
+		if (strcmp(e->syms[i], s->sym) == 0) { return e->vals[i]; }
+	}
+	return NULL;
+}
+
+/* Kinds of Q-expression argument a control flow form evaluates as code */
+enum { OPT_DATA, OPT_CODE, OPT_CLAUSE };
+
+int opt_code_arg(lbuiltin b, int i, int count) {
+	/* How builtin b treats a Q-expression passed as argument i of count */
+	if ((b == builtin_if && i >= 2) || b == builtin_let || b == builtin_while
+			|| ((b == builtin_loop || b == builtin_for) && i == count-1)) {
+		return OPT_CODE;
+	}
+	if (b == builtin_select || (b == builtin_case && i >= 2)) { return OPT_CLAUSE; }
+	return OPT_DATA;
+}
+
+lval* opt_expr(lenv* e, lval* shadow, lval* v);
+
+lval* opt_code(lenv* e, lval* shadow, lval* q) {
+	/* Optimise a Q-expression which will be evaluated as an S-expression,
+	 * always returning a Q-expression */
+	q->type = LVAL_SEXPR;
+	lval* x = opt_expr(e, shadow, q);
+	if (x->type == LVAL_SEXPR) {
+		x->type = LVAL_QEXPR;
+		return x;
+	}
+	return lval_add(lval_qexpr(), x);
+}
+
+lval* opt_branch(lval* q) {
+	/* Replace an if branch by the expression it evaluates to */
+	if (q->count == 1) { return lval_take(q, 0); }
+	q->type = LVAL_SEXPR;
+	return q;
+}
+
+lval* opt_expr(lenv* e, lval* shadow, lval* v) {
+	/* Inline constant symbols */
+	if (v->type == LVAL_SYM) {
+		for (int i = 0; i < sizeof(opt_constants) / sizeof(char*); i++) {
+			if (strcmp(v->sym, opt_constants[i]) != 0) { continue; }
+			lval* c = opt_global(e, shadow, v);
+			if (c && opt_is_literal(c)) {
+				lval_del(v);
+				return lval_copy(c);
+			}
+		}
+		return v;
+	}
+	if (v->type != LVAL_SEXPR || v->count == 0) { return v; }
+
+	/* Optimise Q-expressions which control flow forms evaluate as code */
+	lval* f = opt_global(e, shadow, v->cell[0]);
+	lbuiltin b = (f && f->type == LVAL_FUN) ? f->builtin : NULL;
+	for (int i = 1; i < v->count; i++) {
+		lval* x = v->cell[i];
+		if (x->type != LVAL_QEXPR) { continue; }
+
+		switch (opt_code_arg(b, i, v->count)) {
+			case OPT_CODE:
+				v->cell[i] = opt_code(e, shadow, x);
+				break;
+			case OPT_CLAUSE:
+				if (x->count == 2) {
+					x->cell[0] = opt_expr(e, shadow, x->cell[0]);
+					x->cell[1] = opt_expr(e, shadow, x->cell[1]);
+				}
+				break;
+		}
+	}
+
+	/* Optimise all other sub-expressions */
+	int literal = 1;
+	for (int i = 0; i < v->count; i++) {
+		if (v->cell[i]->type != LVAL_QEXPR) {
+			v->cell[i] = opt_expr(e, shadow, v->cell[i]);
+		}
+		if (i > 0 && !opt_is_literal(v->cell[i])) { literal = 0; }
+	}
+
+	/* Drop the dead branch of an if with a constant condition */
+	if (b == builtin_if && v->count == 4 && v->cell[2]->type == LVAL_QEXPR
+			&& v->cell[3]->type == LVAL_QEXPR) {
+		int t = lval_truth(v->cell[1]);
+		if (t != -1 && opt_is_literal(v->cell[1])) {
+			return opt_branch(lval_take(v, t ? 2 : 3));
+		}
+	}
+
+	/* Fold pure builtin called with literal arguments, unless it errors */
+	if (opt_is_pure(f) && literal && v->count > 1) {
+		lval* a = lval_copy(v);
+		lval_del(lval_pop(a, 0));
+		lval* r = b(e, a);
+		if (r->type != LVAL_ERR) {
+			lval_del(v);
+			return r;
+		}
+		lval_del(r);
+	}
+	return v;
+}
+
+/* Type inference run over optimised bodies. Numbers are only ever known
+ * to flow from literals, from the counter of a for, from the variables of
+ * a loop whose initial values and every recur agree, and from builtins
+ * whose result type follows from their arguments. Arithmetic and
+ * comparisons whose arguments are proven to all be numbers or all be
+ * decimals call the specialised builtins directly, every other call site
+ * keeps the generic builtin. Errors never reach a specialised builtin, as
+ * they are returned before any builtin is called. The builtins are put in
+ * place of their symbols in the optimised body only, so once one is rebound
+ * the body as written runs and sees the new binding. */
+
+typedef struct {
+	lbuiltin generic;
+	lbuiltin num;
+	lbuiltin dec;
+	char* name;
+	int arith;
+} ty_special;
+
+ty_special ty_specials[] = {
+	{ builtin_add, builtin_add_num, builtin_add_dec, "+", 1 },
+	{ builtin_sub, builtin_sub_num, builtin_sub_dec, "-", 1 },
+	{ builtin_mul, builtin_mul_num, builtin_mul_dec, "*", 1 },
+	{ builtin_div, builtin_div_num, builtin_div_dec, "/", 1 },
+	{ builtin_gt, builtin_gt_num, builtin_gt_dec, ">", 0 },
+	{ builtin_lt, builtin_lt_num, builtin_lt_dec, "<", 0 },
+	{ builtin_ge, builtin_ge_num, builtin_ge_dec, ">=", 0 },
+	{ builtin_le, builtin_le_num, builtin_le_dec, "<=", 0 },
+};
+
+/* Number of call sites given specialised builtins, and left generic */
+int ty_specialised = 0;
+int ty_generic = 0;
+
+ty_special* ty_find(lbuiltin b) {
+	for (int i = 0; i < sizeof(ty_specials) / sizeof(ty_special); i++) {
+		ty_special* s = &ty_specials[i];
+		if (b == s->generic || b == s->num || b == s->dec) { return s; }
+	}
+	return NULL;
+}
+
+lbuiltin ty_unspecialise(lbuiltin b) {
+	/* Generic builtin a specialised one stands in for */
+	ty_special* s = ty_find(b);
+	return s ? s->generic : b;
+}
+
+/* Types known for symbols in scope, innermost last */
+typedef struct {
+	lenv* e;
+	lval* shadow;
+	lval* assigned;
+	int count;
+	char** syms;
+	int* types;
+	int changed;
+} ty_env;
+
+void ty_push(ty_env* t, lval* sym, int type) {
+	/* Symbols the body ever assigns to are never known */
+	for (int i = 0; i < t->assigned->count; i++) {
+		if (strcmp(t->assigned->cell[i]->sym, sym->sym) == 0) { type = -1; }
+	}
+	t->count++;
+	t->syms = realloc(t->syms, sizeof(char*) * t->count);
+	t->types = realloc(t->types, sizeof(int) * t->count);
+	t->syms[t->count-1] = sym->sym;
+	t->types[t->count-1] = type;
+}
+
+int ty_slot(ty_env* t, lval* sym) {
+	for (int i = t->count-1; i >= 0; i--) {
+		if (strcmp(t->syms[i], sym->sym) == 0) { return i; }
+	}
+	return -1;
+}
+
+void ty_assigned(lval* assigned, lval* v) {
+	/* Collect every symbol code in v could assign with = or def */
+	if (!(v->type == LVAL_SEXPR || v->type == LVAL_QEXPR)) { return; }
+
+	if (v->count >= 2 && v->cell[0]->type == LVAL_SYM
+			&& v->cell[1]->type == LVAL_QEXPR) {
+		char* s = v->cell[0]->sym;
+		int n = strcmp(s, "fun") == 0 ? 1 : v->cell[1]->count;
+		if (strcmp(s, "=") == 0 || strcmp(s, "def") == 0 || strcmp(s, "fun") == 0) {
+			for (int i = 0; i < n && i < v->cell[1]->count; i++) {
+				if (v->cell[1]->cell[i]->type == LVAL_SYM) {
+					lval_add(assigned, lval_copy(v->cell[1]->cell[i]));
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < v->count; i++) {
+		ty_assigned(assigned, v->cell[i]);
+	}
+}
+
+lbuiltin ty_callee(ty_env* t, lval* l) {
+	/* Builtin a list evaluated as an S-expression calls, if known */
+	if (l->count < 2) { return NULL; }
+	lval* f = l->cell[0]->type == LVAL_FUN ? l->cell[0]
+		: opt_global(t->e, t->shadow, l->cell[0]);
+	if (!f || f->type != LVAL_FUN || !f->builtin) { return NULL; }
+	return f->builtin;
+}
+
+int ty_list(ty_env* t, lval* l);
+
+int ty_type(ty_env* t, lval* v) {
+	/* Type v always evaluates to, unless an error, -1 if not known */
+	switch (v->type) {
+		case LVAL_NUM: case LVAL_DEC: case LVAL_BOOL:
+			return v->type;
+		case LVAL_SYM: {
+			int i = ty_slot(t, v);
+			return i == -1 ? -1 : t->types[i];
+		}
+		case LVAL_SEXPR:
+			return ty_list(t, v);
+	}
+	return -1;
+}
+
+int ty_args(ty_env* t, lval* l) {
+	/* Common numeric type of arguments, LVAL_NUM for numbers and booleans,
+	 * LVAL_DEC if any is a decimal, -1 if any is not known */
+	int type = LVAL_NUM;
+	for (int i = 1; i < l->count; i++) {
+		int x = ty_type(t, l->cell[i]);
+		if (x == LVAL_DEC) { type = LVAL_DEC; continue; }
+		if (x != LVAL_NUM && x != LVAL_BOOL) { return -1; }
+	}
+	return type;
+}
+
+int ty_list(ty_env* t, lval* l) {
+	/* Type of list evaluated as an S-expression */
+	if (l->count == 0) { return -1; }
+	if (l->count == 1) { return ty_type(t, l->cell[0]); }
+
+	lbuiltin b = ty_callee(t, l);
+	if (!b) { return -1; }
+	ty_special* s = ty_find(b);
+	if (s) { return s->arith ? ty_args(t, l) : LVAL_BOOL; }
+
+	if (b == builtin_eq || b == builtin_ne || b == builtin_not
+			|| b == builtin_or || b == builtin_and) { return LVAL_BOOL; }
+	if (b == builtin_len) { return LVAL_NUM; }
+	if (b == builtin_if && l->count == 4
+			&& l->cell[2]->type == LVAL_QEXPR && l->cell[3]->type == LVAL_QEXPR) {
+		int x = ty_list(t, l->cell[2]);
+		return x == ty_list(t, l->cell[3]) ? x : -1;
+	}
+	return -1;
+}
+
+int ty_tail(ty_env* t, int first, lval* syms, lval* l) {
+	/* Check the result of list l evaluated as the body of a loop, whose
+	 * variables start at slot first, can only come from a recur passing
+	 * each variable its known type, or is something other than a recur.
+	 * Variables passed another type are marked unknown. */
+	if (l->count == 0) { return 1; }
+	if (l->count == 1) {
+		lval* x = l->cell[0];
+		if (x->type == LVAL_SEXPR) { return ty_tail(t, first, syms, x); }
+		return x->type != LVAL_SYM || ty_type(t, x) != -1;
+	}
+
+	lbuiltin b = ty_callee(t, l);
+	if (b == builtin_recur) {
+		if (l->count-1 != syms->count) { return 0; }
+		for (int i = 0; i < syms->count; i++) {
+			int x = ty_type(t, l->cell[i+1]);
+			if (t->types[first+i] != -1 && t->types[first+i] != x) {
+				t->types[first+i] = -1;
+				t->changed = 1;
+			}
+		}
+		return 1;
+	}
+	if (b == builtin_if && l->count == 4
+			&& l->cell[2]->type == LVAL_QEXPR && l->cell[3]->type == LVAL_QEXPR) {
+		return ty_tail(t, first, syms, l->cell[2]) && ty_tail(t, first, syms, l->cell[3]);
+	}
+
+	/* Only builtins known never to return a recur */
+	return ty_list(t, l) != -1 || b == builtin_for || b == builtin_while;
+}
+
+lval* ty_expr(ty_env* t, lval* v);
+
+lval* ty_code(ty_env* t, lval* q) {
+	/* Specialise a Q-expression evaluated as an S-expression */
+	q->type = LVAL_SEXPR;
+	q = ty_expr(t, q);
+	q->type = LVAL_QEXPR;
+	return q;
+}
+
+lval* ty_expr(ty_env* t, lval* v) {
+	if (v->type != LVAL_SEXPR || v->count < 2) { return v; }
+	lbuiltin b = ty_callee(t, v);
+	int scope = t->count;
+
+	/* The variables of for and loop are known in their bodies */
+	int last = v->count-1;
+	if (b == builtin_for && (v->count == 5 || v->count == 6)
+			&& v->cell[1]->type == LVAL_QEXPR && v->cell[1]->count == 1
+			&& v->cell[1]->cell[0]->type == LVAL_SYM
+			&& v->cell[last]->type == LVAL_QEXPR) {
+		for (int i = 2; i < last; i++) { v->cell[i] = ty_expr(t, v->cell[i]); }
+		ty_push(t, v->cell[1]->cell[0], LVAL_NUM);
+		v->cell[last] = ty_code(t, v->cell[last]);
+		t->count = scope;
+		return v;
+	}
+	if (b == builtin_loop && v->cell[1]->type == LVAL_QEXPR
+			&& v->cell[1]->count == v->count-3 && v->cell[last]->type == LVAL_QEXPR) {
+		lval* syms = v->cell[1];
+		for (int i = 0; i < syms->count; i++) {
+			if (syms->cell[i]->type != LVAL_SYM) { return v; }
+		}
+		int* inits = malloc(sizeof(int) * syms->count);
+		for (int i = 2; i < last; i++) {
+			v->cell[i] = ty_expr(t, v->cell[i]);
+			inits[i-2] = ty_type(t, v->cell[i]);
+		}
+		for (int i = 0; i < syms->count; i++) { ty_push(t, syms->cell[i], inits[i]); }
+		free(inits);
+
+		/* Drop variables some recur passes another type, until none do */
+		lval* body = v->cell[last];
+		body->type = LVAL_SEXPR;
+		do {
+			t->changed = 0;
+			if (!ty_tail(t, scope, syms, body)) {
+				for (int i = scope; i < t->count; i++) { t->types[i] = -1; }
+				break;
+			}
+		} while (t->changed);
+		v->cell[last] = ty_code(t, body);
+		t->count = scope;
+		return v;
+	}
+
+	/* Specialise code of other control flow forms and sub-expressions */
+	for (int i = 1; i < v->count; i++) {
+		lval* x = v->cell[i];
+		switch (x->type == LVAL_QEXPR ? opt_code_arg(b, i, v->count) : 0) {
+			case OPT_CODE:
+				v->cell[i] = ty_code(t, x);
+				break;
+			case OPT_CLAUSE:
+				if (x->count == 2) {
+					x->cell[0] = ty_expr(t, x->cell[0]);
+					x->cell[1] = ty_expr(t, x->cell[1]);
+				}
+				break;
+		}
+	}
+	for (int i = 0; i < v->count; i++) {
+		v->cell[i] = ty_expr(t, v->cell[i]);
+	}
+
+	/* Call a specialised builtin if every argument has the same type */
+	ty_special* s = b ? ty_find(b) : NULL;
+	if (!s || b != s->generic) { return v; }
+	int arity = v->count-1;
+	int args = -1;
+	for (int i = 1; i < v->count; i++) {
+		int x = ty_type(t, v->cell[i]);
+		if (i > 1 && x != args) { args = -1; break; }
+		args = x;
+	}
+	if ((args == LVAL_NUM || args == LVAL_DEC) && (s->arith || arity == 2)) {
+		lval_del(v->cell[0]);
+		v->cell[0] = lval_fun(args == LVAL_NUM ? s->num : s->dec, s->name);
+		ty_specialised++;
+	} else {
+		ty_generic++;
+	}
+	return v;
+}
+
+lval* ty_body(lenv* e, lval* shadow, lval* body) {
+	/* Specialise call sites in the body of a function */
+	ty_env t;
+	t.e = e;
+	t.shadow = shadow;
+	t.assigned = lval_qexpr();
+	ty_assigned(t.assigned, body);
+	t.count = 0;
+	t.syms = NULL;
+	t.types = NULL;
+
+	body = ty_code(&t, body);
+
+	free(t.syms);
+	free(t.types);
+	lval_del(t.assigned);
+	return body;
+}
+
+lval* opt_body(lenv* e, lval* formals, lval* body) {
+	/* Optimise the body of a function with the given formals */
+	if (!opt_enabled) { return body; }
+
+	lval* shadow = lval_copy(formals);
+	opt_shadowed(shadow, body);
+	body = opt_code(e, shadow, body);
+	body = ty_body(e, shadow, body);
+	lval_del(shadow);
+	return body;
+}
+
+void opt_lambda(lenv* e, lval* f) {
+	/* Optimise the body of lambda f, keeping the one written to run once a
+	 * name resolved in it is rebound */
+	if (!opt_enabled) { return; }
+	lval* body = opt_body(e, f->formals, lval_copy(f->body));
+	if (lval_eq(body, f->body)) { lval_del(body); return; }
+	f->jit->source = f->body;
+	f->body = body;
+}
+
+lval* builtin_type_stats(lenv* e, lval* a) {
+	/* Returns {specialised generic}, the number of call sites given
+	 * specialised builtins by type inference and those left generic */
+	TYPE_CHECK(a, 0, LVAL_SEXPR, "type-stats")
+	CHECK_ARG_NUM(a, 1, "type-stats")
+	LASSERT(a, a->cell[0]->count == 0, "type-stats expects empty sexpr as argument, "
+			"received sexpr with %i arguments", a->cell[0]->count)
+	lval_del(a);
+	lval* r = lval_qexpr();
+	lval_add(r, lval_num(ty_specialised));
+	lval_add(r, lval_num(ty_generic));
+	return r;
+}
+
+lval* builtin_optimise(lenv* e, lval* a) {
+	/* Switch the optimiser on or off for functions defined from now on */
+	CHECK_ARG_NUM(a, 1, "optimise")
+	TYPE_CHECK(a, 0, LVAL_BOOL, "optimise")
+	opt_enabled = a->cell[0]->boo;
+	lval_del(a);
+	return lval_sexpr();
+}
+
+/* Baseline JIT. Lambdas count their calls and once hot, if their body only
+ * does arithmetic, comparisons and ifs over their formals and literals, it
+ * is compiled to x86-64 machine code specialised for the argument types of
+ * that call. Later calls are guarded on those types and fall back to the
+ * interpreter on a mismatch, or when the code hits something it leaves to
+ * the interpreter such as division by zero. Builtins are resolved the same
+ * way as in the optimiser above, and code stops being run under the same
+ * conditions as its optimised bodies. */
+
+/* Calls before a lambda is compiled */
+#define JIT_THRESHOLD 100
+
+/* Whether hot lambdas are compiled */
+int jit_enabled = 1;
+
+enum { JIT_COLD, JIT_COMPILED, JIT_FAILED };
+
+/* Argument and result slots passed to compiled code */
+typedef union {
+	long num;
+	double dec;
+} jit_slot;
+
+typedef int(*jit_fn)(jit_slot*, jit_slot*);
+
+ljit* ljit_new(void) {
+	ljit* j = malloc(sizeof(ljit));
+	j->refs = 1;
+	j->state = JIT_COLD;
+	j->calls = 0;
+	j->runs = 0;
+	j->bails = 0;
+	j->nargs = 0;
+	j->sig = NULL;
+	j->ret = LVAL_NUM;
+	j->code = NULL;
+	j->size = 0;
+	j->aot = NULL;
+	j->source = NULL;
+	j->version = lenv_version;
+	return j;
+}
+
+void ljit_release(ljit* j) {
+	/* Drop one reference, freeing compiled code when none remain */
+	if (--j->refs > 0) { return; }
+#ifdef JIT_X86_64
+	if (j->code) { munmap(j->code, j->size); }
+#endif
+	if (j->source) { lval_del(j->source); }
+	free(j->sig);
+	free(j);
+}
+
+#ifdef JIT_X86_64
+
+/* Code buffer and compilation context */
+typedef struct {
+	unsigned char* buf;
+	int len;
+	int cap;
+	lenv* e;
+	lval* formals;
+	lval* shadow;
+	int* sig;
+} jit_asm;
+
+void jit_emit(jit_asm* j, const void* bytes, int n) {
+	if (j->len + n > j->cap) {
+		while (j->len + n > j->cap) { j->cap *= 2; }
+		j->buf = realloc(j->buf, j->cap);
+	}
+	memcpy(j->buf + j->len, bytes, n);
+	j->len += n;
+}
+
+#define EMIT(j, ...) do { \
+		unsigned char b_[] = { __VA_ARGS__ }; \
+		jit_emit(j, b_, sizeof(b_)); \
+	} while (0)
+
+/* Code starts with a stub returning 1 which every guard jumps back to */
+#define JIT_BAIL 0
+#define JIT_ENTRY 7
+
+void jit_jcc(jit_asm* j, unsigned char cc, int target) {
+	/* Conditional jump to a known target */
+	int rel = target - (j->len + 6);
+	EMIT(j, 0x0F, cc);
+	jit_emit(j, &rel, 4);
+}
+
+int jit_jcc_fwd(jit_asm* j, unsigned char cc) {
+	/* Conditional jump to be patched, 0 as cc emits an unconditional jmp */
+	if (cc) { EMIT(j, 0x0F, cc, 0, 0, 0, 0); } else { EMIT(j, 0xE9, 0, 0, 0, 0); }
+	return j->len;
+}
+
+void jit_patch(jit_asm* j, int at) {
+	/* Point the jump ending at offset at to the current position */
+	int rel = j->len - at;
+	memcpy(j->buf + at - 4, &rel, 4);
+}
+
+/* Condition codes for jcc, setcc is the same plus 0x10 */
+#define CC_P  0x8A
+#define CC_NP 0x8B
+#define CC_E  0x84
+#define CC_NE 0x85
+#define CC_A  0x87
+#define CC_AE 0x83
+#define CC_G  0x8F
+#define CC_GE 0x8D
+#define CC_L  0x8C
+#define CC_LE 0x8E
+
+int jit_formal(jit_asm* j, lval* s) {
+	for (int i = 0; i < j->formals->count; i++) {
+		if (strcmp(j->formals->cell[i]->sym, s->sym) == 0) { return i; }
+	}
+	return -1;
+}
+
+lbuiltin jit_head(jit_asm* j, lval* l) {
+	/* Builtin called by a list, NULL if not one the JIT knows */
+	lval* f = l->cell[0]->type == LVAL_FUN ? l->cell[0]
+		: opt_global(j->e, j->shadow, l->cell[0]);
+	if (!f || f->type != LVAL_FUN || !f->builtin) { return NULL; }
+	lbuiltin b = ty_unspecialise(f->builtin);
+	if (b == builtin_add || b == builtin_sub || b == builtin_mul || b == builtin_div
+			|| b == builtin_gt || b == builtin_lt || b == builtin_ge || b == builtin_le
+			|| b == builtin_eq || b == builtin_ne || b == builtin_if) {
+		return b;
+	}
+	return NULL;
+}
+
+int jit_type_list(jit_asm* j, lval* l);
+
+int jit_type(jit_asm* j, lval* v) {
+	/* Type the expression always evaluates to, -1 if it can't be compiled */
+	switch (v->type) {
+		case LVAL_NUM: case LVAL_DEC: case LVAL_BOOL:
+			return v->type;
+		case LVAL_SYM: {
+			int i = jit_formal(j, v);
+			return i == -1 ? -1 : j->sig[i];
+		}
+		case LVAL_SEXPR:
+			return jit_type_list(j, v);
+	}
+	return -1;
+}
+
+int jit_type_list(jit_asm* j, lval* l) {
+	/* Type of list evaluated as an S-expression */
+	if (l->count == 0) { return -1; }
+	if (l->count == 1) { return jit_type(j, l->cell[0]); }
+
+	lbuiltin b = jit_head(j, l);
+	if (!b) { return -1; }
+
+	if (b == builtin_if) {
+		if (l->count != 4) { return -1; }
+		if (l->cell[2]->type != LVAL_QEXPR || l->cell[3]->type != LVAL_QEXPR) { return -1; }
+		if (jit_type(j, l->cell[1]) == -1) { return -1; }
+		int t = jit_type_list(j, l->cell[2]);
+		return t == jit_type_list(j, l->cell[3]) ? t : -1;
+	}
+
+	/* Operands are numbers, with decimals making everything decimal */
+	int dec = 0;
+	for (int i = 1; i < l->count; i++) {
+		int t = jit_type(j, l->cell[i]);
+		if (t == -1) { return -1; }
+		if (t == LVAL_DEC) { dec = 1; }
+	}
+
+	if (b == builtin_add || b == builtin_sub || b == builtin_mul || b == builtin_div) {
+		return dec ? LVAL_DEC : LVAL_NUM;
+	}
+	return l->count == 3 ? LVAL_BOOL : -1;
+}
+
+void jit_expr(jit_asm* j, lval* v, int want);
+void jit_list(jit_asm* j, lval* l);
+
+void jit_convert(jit_asm* j, int have, int want) {
+	/* Convert number or boolean in rax to a decimal in xmm0 */
+	if (want == LVAL_DEC && have != LVAL_DEC) {
+		EMIT(j, 0xF2, 0x48, 0x0F, 0x2A, 0xC0);        /* cvtsi2sd xmm0, rax */
+	}
+}
+
+void jit_push(jit_asm* j, int t) {
+	if (t == LVAL_DEC) {
+		EMIT(j, 0x48, 0x83, 0xEC, 0x08);              /* sub rsp, 8 */
+		EMIT(j, 0xF2, 0x0F, 0x11, 0x04, 0x24);        /* movsd [rsp], xmm0 */
+	} else {
+		EMIT(j, 0x50);                                /* push rax */
+	}
+}
+
+void jit_pop_pair(jit_asm* j, int t) {
+	/* Move right operand to rcx/xmm1 and pop left operand to rax/xmm0 */
+	if (t == LVAL_DEC) {
+		EMIT(j, 0x66, 0x0F, 0x28, 0xC8);              /* movapd xmm1, xmm0 */
+		EMIT(j, 0xF2, 0x0F, 0x10, 0x04, 0x24);        /* movsd xmm0, [rsp] */
+		EMIT(j, 0x48, 0x83, 0xC4, 0x08);              /* add rsp, 8 */
+	} else {
+		EMIT(j, 0x48, 0x89, 0xC1);                    /* mov rcx, rax */
+		EMIT(j, 0x58);                                /* pop rax */
+	}
+}
+
+void jit_arith(jit_asm* j, lval* l, lbuiltin b, int t) {
+	jit_expr(j, l->cell[1], t);
+
+	/* Unary minus negates, other unary operations return their operand */
+	if (l->count == 2 && b == builtin_sub) {
+		if (t == LVAL_DEC) {
+			long sign = 1UL << 63;
+			EMIT(j, 0x48, 0xB8); jit_emit(j, &sign, 8);  /* mov rax, sign */
+			EMIT(j, 0x66, 0x48, 0x0F, 0x6E, 0xC8);        /* movq xmm1, rax */
+			EMIT(j, 0x66, 0x0F, 0x57, 0xC1);              /* xorpd xmm0, xmm1 */
+		} else {
+			EMIT(j, 0x48, 0xF7, 0xD8);                    /* neg rax */
+		}
+	}
+
+	for (int i = 2; i < l->count; i++) {
+		jit_push(j, t);
+		jit_expr(j, l->cell[i], t);
+		jit_pop_pair(j, t);
+
+		if (t == LVAL_DEC) {
+			if (b == builtin_add) { EMIT(j, 0xF2, 0x0F, 0x58, 0xC1); }  /* addsd */
+			if (b == builtin_sub) { EMIT(j, 0xF2, 0x0F, 0x5C, 0xC1); }  /* subsd */
+			if (b == builtin_mul) { EMIT(j, 0xF2, 0x0F, 0x59, 0xC1); }  /* mulsd */
+			if (b == builtin_div) {
+				/* Bail on a zero divisor, NaN is not zero */
+				EMIT(j, 0x66, 0x0F, 0x57, 0xD2);          /* xorpd xmm2, xmm2 */
+				EMIT(j, 0x66, 0x0F, 0x2E, 0xCA);          /* ucomisd xmm1, xmm2 */
+				int nan = jit_jcc_fwd(j, CC_P);
+				jit_jcc(j, CC_E, JIT_BAIL);
+				jit_patch(j, nan);
+				EMIT(j, 0xF2, 0x0F, 0x5E, 0xC1);          /* divsd xmm0, xmm1 */
+			}
+		} else {
+			if (b == builtin_add) { EMIT(j, 0x48, 0x01, 0xC8); }        /* add rax, rcx */
+			if (b == builtin_sub) { EMIT(j, 0x48, 0x29, 0xC8); }        /* sub rax, rcx */
+			if (b == builtin_mul) { EMIT(j, 0x48, 0x0F, 0xAF, 0xC1); }  /* imul rax, rcx */
+			if (b == builtin_div) {
+				/* Bail on zero, and negate for -1 as idiv traps on overflow */
+				EMIT(j, 0x48, 0x85, 0xC9);                /* test rcx, rcx */
+				jit_jcc(j, CC_E, JIT_BAIL);
+				EMIT(j, 0x48, 0x83, 0xF9, 0xFF);          /* cmp rcx, -1 */
+				int div = jit_jcc_fwd(j, CC_NE);
+				EMIT(j, 0x48, 0xF7, 0xD8);                /* neg rax */
+				int done = jit_jcc_fwd(j, 0);
+				jit_patch(j, div);
+				EMIT(j, 0x48, 0x99);                      /* cqo */
+				EMIT(j, 0x48, 0xF7, 0xF9);                /* idiv rcx */
+				jit_patch(j, done);
+			}
+		}
+	}
+}
+
+void jit_cmp(jit_asm* j, lval* l, lbuiltin b) {
+	int t = (jit_type(j, l->cell[1]) == LVAL_DEC
+		|| jit_type(j, l->cell[2]) == LVAL_DEC) ? LVAL_DEC : LVAL_NUM;
+
+	jit_expr(j, l->cell[1], t);
+	jit_push(j, t);
+	jit_expr(j, l->cell[2], t);
+	jit_pop_pair(j, t);
+
+	if (t == LVAL_DEC) {
+		/* Unordered comparisons must come out false, or true for != */
+		if (b == builtin_lt || b == builtin_le) {
+			EMIT(j, 0x66, 0x0F, 0x2E, 0xC8);              /* ucomisd xmm1, xmm0 */
+		} else {
+			EMIT(j, 0x66, 0x0F, 0x2E, 0xC1);              /* ucomisd xmm0, xmm1 */
+		}
+		if (b == builtin_gt || b == builtin_lt) { EMIT(j, 0x0F, CC_A + 0x10, 0xC0); }
+		if (b == builtin_ge || b == builtin_le) { EMIT(j, 0x0F, CC_AE + 0x10, 0xC0); }
+		if (b == builtin_eq) {
+			EMIT(j, 0x0F, CC_E + 0x10, 0xC0);             /* sete al */
+			EMIT(j, 0x0F, CC_NP + 0x10, 0xC1);            /* setnp cl */
+			EMIT(j, 0x20, 0xC8);                          /* and al, cl */
+		}
+		if (b == builtin_ne) {
+			EMIT(j, 0x0F, CC_NE + 0x10, 0xC0);            /* setne al */
+			EMIT(j, 0x0F, CC_P + 0x10, 0xC1);             /* setp cl */
+			EMIT(j, 0x08, 0xC8);                          /* or al, cl */
+		}
+	} else {
+		EMIT(j, 0x48, 0x39, 0xC8);                        /* cmp rax, rcx */
+		unsigned char cc = CC_E;
+		if (b == builtin_gt) { cc = CC_G; }
+		if (b == builtin_lt) { cc = CC_L; }
+		if (b == builtin_ge) { cc = CC_GE; }
+		if (b == builtin_le) { cc = CC_LE; }
+		if (b == builtin_ne) { cc = CC_NE; }
+		EMIT(j, 0x0F, cc + 0x10, 0xC0);                   /* setcc al */
+	}
+	EMIT(j, 0x0F, 0xB6, 0xC0);                            /* movzx eax, al */
+}
+
+void jit_if(jit_asm* j, lval* l) {
+	if (jit_type(j, l->cell[1]) == LVAL_DEC) {
+		/* NaN is true as it is not equal to zero */
+		jit_expr(j, l->cell[1], LVAL_DEC);
+		EMIT(j, 0x66, 0x0F, 0x57, 0xD2);                  /* xorpd xmm2, xmm2 */
+		EMIT(j, 0x66, 0x0F, 0x2E, 0xC2);                  /* ucomisd xmm0, xmm2 */
+		int nan = jit_jcc_fwd(j, CC_P);
+		int zero = jit_jcc_fwd(j, CC_E);
+		jit_patch(j, nan);
+		jit_list(j, l->cell[2]);
+		int done = jit_jcc_fwd(j, 0);
+		jit_patch(j, zero);
+		jit_list(j, l->cell[3]);
+		jit_patch(j, done);
+	} else {
+		jit_expr(j, l->cell[1], LVAL_NUM);
+		EMIT(j, 0x48, 0x85, 0xC0);                        /* test rax, rax */
+		int zero = jit_jcc_fwd(j, CC_E);
+		jit_list(j, l->cell[2]);
+		int done = jit_jcc_fwd(j, 0);
+		jit_patch(j, zero);
+		jit_list(j, l->cell[3]);
+		jit_patch(j, done);
+	}
+}
+
+void jit_list(jit_asm* j, lval* l) {
+	/* Emit code for a list evaluated as an S-expression, result in rax
+	 * for numbers and booleans, and in xmm0 for decimals */
+	if (l->count == 1) {
+		jit_expr(j, l->cell[0], jit_type(j, l->cell[0]));
+		return;
+	}
+	lbuiltin b = jit_head(j, l);
+	if (b == builtin_if) {
+		jit_if(j, l);
+	} else if (b == builtin_add || b == builtin_sub
+			|| b == builtin_mul || b == builtin_div) {
+		jit_arith(j, l, b, jit_type_list(j, l));
+	} else {
+		jit_cmp(j, l, b);
+	}
+}
+
+void jit_expr(jit_asm* j, lval* v, int want) {
+	/* Emit code for an expression, converted to a decimal if wanted */
+	int t = jit_type(j, v);
+	switch (v->type) {
+		case LVAL_NUM:
+			EMIT(j, 0x48, 0xB8); jit_emit(j, &v->num, 8);     /* mov rax, imm64 */
+			break;
+		case LVAL_BOOL: {
+			long b = v->boo;
+			EMIT(j, 0x48, 0xB8); jit_emit(j, &b, 8);          /* mov rax, imm64 */
+			break;
+		}
+		case LVAL_DEC:
+			EMIT(j, 0x48, 0xB8); jit_emit(j, &v->dec, 8);     /* mov rax, imm64 */
+			EMIT(j, 0x66, 0x48, 0x0F, 0x6E, 0xC0);            /* movq xmm0, rax */
+			break;
+		case LVAL_SYM: {
+			int disp = jit_formal(j, v) * sizeof(jit_slot);
+			if (t == LVAL_DEC) {
+				EMIT(j, 0xF2, 0x0F, 0x10, 0x87);              /* movsd xmm0, [rdi+disp] */
+			} else {
+				EMIT(j, 0x48, 0x8B, 0x87);                    /* mov rax, [rdi+disp] */
+			}
+			jit_emit(j, &disp, 4);
+			break;
+		}
+		case LVAL_SEXPR:
+			jit_list(j, v);
+			break;
+	}
+	jit_convert(j, t, want);
+}
+
+void jit_compile(lenv* e, lval* f, lval* a) {
+	/* Try to compile f specialised for the types of the arguments a */
+	ljit* fj = f->jit;
+	fj->state = JIT_FAILED;
+
+	if (f->env->count != 0 || a->count != f->formals->count) { return; }
+	for (int i = 0; i < f->formals->count; i++) {
+		if (strcmp(f->formals->cell[i]->sym, "&") == 0) { return; }
+		int t = a->cell[i]->type;
+		if (!(t == LVAL_NUM || t == LVAL_DEC || t == LVAL_BOOL)) { return; }
+	}
+
+	jit_asm j;
+	j.e = e;
+	j.formals = f->formals;
+	j.sig = malloc(sizeof(int) * (a->count + 1));
+	for (int i = 0; i < a->count; i++) { j.sig[i] = a->cell[i]->type; }
+	j.shadow = lval_copy(f->formals);
+	opt_shadowed(j.shadow, f->body);
+
+	int ret = jit_type_list(&j, f->body);
+	if (ret == -1) {
+		free(j.sig);
+		lval_del(j.shadow);
+		return;
+	}
+
+	j.cap = 256;
+	j.len = 0;
+	j.buf = malloc(j.cap);
+
+	/* Bail stub, then prologue, body and epilogue storing the result */
+	EMIT(&j, 0xB8, 0x01, 0x00, 0x00, 0x00);               /* mov eax, 1 */
+	EMIT(&j, 0xC9, 0xC3);                                 /* leave; ret */
+	EMIT(&j, 0x55);                                       /* push rbp */
+	EMIT(&j, 0x48, 0x89, 0xE5);                           /* mov rbp, rsp */
+	jit_list(&j, f->body);
+	if (ret == LVAL_DEC) {
+		EMIT(&j, 0xF2, 0x0F, 0x11, 0x06);                 /* movsd [rsi], xmm0 */
+	} else {
+		EMIT(&j, 0x48, 0x89, 0x06);                       /* mov [rsi], rax */
+	}
+	EMIT(&j, 0x31, 0xC0);                                 /* xor eax, eax */
+	EMIT(&j, 0xC9, 0xC3);                                 /* leave; ret */
+
+	/* Copy into executable memory */
+	void* code = mmap(NULL, j.len, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code != MAP_FAILED) {
+		memcpy(code, j.buf, j.len);
+		if (mprotect(code, j.len, PROT_READ | PROT_EXEC) == 0) {
+			fj->state = JIT_COMPILED;
+			fj->code = code;
+			fj->size = j.len;
+			fj->nargs = a->count;
+			fj->sig = j.sig;
+			fj->ret = ret;
+			j.sig = NULL;
+		} else {
+			munmap(code, j.len);
+		}
+	}
+
+	free(j.buf);
+	free(j.sig);
+	lval_del(j.shadow);
+}
+
+#endif
+
+lval* jit_call(lenv* e, lval* f, lval* a) {
+	/* Run the compiled code for f if possible, otherwise NULL */
+	ljit* j = f->jit;
+#ifdef JIT_X86_64
+	/* Builtins were resolved when the lambda was made, so once one of
+	 * them may have been rebound the code is no longer run */
+	if (!lwatch_valid(j)) { return NULL; }
+	if (j->state == JIT_COLD) {
+		if (!jit_enabled || ++j->calls < JIT_THRESHOLD) { return NULL; }
+		jit_compile(e, f, a);
+	}
+	if (j->state != JIT_COMPILED) { return NULL; }
+	j->calls++;
+
+	/* Guard on the arguments matching the specialisation */
+	if (a->count != j->nargs || f->formals->count != j->nargs) {
+		j->bails++;
+		return NULL;
+	}
+	jit_slot stack[8];
+	jit_slot* args = j->nargs > 8 ? malloc(sizeof(jit_slot) * j->nargs) : stack;
+	for (int i = 0; i < j->nargs; i++) {
+		lval* x = a->cell[i];
+		if (x->type != j->sig[i]) {
+			if (args != stack) { free(args); }
+			j->bails++;
+			return NULL;
+		}
+		if (x->type == LVAL_NUM) { args[i].num = x->num; }
+		if (x->type == LVAL_BOOL) { args[i].num = x->boo; }
+		if (x->type == LVAL_DEC) { args[i].dec = x->dec; }
+	}
+
+	jit_slot r;
+	int bail = ((jit_fn)((char*)j->code + JIT_ENTRY))(args, &r);
+	if (args != stack) { free(args); }
+	if (bail) {
+		j->bails++;
+		return NULL;
+	}
+
+	j->runs++;
+	lval_del(a);
+	if (j->ret == LVAL_DEC) { return lval_dec(r.dec); }
+	if (j->ret == LVAL_BOOL) { return lval_bool(r.num); }
+	return lval_num(r.num);
+#else
+	j->calls++;
+	return NULL;
+#endif
+}
+
+lval* builtin_jit(lenv* e, lval* a) {
+	/* Switch compilation of hot lambdas on or off */
+	CHECK_ARG_NUM(a, 1, "jit")
+	TYPE_CHECK(a, 0, LVAL_BOOL, "jit")
+	jit_enabled = a->cell[0]->boo;
+	lval_del(a);
+	return lval_sexpr();
+}
+
+lval* builtin_jit_stats(lenv* e, lval* a) {
+	/* Returns {calls compiled runs bails} for a lambda */
+	CHECK_ARG_NUM(a, 1, "jit-stats")
+	TYPE_CHECK(a, 0, LVAL_FUN, "jit-stats")
+	LASSERT(a, a->cell[0]->jit, "Function jit-stats passed a builtin or partially applied function")
+
+	ljit* j = a->cell[0]->jit;
+	lval* v = lval_qexpr();
+	v = lval_add(v, lval_num(j->calls));
+	v = lval_add(v, lval_bool(j->state == JIT_COMPILED));
+	v = lval_add(v, lval_num(j->runs));
+	v = lval_add(v, lval_num(j->bails));
+	lval_del(a);
+	return v;
+}
+
+lval* builtin_lambda(lenv* e, lval* a) {
+	/* Create lambda function */
+	CHECK_ARG_NUM(a, 2, "\\")
+	TYPE_CHECK(a, 0, LVAL_QEXPR, "\\")
+	TYPE_CHECK(a, 1, LVAL_QEXPR, "\\")
+
+	/* Check first Q-expression contains only Symbols */
+	for (int i = 0; i < a->cell[0]->count; i++) {
+		LASSERT(a, (a->cell[0]->cell[i]->type == LVAL_SYM),
+				"Cannot define non-symbol. Got %s, Expected %s.",
+				ltype_name(a->cell[0]->cell[i]->type), ltype_name(LVAL_SYM));
+	}
+
+	/* Pop first two arguments and pass them to lval_lambda */
+	lval* formals = lval_pop(a, 0);
+	lval* body = lval_pop(a, 0);
+	lval_del(a);
+
+	lval* f = lval_lambda(formals, body);
+	opt_lambda(e, f);
+	return f;
+}
+
+/* Default number of results kept by a memoised function */
+#define MEMO_CAPACITY 1024
+
+lval* builtin_memo(lenv* e, lval* a) {
+	/* Wrap lambda with a result cache of optionally given capacity */
+	LASSERT(a, a->count == 1 || a->count == 2,
+			"Function memo passed incorrect number of arguments. "
+			"Got %i, Expected 1 or 2", a->count)
+	TYPE_CHECK(a, 0, LVAL_FUN, "memo")
+	LASSERT(a, a->cell[0]->builtin == NULL,
+			"Function memo can only wrap lambdas, not builtins")
+
+	int capacity = MEMO_CAPACITY;
+	if (a->count == 2) {
+		TYPE_CHECK(a, 1, LVAL_NUM, "memo")
+		LASSERT(a, a->cell[1]->num > 0,
+				"Function memo passed non-positive capacity %li",
+				a->cell[1]->num)
+		LASSERT(a, a->cell[1]->num <= MEMO_MAX_CAPACITY,
+				"Function memo passed capacity %li, Expected at most %i",
+				a->cell[1]->num, MEMO_MAX_CAPACITY)
+		capacity = a->cell[1]->num;
+	}
+
+	lmemo* m = lmemo_new(capacity);
+	LASSERT(a, m, "Function memo could not allocate a cache")
+	lval* f = lval_take(a, 0);
+	if (f->memo) { lmemo_release(f->memo); }
+	f->memo = m;
+	return f;
+}
+
+lval* builtin_memo_stats(lenv* e, lval* a) {
+	/* Returns {hits misses evictions size capacity} of a memoised function */
+	CHECK_ARG_NUM(a, 1, "memo-stats")
+	TYPE_CHECK(a, 0, LVAL_FUN, "memo-stats")
+	LASSERT(a, a->cell[0]->memo, "Function memo-stats passed function that is not memoised")
+
+	lmemo* m = a->cell[0]->memo;
+	lval* v = lval_qexpr();
+	v = lval_add(v, lval_num(m->hits));
+	v = lval_add(v, lval_num(m->misses));
+	v = lval_add(v, lval_num(m->evictions));
+	v = lval_add(v, lval_num(m->count));
+	v = lval_add(v, lval_num(m->capacity));
+	lval_del(a);
+	return v;
+}
+
+lval* builtin_var(lenv* e, lval* a, char* func) {
+	/* Assign symbols to values */
+	TYPE_CHECK(a, 0, LVAL_QEXPR, func);
+
+	lval* syms = a->cell[0];
+
+	/* Ensure all elements of first list are symbols */
+	for (int i = 0; i < syms->count; i++) {
+		LASSERT(a, syms->cell[i]->type == LVAL_SYM,
+				"Function '%s' cannot define non-symbol"
+				"Got %s, Expected %s. ",
+				func, ltype_name(syms->cell[i]->type),
+			       	ltype_name(LVAL_SYM));
+	}
+
+	/* Check correct number of symbols and values */
+	LASSERT(a, syms->count == a->count-1,
+			"Function '%s' passed too many arguments for symbols "
+			"Got %i symbols and %i values",
+			func, syms->count, a->count-1);
+
+	/* Assign copies of values to symbols */
+	for (int i = 0; i < syms->count; i++) {
+		/* If 'def' define in globally. If 'put' define in locally */
+		if (strcmp(func, "def") == 0) {
+			lenv_def(e, syms->cell[i], a->cell[i+1]);
+		}
+
+		if (strcmp(func, "=") == 0) {
+			lenv_put(e, syms->cell[i], a->cell[i+1]);
+		}
+	}
+
+	lval_del(a);
+	return lval_sexpr();
+}
+
+lval* builtin_def(lenv* e, lval* a) {
+	return builtin_var(e, a, "def");
+}
+
+lval* builtin_fun(lenv* e, lval* a) {
+	lval* fun_name = lval_add(lval_qexpr(), lval_pop(a->cell[0], 0));
+	lval* fun = builtin_lambda(e, a);
+
+	lval* sexpr = lval_add(lval_sexpr(), fun_name);
+	sexpr = lval_add(sexpr, fun);
+	return builtin_def(e, sexpr);
+}
+
+lval* builtin_put(lenv* e, lval* a) {
+	return builtin_var(e, a, "=");
+}
+
+lval* builtin_eval(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 1, "eval")
+	TYPE_CHECK(a, 0, LVAL_QEXPR, "eval")
+
+	lval* x = lval_take(a, 0);
+	x->type = LVAL_SEXPR;
+	return lval_eval(e, x);
+}
+
+
+lval* builtin_qexpr_join(lenv* e, lval* a) {
+	for (int i = 0; i < a->count; i++) {
+		TYPE_CHECK(a, i, LVAL_QEXPR, "qexpr join");
+	}
+	lval* x = lval_pop(a, 0);
+
+	while (a->count) {
+		x = lval_join(x, lval_pop(a, 0));
+	}
+
+	lval_del(a);
+	return x;
+}
+
+lval* builtin_str_join(lenv* e, lval* a) {
+	for (int i = 0; i< a->count; i++) {
+		TYPE_CHECK(a, i, LVAL_STR, "string join")
+	}
+	lval* x = lval_pop(a, 0);
+
+	while (a->count) {
+		x = lval_str_join(x, lval_pop(a, 0));
+	}
+
+	lval_del(a);
+	return x;
+}
+
+
+lval* builtin_join(lenv* e, lval* a) {
+	if (a->cell[0]->type == LVAL_QEXPR){
+		return builtin_qexpr_join(e, a);
+	} else {
+		return builtin_str_join(e, a);
+	}
+}
+
+lval* builtin_list_env(lenv* e, lval* a) {
+	TYPE_CHECK(a, 0, LVAL_SEXPR, "list_env")
+	CHECK_ARG_NUM(a, 1, "list_env")
+	LASSERT(a, a->cell[0]->count == 0, "list_env expects empty sexpr as argument, "
+			"received sexpr with %i arguments", a->cell[0]->count)
+
+
+	lval_del(a);
+
+	lval* v = lval_qexpr();
+	/* Iterate over all items in environment */
+	for (int i = 0; i < e->count; i++) {
+		v = lval_add(v, lval_sym(e->syms[i]));
+   	}
+	return v;
+}
+
+lval* builtin_exit(lenv* e, lval* a) {
+	TYPE_CHECK(a, 0, LVAL_SEXPR, "exit")
+	CHECK_ARG_NUM(a, 1, "exit")
+	LASSERT(a, a->cell[0]->count == 0, "exit expects empty sexpr as argument, "
+			"received sexpr with %i arguments", a->cell[0]->count)
+	e->quit = 1;
+	lval_del(a);
+	return lval_sym("Exiting Prompt");
+}
+
+/* Defined all builtins, now load them into environment */
+void lenv_add_builtin(lenv* e, char* name, lbuiltin func) {
+	lval* k = lval_sym(name);
+	lval* v = lval_fun(func, name);
+	lenv_put(e, k, v);
+	lval_del(k); lval_del(v);
+}
+
+/* Directory of the cache of expressions read by load, or NULL for none */
+char* cache_dir = NULL;
+
+/* Loads found in the cache and not, and the seconds each took, counted
+ * under cache_lock when threads read through the cache */
+long cache_hits = 0;
+long cache_misses = 0;
+double cache_hit_time = 0;
+double cache_miss_time = 0;
+#ifdef READ_THREADS
+pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+void lval_eval_each(lenv* e, lval* expr) {
+	/* Evaluate every expression read from a file in turn, printing any
+	 * errors, and delete what is left of expr */
+	for (int i = 0; i < expr->count; i++) {
+		lval* x = lval_eval(e, expr->cell[i]);
+		if (x->type == LVAL_ERR) { lval_println(x); }
+		lval_del(x);
+	}
+	free(expr->cell);
+	free(expr);
+}
+
+typedef struct lcache lcache;
+lcache* lcache_open(char*);
+lval* lcache_next(lcache*, char**);
+void lcache_close(lcache*);
+
+lval* builtin_load(lenv* e, lval* a) {
+	/* Run contents of file */
+	CHECK_ARG_NUM(a, 1, "load")
+	TYPE_CHECK(a, 0, LVAL_STR, "load")
+
+	/* Evaluate each expression as soon as it is read, through the cache
+	 * when there is one, and otherwise unless using mpc */
+	lcache* c = cache_dir ? lcache_open(a->cell[0]->str) : NULL;
+	lstream* s = c || reader_mpc ? NULL : lstream_open(a->cell[0]->str, 1);
+	if (c || s) {
+		char* err_msg;
+		lval* x;
+		while ((x = c ? lcache_next(c, &err_msg) : lstream_next(s, &err_msg))) {
+			x = lval_eval(e, x);
+			/* If Evaluation leads to error print it */
+			if (x->type == LVAL_ERR) { lval_println(x); }
+			lval_del(x);
+		}
+		if (c) { lcache_close(c); } else { lstream_close(s); }
+		lval_del(a);
+
+		if (err_msg) {
+			lval* err = lval_err("Could not load Library %s", err_msg);
+			free(err_msg);
+			return err;
+		}
+		return lval_sexpr();
+	}
+
+	/* Read contents */
+	char* err_msg;
+	lval* expr = lval_read_file(a->cell[0]->str, &err_msg);
+	if (expr) {
+
+		/* Evalutate each expression, deleting expressions and arguments */
+		lval_eval_each(e, expr);
+		lval_del(a);
+
+		/* Return empty list */
+		return lval_sexpr();
+	} else {
+		/* Create new error message using it */
+		lval* err = lval_err("Could not load Library %s", err_msg);
+		free(err_msg);
+		lval_del(a);
+
+		/* Cleanup and return error */
+		return err;
+	}
+}
+
+lval* builtin_cache_stats(lenv* e, lval* a) {
+	/* Returns {hits misses hit-time miss-time}, the number of files load
+	 * found in the cache and not, and the seconds spent loading each */
+	TYPE_CHECK(a, 0, LVAL_SEXPR, "cache-stats")
+	CHECK_ARG_NUM(a, 1, "cache-stats")
+	LASSERT(a, a->cell[0]->count == 0, "cache-stats expects empty sexpr as argument, "
+			"received sexpr with %i arguments", a->cell[0]->count)
+	lval_del(a);
+	lval* r = lval_qexpr();
+	lval_add(r, lval_num(cache_hits));
+	lval_add(r, lval_num(cache_misses));
+	lval_add(r, lval_dec(cache_hit_time));
+	lval_add(r, lval_dec(cache_miss_time));
+	return r;
+}
+
+lval* builtin_json_read(lenv* e, lval* a) {
+	/* Read every JSON value in a file, returning them in a list, or given
+	 * a function calling it on each in turn as it is read */
+	LASSERT(a, a->count == 1 || a->count == 2,
+			"Function json-read passed incorrect number of arguments. "
+			"Got %i, Expected 1 or 2", a->count)
+	TYPE_CHECK(a, 0, LVAL_STR, "json-read")
+	if (a->count == 2) { TYPE_CHECK(a, 1, LVAL_FUN, "json-read") }
+
+	lstream* s = lstream_open(a->cell[0]->str, 1);
+	if (!s) {
+		lval* err = lval_err("Could not open %s", a->cell[0]->str);
+		lval_del(a);
+		return err;
+	}
+	lval* f = a->count == 2 ? a->cell[1] : NULL;
+	lval* r = f ? lval_sexpr() : lval_qexpr();
+	char* err;
+	lval* x;
+	while ((x = json_next(s, &err))) {
+		if (!f) { lval_add(r, x); continue; }
+		lval* g = lval_copy(f);
+		lval* y = lval_call(e, g, lval_add(lval_sexpr(), x));
+		lval_del(g);
+		if (y->type == LVAL_ERR) {
+			lval_del(r);
+			r = y;
+			break;
+		}
+		lval_del(y);
+	}
+	lstream_close(s);
+	lval_del(a);
+
+	if (err) {
+		lval_del(r);
+		r = lval_err("Could not read JSON %s", err);
+		free(err);
+	}
+	return r;
+}
+
+lval* builtin_json_write(lenv* e, lval* a) {
+	/* Write each value after the file name to the file as JSON, one to a
+	 * line */
+	LASSERT(a, a->count >= 2,
+			"Function json-write passed incorrect number of arguments. "
+			"Got %i, Expected at least 2", a->count)
+	TYPE_CHECK(a, 0, LVAL_STR, "json-write")
+
+	char* path = a->cell[0]->str;
+	FILE* f = fopen(path, "wb");
+	if (!f) {
+		lval* err = lval_err("Could not open %s for writing", path);
+		lval_del(a);
+		return err;
+	}
+	char buf[LOUT_SIZE];
+	lout o = lout_file(f, buf, sizeof(buf));
+	char* bad = NULL;
+	for (int i = 1; i < a->count && !bad; i++) {
+		bad = json_write(&o, a->cell[i]);
+		lout_putc(&o, '\n');
+	}
+	lout_flush(&o);
+	int failed = ferror(f);
+	if (fclose(f) != 0) { failed = 1; }
+
+	/* Leave no half written file behind */
+	lval* x = bad ? lval_err("Could not write %s as JSON", bad)
+		: failed ? lval_err("Could not write %s", path) : lval_ok();
+	if (bad || failed) { remove(path); }
+	lval_del(a);
+	return x;
+}
+
+lval* builtin_open(lenv* e, lval* a) {
+	/* Open a file, with mode "r" to read it, "w" to write it or "a" to
+	 * append to it, returning its handle */
+	CHECK_ARG_NUM(a, 2, "open")
+	TYPE_CHECK(a, 0, LVAL_STR, "open")
+	TYPE_CHECK(a, 1, LVAL_STR, "open")
+	char* mode = a->cell[1]->str;
+	LASSERT(a, strcmp(mode, "r") == 0 || strcmp(mode, "w") == 0 || strcmp(mode, "a") == 0,
+			"Function open passed mode \"%s\", Expected \"r\", \"w\" or \"a\"", mode)
+
+	lfile* h = lfile_open(a->cell[0]->str, mode);
+	lval* x = h ? lval_file(h) : lval_err("Could not open %s", a->cell[0]->str);
+	lval_del(a);
+	return x;
+}
+
+lval* builtin_close(lenv* e, lval* a) {
+	/* Close a file, flushing anything written to it. Every copy of the
+	 * handle is closed with it */
+	CHECK_ARG_NUM(a, 1, "close")
+	TYPE_CHECK(a, 0, LVAL_FILE, "close")
+	lfile* h = a->cell[0]->file;
+	lval* x = lfile_close(h) ? lval_ok() : lval_err("Could not write %s", h->path);
+	lval_del(a);
+	return x;
+}
+
+lval* builtin_read_line(lenv* e, lval* a) {
+	/* Read the next line of a file, or () at its end */
+	CHECK_ARG_NUM(a, 1, "read-line")
+	TYPE_CHECK(a, 0, LVAL_FILE, "read-line")
+	lfile* h = a->cell[0]->file;
+	LASSERT(a, h->in, "File %s is not open for reading", h->path)
+	lval* x = lfile_line(h);
+	lval_del(a);
+	return x ? x : lval_sexpr();
+}
+
+lval* builtin_write(lenv* e, lval* a) {
+	/* Write each value after the handle to the file, strings as they are
+	 * and anything else as it prints */
+	LASSERT(a, a->count >= 2,
+			"Function write passed incorrect number of arguments. "
+			"Got %i, Expected at least 2", a->count)
+	TYPE_CHECK(a, 0, LVAL_FILE, "write")
+	lfile* h = a->cell[0]->file;
+	LASSERT(a, h->out, "File %s is not open for writing", h->path)
+
+	char buf[LOUT_SIZE];
+	lout o = lout_file(h->out, buf, sizeof(buf));
+	for (int i = 1; i < a->count; i++) {
+		lval* x = a->cell[i];
+		if (x->type == LVAL_STR) { lout_puts(&o, x->str); } else { lval_write(&o, x); }
+	}
+	lout_flush(&o);
+	lval* x = ferror(h->out) ? lval_err("Could not write %s", h->path) : lval_ok();
+	lval_del(a);
+	return x;
+}
+
+/* Lazy sequences. A sequence is a recipe for its elements, made from a
+ * source such as a range, a list or the lines of a file, and from other
+ * sequences by mapping, filtering and taking from them. It never changes
+ * once made, so copies share it and it can be gone through any number of
+ * times. Going through one builds a chain of iterators, one for each
+ * sequence in the recipe, and elements are pulled along the chain one at a
+ * time, so a pipeline only ever holds the element it is working on. */
+
+enum { LSEQ_LIST, LSEQ_RANGE, LSEQ_ITERATE, LSEQ_LINES,
+       LSEQ_MAP, LSEQ_FILTER, LSEQ_TAKE, LSEQ_TAKE_WHILE };
+
+lseq* lseq_new(int kind, lseq* src, lval* f, lval* x) {
+	lseq* s = malloc(sizeof(lseq));
+	s->refs = 1;
+	s->kind = kind;
+	s->src = src;
+	s->f = f;
+	s->x = x;
+	s->start = 0;
+	s->end = 0;
+	s->step = 0;
+	return s;
+}
+
+void lseq_release(lseq* s) {
+	s->refs--;
+	if (s->refs > 0) { return; }
+	if (s->src) { lseq_release(s->src); }
+	if (s->f) { lval_del(s->f); }
+	if (s->x) { lval_del(s->x); }
+	free(s);
+}
+
+char* lseq_name(lseq* s) {
+	switch (s->kind) {
+		case LSEQ_LIST: return "list";
+		case LSEQ_RANGE: return "range";
+		case LSEQ_ITERATE: return "iterate";
+		case LSEQ_LINES: return "lines";
+		case LSEQ_MAP: return "lazy-map";
+		case LSEQ_FILTER: return "lazy-filter";
+		case LSEQ_TAKE: return "lazy-take";
+		case LSEQ_TAKE_WHILE: return "take-while";
+	}
+	return "unknown";
+}
+
+lval* lval_seq(lseq* s) {
+	lval* v = malloc(sizeof(lval));
+	v->type = LVAL_SEQ;
+	v->seq = s;
+	return v;
+}
+
+lseq* lseq_of(lval* v) {
+	/* The sequence of a Sequence or Q-Expression, deleting v or taking it
+	 * over as a list */
+	if (v->type == LVAL_QEXPR) { return lseq_new(LSEQ_LIST, NULL, NULL, v); }
+	lseq* s = v->seq;
+	s->refs++;
+	lval_del(v);
+	return s;
+}
+
+typedef struct lseq_iter lseq_iter;
+struct lseq_iter {
+	lseq* seq;
+	lseq_iter* src;
+	long i;
+	int done;
+
+	/* Last value of iterate, or an error to give back first */
+	lval* x;
+
+	/* File being read by lines */
+	lfile* file;
+};
+
+lseq_iter* lseq_start(lseq* s) {
+	lseq_iter* it = malloc(sizeof(lseq_iter));
+	it->seq = s;
+	it->src = s->src ? lseq_start(s->src) : NULL;
+	it->i = s->kind == LSEQ_RANGE ? s->start : 0;
+	it->done = 0;
+	it->x = NULL;
+	it->file = NULL;
+
+	/* Lines of a file name open it afresh each time they are gone through */
+	if (s->kind == LSEQ_LINES && s->x->type == LVAL_STR) {
+		it->file = lfile_open(s->x->str, "r");
+		if (!it->file) { it->x = lval_err("Could not open %s", s->x->str); }
+	} else if (s->kind == LSEQ_LINES) {
+		it->file = s->x->file;
+		it->file->refs++;
+	}
+	return it;
+}
+
+void lseq_stop(lseq_iter* it) {
+	if (it->src) { lseq_stop(it->src); }
+	if (it->x) { lval_del(it->x); }
+	if (it->file) { lfile_release(it->file); }
+	free(it);
+}
+
+lval* lseq_call(lenv* e, lval* f, lval* x) {
+	lval* g = lval_copy(f);
+	lval* r = lval_call(e, g, lval_add(lval_sexpr(), x));
+	lval_del(g);
+	return r;
+}
+
+lval* lseq_test(lenv* e, lseq* s, lval* x, int* keep) {
+	/* Call the sequence's predicate on a copy of x, setting keep by its
+	 * result as if does, or returning an error */
+	lval* r = lseq_call(e, s->f, lval_copy(x));
+	switch (r->type) {
+		case LVAL_ERR: return r;
+		case LVAL_BOOL: *keep = r->boo == LVAL_TRUE; break;
+		case LVAL_NUM: *keep = r->num != 0; break;
+		case LVAL_DEC: *keep = r->dec != 0; break;
+		default: {
+			lval* err = lval_err("Function %s expected its function to return Number, "
+					"Decimal or Boolean. Got %s", lseq_name(s), ltype_name(r->type));
+			lval_del(r);
+			return err;
 		}
 	}
+	lval_del(r);
+	return NULL;
+}
 
-	/* Otherwise, process each argument individually */
-	while (a->count > 0) {
+lval* lseq_next(lenv* e, lseq_iter* it) {
+	/* The next element, NULL once there are no more, or an error after
+	 * which there are none */
+	lseq* s = it->seq;
+	if (it->done) { return NULL; }
+	if (it->x && it->x->type == LVAL_ERR) {
+		lval* err = it->x;
+		it->x = NULL;
+		it->done = 1;
+		return err;
+	}
 
-		lval* y = lval_pop(a, 0);
+	lval* x;
+	switch (s->kind) {
+		case LSEQ_LIST:
+			if (it->i == s->x->count) { return NULL; }
+			return lval_copy(s->x->cell[it->i++]);
+
+		case LSEQ_RANGE:
+			if (s->step > 0 ? it->i >= s->end : it->i <= s->end) { return NULL; }
+			x = lval_num(it->i);
+			/* Stop rather than overflow at the ends of the range of numbers */
+			if (s->step > 0 ? it->i > LONG_MAX - s->step : it->i < LONG_MIN - s->step) {
+				it->done = 1;
+			} else {
+				it->i += s->step;
+			}
+			return x;
 
-		/* Arithmetic ops */
-		if (strcmp(op, "+") == 0) { x->dec += y->dec; }
-		if (strcmp(op, "-") == 0) { x->dec -= y->dec; }
-		if (strcmp(op, "*") == 0) { x->dec *= y->dec; }
-		if (strcmp(op, "/") == 0) {
-			if (y->dec == 0) {
-				lval_del(x); lval_del(y);
-				x = lval_err("Division By Zero!"); break;
+		case LSEQ_ITERATE:
+			/* Each value is made only once the one before it is used up */
+			if (it->i++ == 0) {
+				it->x = lval_copy(s->x);
+			} else {
+				it->x = lseq_call(e, s->f, it->x);
+				if (it->x->type == LVAL_ERR) {
+					x = it->x;
+					it->x = NULL;
+					it->done = 1;
+					return x;
+				}
 			}
-			x->dec /= y->dec;
-		}
-		if (strcmp(op, "%") == 0) { return lval_err("Can't compute remainder on decimal types!");}
+			return lval_copy(it->x);
 
-		/* Comparison ops */
-		if (strcmp(op, ">") == 0) {
-			x->type = LVAL_BOOL;
-			x->boo = (x->dec > y->dec);
-		}
-		if (strcmp(op, "<") == 0) {
-			x->type = LVAL_BOOL;
-			x->boo = (x->dec < y->dec);
-		}
-		if (strcmp(op, ">=") == 0) {
-			x->type = LVAL_BOOL;
-			x->boo = (x->dec >= y->dec);
-		}
-		if (strcmp(op, "<=") == 0) {
-			x->type = LVAL_BOOL;
-			x->boo = (x->dec <= y->dec);
-		}
-		if (strcmp(op, "||") == 0) {
-			x->type = LVAL_BOOL;
-			x->boo = (x->dec || y->dec);
-		}
-		if (strcmp(op, "&&") == 0) {
-			x->type = LVAL_BOOL;
-			x->boo = (x->dec && y->dec);
+		case LSEQ_LINES:
+			if (!it->file->in) {
+				it->done = 1;
+				return lval_err("File %s is not open for reading", it->file->path);
+			}
+			return lfile_line(it->file);
+
+		case LSEQ_MAP:
+			x = lseq_next(e, it->src);
+			if (!x || x->type == LVAL_ERR) { return x; }
+			return lseq_call(e, s->f, x);
+
+		case LSEQ_FILTER:
+			while ((x = lseq_next(e, it->src)) && x->type != LVAL_ERR) {
+				int keep;
+				lval* err = lseq_test(e, s, x, &keep);
+				if (err) { lval_del(x); return err; }
+				if (keep) { return x; }
+				lval_del(x);
+			}
+			return x;
+
+		case LSEQ_TAKE:
+			if (it->i == s->end) { return NULL; }
+			it->i++;
+			return lseq_next(e, it->src);
+
+		case LSEQ_TAKE_WHILE: {
+			x = lseq_next(e, it->src);
+			if (!x || x->type == LVAL_ERR) { return x; }
+			int keep;
+			lval* err = lseq_test(e, s, x, &keep);
+			if (err) { lval_del(x); return err; }
+			if (keep) { return x; }
+			lval_del(x);
+			it->done = 1;
+			return NULL;
 		}
-		lval_del(y);
 	}
-	lval_del(a); return x;
-
+	return NULL;
 }
 
-lval* num_op(lval* a, char* op) {
-	/* Numerical operation function for decimal types */
-	lval* x = lval_pop(a, 0);
-
-	/* If no arguments and sub then perform unary negation */
-	if ((strcmp(op, "-") == 0) && a->count == 0) {
-		x->num = -x->num;
+#define SEQ_CHECK(args, num, fun_name) \
+	LASSERT(args, args->cell[num]->type == LVAL_SEQ || args->cell[num]->type == LVAL_QEXPR, \
+			"Function %s passed incorrect type for argument %i. " \
+			"Got %s, Expected Sequence or Q-Expression", \
+			fun_name, num, ltype_name(args->cell[num]->type))
+
+lval* builtin_lines(lenv* e, lval* a) {
+	/* The lines of a file as a sequence, given its name or a handle open
+	 * for reading. A file name is opened again each time the lines are
+	 * gone through, while a handle carries on from where it is */
+	CHECK_ARG_NUM(a, 1, "lines")
+	lval* x = a->cell[0];
+	LASSERT(a, x->type == LVAL_STR || x->type == LVAL_FILE,
+			"Function lines passed incorrect type for argument 0. "
+			"Got %s, Expected String or File", ltype_name(x->type))
+	if (x->type == LVAL_FILE) {
+		LASSERT(a, x->file->in, "File %s is not open for reading", x->file->path)
 	}
-	/* If no arguments and not op, then reverse boolean */
-	if (strcmp(op, "!") == 0) {
-		x->type = LVAL_BOOL;
-		if (x->num == 0) {
-			x->boo = LVAL_FALSE;
-		} else {
-			x->boo = LVAL_TRUE;
-		}
+	lval* s = lval_seq(lseq_new(LSEQ_LINES, NULL, NULL, lval_pop(a, 0)));
+	lval_del(a);
+	return s;
+}
+
+lval* builtin_range(lenv* e, lval* a) {
+	/* The numbers from start up to but not including end, by step, with
+	 * start 0 and step 1 if not given */
+	LASSERT(a, a->count >= 1 && a->count <= 3,
+			"Function range passed incorrect number of arguments. "
+			"Got %i, Expected 1, 2 or 3", a->count)
+	for (int i = 0; i < a->count; i++) { TYPE_CHECK(a, i, LVAL_NUM, "range") }
+
+	lseq* s = lseq_new(LSEQ_RANGE, NULL, NULL, NULL);
+	s->start = a->count == 1 ? 0 : a->cell[0]->num;
+	s->end = a->count == 1 ? a->cell[0]->num : a->cell[1]->num;
+	s->step = a->count == 3 ? a->cell[2]->num : 1;
+	if (s->step == 0) {
+		lseq_release(s);
+		lval_del(a);
+		return lval_err("Function range passed a step of 0");
 	}
+	lval_del(a);
+	return lval_seq(s);
+}
 
-	/* Otherwise, process each argument individually */
-	while (a->count > 0) {
+lval* builtin_iterate(lenv* e, lval* a) {
+	/* The endless sequence x, f x, f (f x) and so on */
+	CHECK_ARG_NUM(a, 2, "iterate")
+	TYPE_CHECK(a, 0, LVAL_FUN, "iterate")
+	lval* f = lval_pop(a, 0);
+	lval* x = lval_take(a, 0);
+	return lval_seq(lseq_new(LSEQ_ITERATE, NULL, f, x));
+}
 
-		lval* y = lval_pop(a, 0);
+lval* builtin_lazy(lval* a, int kind, char* name) {
+	/* A sequence applying the function in the first argument to the
+	 * elements of the second */
+	CHECK_ARG_NUM(a, 2, name)
+	TYPE_CHECK(a, 0, LVAL_FUN, name)
+	SEQ_CHECK(a, 1, name)
+	lval* f = lval_pop(a, 0);
+	lseq* src = lseq_of(lval_take(a, 0));
+	return lval_seq(lseq_new(kind, src, f, NULL));
+}
 
-		/* Arithmetic ops */
-		if (strcmp(op, "+") == 0) { x->num += y->num; }
-		if (strcmp(op, "-") == 0) { x->num -= y->num; }
-		if (strcmp(op, "*") == 0) { x->num *= y->num; }
-		if (strcmp(op, "/") == 0) {
-			if (y->num == 0) {
-				lval_del(x); lval_del(y);
-				x = lval_err("Division By Zero!"); break;
-			}
-			x->num /= y->num;
-		}
-		if (strcmp(op, "%") == 0) {
-			/* Check there are no more elements */
-			if (a->count > 0) { return lval_err("Remainder operator takes only two arguments!"); }
-			x->num %= y->num;
-		}
+lval* builtin_lazy_map(lenv* e, lval* a) {
+	return builtin_lazy(a, LSEQ_MAP, "lazy-map");
+}
 
-		/* Comparison ops */
-		if (strcmp(op, ">") == 0) {
-			x->type = LVAL_BOOL;
-			x->boo = (x->num > y->num);
-		}
-		if (strcmp(op, "<") == 0) {
-			x->type = LVAL_BOOL;
-			x->boo = (x->num < y->num);
-		}
-		if (strcmp(op, ">=") == 0) {
-			x->type = LVAL_BOOL;
-			x->boo = (x->num >= y->num);
-		}
-		if (strcmp(op, "<=") == 0) {
-			x->type = LVAL_BOOL;
-			x->boo = (x->num <= y->num);
-		}
-		if (strcmp(op, "||") == 0) {
-			x->type = LVAL_BOOL;
-			x->boo = (x->num || y->num);
-		}
-		if (strcmp(op, "&&") == 0) {
-			x->type = LVAL_BOOL;
-			x->boo = (x->num && y->num);
-		}
-		lval_del(y);
-	}
-	lval_del(a); return x;
+lval* builtin_lazy_filter(lenv* e, lval* a) {
+	return builtin_lazy(a, LSEQ_FILTER, "lazy-filter");
+}
 
+lval* builtin_take_while(lenv* e, lval* a) {
+	return builtin_lazy(a, LSEQ_TAKE_WHILE, "take-while");
 }
 
+lval* builtin_lazy_take(lenv* e, lval* a) {
+	/* The first n elements of a sequence, or all of them if there are fewer */
+	CHECK_ARG_NUM(a, 2, "lazy-take")
+	TYPE_CHECK(a, 0, LVAL_NUM, "lazy-take")
+	SEQ_CHECK(a, 1, "lazy-take")
+	LASSERT(a, a->cell[0]->num >= 0, "Function lazy-take passed a negative count %li",
+			a->cell[0]->num)
+	long n = a->cell[0]->num;
+	lseq* s = lseq_new(LSEQ_TAKE, lseq_of(lval_pop(a, 1)), NULL, NULL);
+	s->end = n;
+	lval_del(a);
+	return lval_seq(s);
+}
 
-lval* builtin_op(lenv* e, lval* a, char* op) {
-	/* If decimal is present we convert everything to decimal type */
-	int is_dec = 0;
-	for (int i = 0; i < a->count; i++) {
-		if (a->cell[i]->type != LVAL_NUM) {
-			/* If boolean, convert to num for the purpose of the operation */
-			if (a->cell[i]->type == LVAL_BOOL) {
-				a->cell[i]->type = LVAL_NUM;
-				a->cell[i]->num = (long) a->cell[i]->boo;
-				continue;
-			}
-			/* If a decimal, make a note of this and continue */
-			if (a->cell[i]->type == LVAL_DEC) {
-				is_dec = 1;
-				continue;
-			}
-			return lval_err("Function %s passsed incorrect type for argument %i. "
-					"Got %s, expected %s or %s",
-					op, i, ltype_name(a->cell[i]->type),
-					ltype_name(LVAL_NUM), ltype_name(LVAL_DEC));
-			lval_del(a);
+lval* builtin_collect(lenv* e, lval* a) {
+	/* Every element of a sequence in a Q-Expression */
+	CHECK_ARG_NUM(a, 1, "collect")
+	SEQ_CHECK(a, 0, "collect")
+	if (a->cell[0]->type == LVAL_QEXPR) { return lval_take(a, 0); }
+
+	lseq_iter* it = lseq_start(a->cell[0]->seq);
+	lval* r = lval_qexpr();
+	lval* x;
+	while ((x = lseq_next(e, it))) {
+		if (x->type == LVAL_ERR) {
+			lval_del(r);
+			r = x;
+			break;
 		}
+		lval_add(r, x);
 	}
+	lseq_stop(it);
+	lval_del(a);
+	return r;
+}
 
-	/* If decimal exists convert everything and run dec_op */
-	if (is_dec) {
-		for (int i = 0; i < a->count; i++) {
-			if (a->cell[i]->type == LVAL_NUM) {
-				a->cell[i]->type = LVAL_DEC;
-				a->cell[i]->dec = (double) a->cell[i]->num;
-			}
+lval* builtin_fold(lenv* e, lval* a) {
+	/* Fold f over a sequence or Q-Expression from the left, starting from
+	 * z. Elements are made one at a time as they are needed, so folding
+	 * over the lines of a file holds no more of it than the current line */
+	CHECK_ARG_NUM(a, 3, "fold")
+	TYPE_CHECK(a, 0, LVAL_FUN, "fold")
+	SEQ_CHECK(a, 2, "fold")
+
+	lseq* s = lseq_of(lval_pop(a, 2));
+	lseq_iter* it = lseq_start(s);
+	lval* f = a->cell[0];
+	lval* acc = lval_pop(a, 1);
+	lval* x;
+	while (acc->type != LVAL_ERR && (x = lseq_next(e, it))) {
+		if (x->type == LVAL_ERR) {
+			lval_del(acc);
+			acc = x;
+			break;
 		}
-		return dec_op(a, op);
+		lval* g = lval_copy(f);
+		acc = lval_call(e, g, lval_add(lval_add(lval_sexpr(), acc), x));
+		lval_del(g);
 	}
+	lseq_stop(it);
+	lseq_release(s);
+	lval_del(a);
+	return acc;
+}
 
-	/* If no decimal then run num_op */
-	return num_op(a, op);
+lval* image_dump(lval*, char*);
+lval* image_undump(char*);
+
+lval* builtin_dump(lenv* e, lval* a) {
+	/* Write a value to a file, to be read back by undump */
+	CHECK_ARG_NUM(a, 2, "dump")
+	TYPE_CHECK(a, 0, LVAL_STR, "dump")
 
+	lval* x = image_dump(a->cell[1], a->cell[0]->str);
+	lval_del(a);
+	return x;
 }
 
-/* Builtin arithmetic operations */
-lval* builtin_add(lenv* e, lval* a) {
-	return builtin_op(e, a, "+");
+lval* builtin_undump(lenv* e, lval* a) {
+	/* Read back the value written to a file by dump */
+	CHECK_ARG_NUM(a, 1, "undump")
+	TYPE_CHECK(a, 0, LVAL_STR, "undump")
+
+	lval* x = image_undump(a->cell[0]->str);
+	lval_del(a);
+	return x;
 }
 
-lval* builtin_sub(lenv* e, lval*a) {
-	return builtin_op(e, a, "-");
+lval* builtin_print(lenv* e, lval* a) {
+	char buf[LOUT_SIZE];
+	lout o = lout_file(stdout, buf, sizeof(buf));
+	for (int i = 0; i < a->count; i++) {
+		lval_write(&o, a->cell[i]); lout_putc(&o, ' ');
+	}
+
+	/* Print a newline and delete arguments */
+	lout_putc(&o, '\n');
+	lout_flush(&o);
+	lval_del(a);
+	return lval_ok();
 }
 
-lval* builtin_mul(lenv* e, lval* a) {
-	return builtin_op(e, a, "*");
+lval* builtin_str(lenv* e, lval* a) {
+	/* Convert a value to the string it prints as */
+	CHECK_ARG_NUM(a, 1, "str")
+
+	lout o = lout_string();
+	lval_write(&o, a->cell[0]);
+	lval_del(a);
+	char* s = lout_take(&o);
+	lval* v = lval_str(s);
+	free(s);
+	return v;
 }
 
-lval* builtin_div(lenv* e, lval* a) {
-	return builtin_op(e, a, "/");
+lval* builtin_error(lenv* e, lval* a) {
+	CHECK_ARG_NUM(a, 1, "error")
+	TYPE_CHECK(a, 0, LVAL_STR, "error")
+
+	/* Construct Error from first argument */
+	lval* err = lval_err(a->cell[0]->str);
+
+	/* Delete arguments and return */
+	lval_del(a);
+	return err;
 }
 
-/* Builtin comparison operations */
-lval* builtin_gt(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 2, ">")
-	return builtin_op(e, a, ">");
+/* Every builtin with the symbol it is bound to and its C name */
+typedef struct {
+	char* name;
+	lbuiltin func;
+	char* cname;
+} lbuiltin_def;
+
+#define BUILTIN(name, func) { name, func, #func }
+
+lbuiltin_def builtins[] = {
+	/* List Functions */
+	BUILTIN("list", builtin_list),
+	BUILTIN("head", builtin_head),
+	BUILTIN("tail", builtin_tail),
+	BUILTIN("eval", builtin_eval),
+	BUILTIN("join", builtin_join),
+	BUILTIN("cons", builtin_cons),
+	BUILTIN("len", builtin_len),
+	BUILTIN("init", builtin_init),
+
+	/* Environment and parsing functions */
+	BUILTIN("list_env", builtin_list_env),
+	BUILTIN("exit", builtin_exit),
+	BUILTIN("\\", builtin_lambda),
+	BUILTIN("load", builtin_load),
+	BUILTIN("cache-stats", builtin_cache_stats),
+	BUILTIN("dump", builtin_dump),
+	BUILTIN("undump", builtin_undump),
+	BUILTIN("json-read", builtin_json_read),
+	BUILTIN("json-write", builtin_json_write),
+	BUILTIN("open", builtin_open),
+	BUILTIN("close", builtin_close),
+	BUILTIN("read-line", builtin_read_line),
+	BUILTIN("write", builtin_write),
+	BUILTIN("lines", builtin_lines),
+	BUILTIN("fold", builtin_fold),
+	BUILTIN("range", builtin_range),
+	BUILTIN("iterate", builtin_iterate),
+	BUILTIN("lazy-map", builtin_lazy_map),
+	BUILTIN("lazy-filter", builtin_lazy_filter),
+	BUILTIN("lazy-take", builtin_lazy_take),
+	BUILTIN("take-while", builtin_take_while),
+	BUILTIN("collect", builtin_collect),
+	BUILTIN("error", builtin_error),
+	BUILTIN("print", builtin_print),
+	BUILTIN("read", builtin_read),
+	BUILTIN("show", builtin_show),
+	BUILTIN("str", builtin_str),
+
+	BUILTIN("def", builtin_def),
+	BUILTIN("fun", builtin_fun),
+	BUILTIN("=", builtin_put),
+	BUILTIN("memo", builtin_memo),
+	BUILTIN("memo-stats", builtin_memo_stats),
+	BUILTIN("optimise", builtin_optimise),
+	BUILTIN("type-stats", builtin_type_stats),
+	BUILTIN("jit", builtin_jit),
+	BUILTIN("jit-stats", builtin_jit_stats),
+
+	/* Arithmetic and Comparison Funtions */
+	BUILTIN("+", builtin_add),
+	BUILTIN("-", builtin_sub),
+	BUILTIN("*", builtin_mul),
+	BUILTIN("/", builtin_div),
+	BUILTIN(">", builtin_gt),
+	BUILTIN("<", builtin_lt),
+	BUILTIN(">=", builtin_ge),
+	BUILTIN("<=", builtin_le),
+	BUILTIN("==", builtin_eq),
+	BUILTIN("!=", builtin_ne),
+	BUILTIN("if", builtin_if),
+	BUILTIN("||", builtin_or),
+	BUILTIN("&&", builtin_and),
+	BUILTIN("!", builtin_not),
+
+	/* Control Flow Functions */
+	BUILTIN("select", builtin_select),
+	BUILTIN("case", builtin_case),
+	BUILTIN("do", builtin_do),
+	BUILTIN("let", builtin_let),
+
+	/* Iteration Functions */
+	BUILTIN("loop", builtin_loop),
+	BUILTIN("recur", builtin_recur),
+	BUILTIN("while", builtin_while),
+	BUILTIN("for", builtin_for),
+
+	{ NULL, NULL, NULL }
+};
+
+void lwatch_init(void) {
+	/* Watch the names of the builtins and of the optimiser's constants */
+	for (lbuiltin_def* b = builtins; b->name; b++) { lwatch_add(b->name); }
+	for (int i = 0; i < sizeof(opt_constants) / sizeof(char*); i++) {
+		lwatch_add(opt_constants[i]);
+	}
 }
 
-lval* builtin_lt(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 2, "<")
-	return builtin_op(e, a, "<");
+void lenv_add_builtins(lenv* e) {
+	/* e is a global environment, where rebinding them is watched */
+	lwatch_init();
+	e->global = 1;
+	for (lbuiltin_def* b = builtins; b->name; b++) {
+		lenv_add_builtin(e, b->name, b->func);
+	}
 }
 
-lval* builtin_ge(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 2, ">=")
-	return builtin_op(e, a, ">=");
+long count_child(mpc_ast_t* t){
+	/* Function to compute number of child nodes */
+	if (t->children_num == 0){
+			return 1;
+	}
+
+	/* if not, then has multiple children, loop through them */
+	int count = 0;
+	int child_num = 0;
+	while(child_num < t->children_num){
+		count += count_child(t->children[child_num]);
+		child_num += 1;
+	}
+	return count;
 }
 
-lval* builtin_le(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 2, "<=")
-	return builtin_op(e, a, "<=");
+/* Ahead of time compiler, translating a program into C which includes this
+ * file for its runtime. Every top level form becomes C code evaluating it
+ * in the global environment, and every function defined with fun is
+ * compiled to a C body run in place of the interpreter whenever it is
+ * called with all of its arguments. Calls to builtins are made directly,
+ * except for any symbol bound anywhere in the program, which is always
+ * looked up as the interpreter would. if is compiled into a C branch, and
+ * everything else, such as eval or read, goes through the interpreter. */
+
+typedef struct {
+	FILE* out;
+	FILE* consts;
+	lval* kvals;
+	int nconst;
+	int ntemp;
+	int nfun;
+
+	/* Symbols bound anywhere in the program and by the current function */
+	lval* dynamic;
+	lval* shadow;
+} emitc;
+
+void emitc_string(FILE* f, char* s) {
+	/* Write s as a C string literal */
+	fputc('"', f);
+	for (unsigned char* c = (unsigned char*)s; *c; c++) {
+		if (*c >= ' ' && *c <= '~' && *c != '"' && *c != '\\' && *c != '?') {
+			fputc(*c, f);
+		} else {
+			fprintf(f, "\\%03o", *c);
+		}
+	}
+	fputc('"', f);
+}
+
+void emitc_build(emitc* c, lval* v, int depth) {
+	/* Write statements constructing v into variable d<depth> */
+	FILE* f = c->consts;
+	fprintf(f, "%*sd%i = ", depth + 1, "\t", depth);
+	switch (v->type) {
+		case LVAL_NUM:
+			if (v->num == LONG_MIN) { fprintf(f, "lval_num(LONG_MIN);\n"); }
+			else { fprintf(f, "lval_num(%liL);\n", v->num); }
+			break;
+		case LVAL_DEC:
+			if (isnan(v->dec)) { fprintf(f, "lval_dec(NAN);\n"); }
+			else if (isinf(v->dec)) { fprintf(f, "lval_dec(%sHUGE_VAL);\n", v->dec < 0 ? "-" : ""); }
+			else { fprintf(f, "lval_dec(%a);\n", v->dec); }
+			break;
+		case LVAL_BOOL: fprintf(f, "lval_bool(%i);\n", v->boo); break;
+		case LVAL_SYM:
+			fprintf(f, "lval_sym("); emitc_string(f, v->sym); fprintf(f, ");\n");
+			break;
+		case LVAL_STR:
+			fprintf(f, "lval_str("); emitc_string(f, v->str); fprintf(f, ");\n");
+			break;
+		case LVAL_SEXPR:
+		case LVAL_QEXPR:
+			fprintf(f, "%s();\n", v->type == LVAL_SEXPR ? "lval_sexpr" : "lval_qexpr");
+			if (v->count == 0) { break; }
+			fprintf(f, "%*s{ lval* d%i;\n", depth + 1, "\t", depth + 1);
+			for (int i = 0; i < v->count; i++) {
+				emitc_build(c, v->cell[i], depth + 1);
+				fprintf(f, "%*slval_add(d%i, d%i);\n", depth + 2, "\t", depth, depth + 1);
+			}
+			fprintf(f, "%*s}\n", depth + 1, "\t");
+			break;
+		default:
+			fprintf(f, "lval_err(\"Cannot compile %s\");\n", ltype_name(v->type));
+	}
 }
 
-lval* builtin_or(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 2, "||")
-	return builtin_op(e, a, "||");
+int emitc_const(emitc* c, lval* v) {
+	/* Add a constant built once at startup, returning its index in k.
+	 * Symbols are shared, everything else is only ever copied. */
+	if (v->type == LVAL_SYM) {
+		for (int i = 0; i < c->kvals->count; i++) {
+			lval* s = c->kvals->cell[i];
+			if (s->type == LVAL_SYM && strcmp(s->sym, v->sym) == 0) { return i; }
+		}
+	}
+	lval_add(c->kvals, lval_copy(v));
+	fprintf(c->consts, "\t{ lval* d0;\n");
+	emitc_build(c, v, 0);
+	fprintf(c->consts, "\tk[%i] = d0; }\n", c->nconst);
+	return c->nconst++;
 }
 
-lval* builtin_and(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 2, "&&")
-	return builtin_op(e, a, "&&");
+int emitc_member(lval* syms, lval* s) {
+	for (int i = 0; i < syms->count; i++) {
+		if (strcmp(syms->cell[i]->sym, s->sym) == 0) { return 1; }
+	}
+	return 0;
 }
 
-lval* builtin_not(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 1, "!")
-	return builtin_op(e, a, "!");
+lbuiltin_def* emitc_builtin(emitc* c, lval* s) {
+	/* Builtin s is always bound to, or NULL if it could be rebound */
+	if (s->type != LVAL_SYM) { return NULL; }
+	if (emitc_member(c->dynamic, s) || emitc_member(c->shadow, s)) { return NULL; }
+	for (lbuiltin_def* b = builtins; b->name; b++) {
+		if (strcmp(b->name, s->sym) == 0) { return b; }
+	}
+	return NULL;
 }
 
+int emitc_list(emitc* c, lval* l);
 
+int emitc_expr(emitc* c, lval* v) {
+	/* Write statements evaluating v in env, returning the temporary
+	 * holding the result */
+	if (v->type == LVAL_SEXPR) { return emitc_list(c, v); }
 
-lval* builtin_cmp(lenv* e, lval* a, char* op) {
-	CHECK_ARG_NUM(a, 2, op);
-	int r;
-	if (strcmp(op, "==") == 0) {
-		r = lval_eq(a->cell[0], a->cell[1]);
-	}
-	if (strcmp(op, "!=") == 0) {
-		r = !lval_eq(a->cell[0], a->cell[1]);
+	int t = c->ntemp++;
+	switch (v->type) {
+		case LVAL_NUM:
+			if (v->num == LONG_MIN) { fprintf(c->out, "\tlval* t%i = lval_num(LONG_MIN);\n", t); }
+			else { fprintf(c->out, "\tlval* t%i = lval_num(%liL);\n", t, v->num); }
+			break;
+		case LVAL_BOOL:
+			fprintf(c->out, "\tlval* t%i = lval_bool(%i);\n", t, v->boo);
+			break;
+		case LVAL_SYM:
+			fprintf(c->out, "\tlval* t%i = lenv_get(env, k[%i]);\n", t, emitc_const(c, v));
+			break;
+		default:
+			fprintf(c->out, "\tlval* t%i = lval_copy(k[%i]);\n", t, emitc_const(c, v));
 	}
-	lval_del(a);
-	return lval_bool(r);
+	return t;
 }
 
-lval* builtin_eq(lenv* e, lval* a) {
-	return builtin_cmp(e, a, "==");
+int emitc_branch(emitc* c, lval* q, int r) {
+	/* Write a block evaluating Q-Expression q into temporary r */
+	fprintf(c->out, "\t{\n");
+	lval* x = lval_copy(q);
+	x->type = LVAL_SEXPR;
+	fprintf(c->out, "\tt%i = t%i;\n\t}\n", r, emitc_list(c, x));
+	lval_del(x);
+	return r;
 }
 
-lval* builtin_ne(lenv* e, lval* a) {
-	return builtin_cmp(e, a, "!=");
-}
+int emitc_list(emitc* c, lval* l) {
+	/* Write statements evaluating l as an S-Expression */
+	lbuiltin_def* b = l->count ? emitc_builtin(c, l->cell[0]) : NULL;
+
+	/* if becomes a C branch on its condition */
+	if (b && b->func == builtin_if && l->count == 4
+			&& l->cell[2]->type == LVAL_QEXPR && l->cell[3]->type == LVAL_QEXPR) {
+		int cond = emitc_expr(c, l->cell[1]);
+		int r = c->ntemp++;
+		fprintf(c->out, "\tlval* t%i;\n", r);
+		fprintf(c->out, "\tif (t%i->type == LVAL_ERR) { t%i = t%i; }\n", cond, r, cond);
+		fprintf(c->out, "\telse if (lval_truth(t%i) == 1) {\n\tlval_del(t%i);\n", cond, cond);
+		emitc_branch(c, l->cell[2], r);
+		fprintf(c->out, "\t} else if (lval_truth(t%i) == 0) {\n\tlval_del(t%i);\n", cond, cond);
+		emitc_branch(c, l->cell[3], r);
+		fprintf(c->out, "\t} else {\n");
+		fprintf(c->out, "\tt%i = builtin_if(env, lval_add(lval_add(lval_add(lval_sexpr(), "
+				"t%i), lval_copy(k[%i])), lval_copy(k[%i])));\n\t}\n",
+				r, cond, emitc_const(c, l->cell[2]), emitc_const(c, l->cell[3]));
+		return r;
+	}
 
-lval* builtin_if(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 3, "if")
-	/* Convert first argument to boolean type if numerical */
-	if (a->cell[0]->type == LVAL_NUM) {
-		a->cell[0]->type = LVAL_BOOL;
-		if (a->cell[0]->num) {
-			a->cell[0]->boo = LVAL_TRUE;
-		} else {
-			a->cell[0]->boo = LVAL_FALSE;
-		}
-	} else if (a->cell[0]->type == LVAL_DEC) {
-		a->cell[0]->type = LVAL_BOOL;
-		if (a->cell[0]->dec) {
-			a->cell[0]->boo = LVAL_TRUE;
-		} else {
-			a->cell[0]->boo = LVAL_FALSE;
-		}
-	} else if (a->cell[0]->type != LVAL_BOOL) {
-		return lval_err("Function if pass incorrected type for argument 0"
-				"Got %s, Expected Number, Decimal or Bool",
-				ltype_name(a->cell[0]->type));
+	/* Evaluate the arguments, then call known builtins directly */
+	int a = c->ntemp++;
+	int first = (b && l->count > 1) ? 1 : 0;
+	fprintf(c->out, "\tlval* t%i = lval_sexpr();\n", a);
+	for (int i = first; i < l->count; i++) {
+		int x = emitc_expr(c, l->cell[i]);
+		fprintf(c->out, "\tlval_add(t%i, t%i);\n", a, x);
 	}
-	TYPE_CHECK(a, 1, LVAL_QEXPR, "if")
-	TYPE_CHECK(a, 2, LVAL_QEXPR, "if")
-	lval* v;
-	a->cell[1]->type = LVAL_SEXPR;
-	a->cell[2]->type = LVAL_SEXPR;
 
-	/* To evaluate expressions, add to sexpr and run eval */
-	if (a->cell[0]->boo) {
-		v = lval_eval(e, lval_pop(a, 1));
+	int r = c->ntemp++;
+	if (first) {
+		fprintf(c->out, "\tlval* t%i = lval_apply_builtin(env, %s, t%i);\n", r, b->cname, a);
 	} else {
-		v = lval_eval(e, lval_pop(a, 2));
+		fprintf(c->out, "\tlval* t%i = lval_apply(env, t%i);\n", r, a);
 	}
-	lval_del(a);
-	return v;
-}
-
-lval* builtin_qexpr_head(lenv* e, lval* a) {
-	TYPE_CHECK(a, 0, LVAL_QEXPR, "head")
-	CHECK_EMPTY(a, "head")
-
-	lval* v = lval_take(a, 0);
-	while (v->count > 1) { lval_del(lval_pop(v, 1)); }
-	return v;
+	return r;
 }
 
-lval* builtin_str_head(lenv* e, lval* a) {
-	TYPE_CHECK(a, 0, LVAL_STR, "head")
+int emitc_fun(emitc* c, lval* x) {
+	/* Compile (fun {name formals...} {body}), returning the function's
+	 * number or -1 if it must be left to the interpreter */
+	if (x->count != 3 || x->cell[1]->type != LVAL_QEXPR
+			|| x->cell[2]->type != LVAL_QEXPR || x->cell[1]->count == 0) { return -1; }
+	lbuiltin_def* b = emitc_builtin(c, x->cell[0]);
+	if (!b || b->func != builtin_fun) { return -1; }
 
-	lval* v = lval_take(a, 0);
-	v->str = realloc(v->str, 2);
-	v->str[1] = '\0';
-	return v;
-}
+	lval* syms = x->cell[1];
+	for (int i = 0; i < syms->count; i++) {
+		if (syms->cell[i]->type != LVAL_SYM) { return -1; }
+		if (strcmp(syms->cell[i]->sym, "&") == 0) { return -1; }
+	}
 
-lval* builtin_head(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 1, "head");
-	if (a->cell[0]->type == LVAL_QEXPR) {
-		return builtin_qexpr_head(e, a);
-	} else {
-		return builtin_str_head(e, a);
+	int n = c->nfun++;
+	c->shadow = lval_qexpr();
+	for (int i = 1; i < syms->count; i++) {
+		lval_add(c->shadow, lval_copy(syms->cell[i]));
 	}
-}
+	opt_shadowed(c->shadow, x->cell[2]);
+
+	fprintf(c->out, "/* %s */\n", syms->cell[0]->sym);
+	fprintf(c->out, "static lval* jdl_fun_%i(lenv* e, lval* a) {\n", n);
+	fprintf(c->out, "\tlenv* env = lenv_new();\n\tenv->par = e;\n");
+	for (int i = 1; i < syms->count; i++) {
+		fprintf(c->out, "\tlenv_put(env, k[%i], a->cell[%i]);\n",
+				emitc_const(c, syms->cell[i]), i-1);
+	}
+	fprintf(c->out, "\tlval_del(a);\n");
 
-lval* builtin_qexpr_tail(lenv* e, lval* a) {
-	TYPE_CHECK(a, 0, LVAL_QEXPR, "tail");
-	CHECK_EMPTY(a,	"tail");
+	lval* body = lval_copy(x->cell[2]);
+	body->type = LVAL_SEXPR;
+	int r = emitc_list(c, body);
+	lval_del(body);
 
-	lval* v = lval_take(a, 0);
-	lval_del(lval_pop(v, 0));
-	return v;
+	fprintf(c->out, "\tlenv_del(env);\n\treturn t%i;\n}\n\n", r);
+	lval_del(c->shadow);
+	c->shadow = lval_qexpr();
+	return n;
 }
 
-lval* builtin_str_tail(lenv* e, lval* a) {
-	TYPE_CHECK(a, 0, LVAL_STR, "tail");
-
-	lval* v = lval_take(a, 0);
-	char tail = v->str[strlen(v->str) - 1];
-	v->str = realloc(v->str, 2);
-	v->str[0] = tail;
-	v->str[1] = '\0';
-	return v;
+int emit_same_file(char* a, char* b) {
+	/* Whether paths a and b name the same file */
+	if (strcmp(a, b) == 0) { return 1; }
+#ifndef _WIN32
+	struct stat sa, sb;
+	if (stat(a, &sa) == 0 && stat(b, &sb) == 0) {
+		return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+	}
+#endif
+	return 0;
 }
 
-lval* builtin_tail(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 1, "tail");
-	if (a->cell[0]->type == LVAL_QEXPR) {
-		return builtin_qexpr_tail(e, a);
-	} else {
-		return builtin_str_tail(e, a);
+int emit_c(char* path, char** files, int nfiles) {
+	/* Translate the given files into a C program written to path */
+	size_t len = strlen(path);
+	if (len < 3 || strcmp(path + len - 2, ".c") != 0) {
+		printf("Output of --emit-c must be a .c file, got %s\n", path);
+		return 1;
+	}
+	for (int i = 0; i < nfiles; i++) {
+		if (emit_same_file(path, files[i])) {
+			printf("Output of --emit-c %s is also an input\n", path);
+			return 1;
+		}
 	}
-}
 
-lval* builtin_cons(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 2, "cons")
-	TYPE_CHECK(a, 1, LVAL_QEXPR, "cons");
+	lval* prog = lval_sexpr();
+	for (int i = 0; i < nfiles; i++) {
+		char* err;
+		lval* x = lval_read_file(files[i], &err);
+		if (!x) {
+			printf("%s", err);
+			free(err);
+			lval_del(prog);
+			return 1;
+		}
+		prog = lval_join(prog, x);
+	}
 
-	lval* v = lval_qexpr();
-	v = lval_add(v, a->cell[0]);
-	v = lval_join(v, a->cell[1]);
-	return v;
-}
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		printf("Could not open %s for writing\n", path);
+		lval_del(prog);
+		return 1;
+	}
 
-lval* builtin_len(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 1, "len")
-	TYPE_CHECK(a, 0, LVAL_QEXPR, "len");
+	emitc c;
+	c.out = tmpfile();
+	c.consts = tmpfile();
+	c.kvals = lval_qexpr();
+	c.nconst = 0;
+	c.ntemp = 0;
+	c.nfun = 0;
+	c.dynamic = lval_qexpr();
+	c.shadow = lval_qexpr();
+	opt_shadowed(c.dynamic, prog);
+
+	/* Compile functions first, recording which forms they came from */
+	int* funs = malloc(sizeof(int) * (prog->count + 1));
+	for (int i = 0; i < prog->count; i++) {
+		funs[i] = prog->cell[i]->type == LVAL_SEXPR ? emitc_fun(&c, prog->cell[i]) : -1;
+	}
 
-	return lval_num(a->cell[0]->count);
+	/* Then every top level form in order */
+	fprintf(c.out, "static void jdl_run(lenv* env) {\n");
+	for (int i = 0; i < prog->count; i++) {
+		lval* x = prog->cell[i];
+		fprintf(c.out, "\t{\n");
+		if (funs[i] != -1) {
+			/* Define the function as the interpreter would, with
+			 * the compiled body attached */
+			int formals = emitc_const(&c, x->cell[1]);
+			int body = emitc_const(&c, x->cell[2]);
+			fprintf(c.out, "\tlval* t = builtin_fun(env, lval_add(lval_add("
+					"lval_sexpr(), lval_copy(k[%i])), lval_copy(k[%i])));\n",
+					formals, body);
+			fprintf(c.out, "\tlval* f = lenv_get(env, k[%i]->cell[0]);\n", formals);
+			fprintf(c.out, "\tif (f->type == LVAL_FUN && f->jit) { f->jit->aot = jdl_fun_%i; }\n", funs[i]);
+			fprintf(c.out, "\tlval_del(f);\n");
+			fprintf(c.out, "\tif (t->type == LVAL_ERR) { lval_println(t); }\n\tlval_del(t);\n");
+		} else {
+			int r = emitc_expr(&c, x);
+			fprintf(c.out, "\tif (t%i->type == LVAL_ERR) { lval_println(t%i); }\n", r, r);
+			fprintf(c.out, "\tlval_del(t%i);\n", r);
+		}
+		fprintf(c.out, "\t}\n");
+	}
+	fprintf(c.out, "}\n\n");
+
+	/* Assemble the program */
+	fprintf(f, "/* Generated by jdlisp --emit-c from");
+	for (int i = 0; i < nfiles; i++) { fprintf(f, " %s", files[i]); }
+	fprintf(f, " */\n/* Build: cc -std=c99 -I<jdlisp> this.c <jdlisp>/mpc.c -ledit -lm */\n\n");
+	fprintf(f, "#define JDLISP_NO_MAIN\n#include \"src.c\"\n\n");
+	fprintf(f, "static lval* k[%i];\n\n", c.nconst + 1);
+	fprintf(f, "static void jdl_consts(void) {\n");
+	rewind(c.consts);
+	for (int ch; (ch = fgetc(c.consts)) != EOF; ) { fputc(ch, f); }
+	fprintf(f, "}\n\n");
+	rewind(c.out);
+	for (int ch; (ch = fgetc(c.out)) != EOF; ) { fputc(ch, f); }
+	fprintf(f, "int main(int argc, char** argv) {\n"
+			"\tlispy_init();\n"
+			"\tlenv* e = lenv_new();\n"
+			"\tlenv_add_builtins(e);\n"
+			"\tjdl_consts();\n"
+			"\tjdl_run(e);\n"
+			"\tfor (int i = 0; i < %i; i++) { lval_del(k[i]); }\n"
+			"\tlenv_del(e);\n"
+			"\tlispy_cleanup();\n"
+			"\treturn 0;\n}\n", c.nconst);
+
+	fclose(c.out);
+	fclose(c.consts);
+	fclose(f);
+	free(funs);
+	lval_del(c.kvals);
+	lval_del(c.dynamic);
+	lval_del(c.shadow);
+	lval_del(prog);
+	return 0;
 }
 
-lval* builtin_init(lenv* e, lval* a) {
-	/* returns all but the final element of a qexpr */
-	CHECK_ARG_NUM(a, 1, "init")
-	TYPE_CHECK(a, 0, LVAL_QEXPR, "init");
-
-	lval* v = lval_take(a, 0);
-	lval_del(lval_pop(v, v->count-1));
-	return v;
+/* Heap images. --save-image writes the global environment, once the
+ * standard library and any files given have been loaded, to a compact
+ * binary file, which --image maps back in at startup in place of reading
+ * and evaluating stlib.jdl. Values are written depth first, with counts
+ * and numbers as variable length integers. Each distinct string is written
+ * once and after that by its index among the strings before it. Builtins
+ * are written by their place in builtins along with their name, so an
+ * image outlives rebuilds of the interpreter as long as the builtins it
+ * uses remain. Lambdas keep their formals, body as written,
+ * partially applied arguments and memo capacity, but start out with an
+ * empty result cache and a cold JIT, and are optimised again once loaded. */
+
+#define IMAGE_MAGIC "JDLIMG"
+#define IMAGE_VERSION 2
+
+/* How writing a file went */
+enum { IMAGE_OK, IMAGE_UNKNOWN_BUILTIN, IMAGE_FILE, IMAGE_SEQ, IMAGE_WRITE_FAILED };
+
+/* How a function is written, with the specialisations of ty_specials */
+enum { IMAGE_LAMBDA, IMAGE_BUILTIN, IMAGE_BUILTIN_NUM, IMAGE_BUILTIN_DEC };
+
+typedef struct {
+	FILE* f;
+	int err;
+
+	/* Copies of the strings written so far, and an open addressed table
+	 * of their indices plus one, with zero marking a free slot */
+	char** strs;
+	int count;
+	int* slots;
+	int size;
+} image_writer;
+
+void image_put_uint(image_writer* w, unsigned long long x) {
+	/* Seven bits at a time, lowest first, the top bit marking more */
+	while (x >= 0x80) {
+		fputc((int)(x & 0x7f) | 0x80, w->f);
+		x >>= 7;
+	}
+	fputc((int)x, w->f);
 }
 
-lval* builtin_list(lenv* e, lval* a) {
-	a->type = LVAL_QEXPR;
-	return a;
-}
+void image_put_str(image_writer* w, char* s) {
+	size_t len = strlen(s);
+	int mask = w->size - 1;
+	int i = lval_hash_bytes(14695981039346656037UL, s, len) & mask;
+	for (; w->slots[i]; i = (i + 1) & mask) {
+		if (strcmp(w->strs[w->slots[i] - 1], s) == 0) {
+			image_put_uint(w, w->slots[i]);
+			return;
+		}
+	}
 
-lval* builtin_read(lenv* e, lval* a) {
-	TYPE_CHECK(a, 0, LVAL_STR, "read")
-	CHECK_ARG_NUM(a, 1, "read")
+	/* First time around, so write it out in full */
+	image_put_uint(w, 0);
+	image_put_uint(w, len);
+	fwrite(s, 1, len, w->f);
+	w->strs[w->count] = malloc(len + 1);
+	memcpy(w->strs[w->count++], s, len + 1);
+	w->slots[i] = w->count;
+
+	/* Keep the table at most half full */
+	if (w->count * 2 > w->size) {
+		free(w->slots);
+		w->size *= 2;
+		w->slots = calloc(w->size, sizeof(int));
+		w->strs = realloc(w->strs, sizeof(char*) * w->size);
+		mask = w->size - 1;
+		for (int n = 0; n < w->count; n++) {
+			int j = lval_hash_bytes(14695981039346656037UL, w->strs[n], strlen(w->strs[n])) & mask;
+			while (w->slots[j]) { j = (j + 1) & mask; }
+			w->slots[j] = n + 1;
+		}
+	}
+}
 
-	mpc_result_t r;
-	/* Parse input through mpc */
-	if (mpc_parse("<stdin>", a->cell[0]->str, Lispy, &r)) {
+void image_put_env(image_writer* w, lenv* e);
 
-		lval* expr = lval_read(r.output);
-		expr->type = LVAL_QEXPR;
+void image_put_lval(image_writer* w, lval* v) {
+	fputc(v->type, w->f);
+	switch (v->type) {
+		case LVAL_NUM:
+			/* Zigzag encoded so that small negative numbers stay small */
+			image_put_uint(w, ((unsigned long long)v->num << 1) ^ (v->num < 0 ? ~0ULL : 0));
+			break;
+		case LVAL_DEC: {
+			/* Eight bytes, lowest first */
+			unsigned long long bits;
+			memcpy(&bits, &v->dec, sizeof(double));
+			for (int i = 0; i < 8; i++) { fputc((int)(bits >> (8 * i)) & 0xff, w->f); }
+			break;
+		}
+		case LVAL_BOOL: fputc(v->boo, w->f); break;
+		case LVAL_OK: break;
+		case LVAL_ERR: image_put_str(w, v->err); break;
+		case LVAL_SYM: image_put_str(w, v->sym); break;
+		case LVAL_STR:
+		case LVAL_USTR: image_put_str(w, v->str); break;
 
-		/* Delete expressions and arguments */
-		mpc_ast_delete(r.output);
-		lval_del(a);
+		case LVAL_FUN:
+			if (v->builtin) {
+				/* Find the entry in builtins the function stands for */
+				lbuiltin generic = ty_unspecialise(v->builtin);
+				lbuiltin_def* b = builtins;
+				while (b->name && b->func != generic) { b++; }
+				if (!b->name) { w->err = IMAGE_UNKNOWN_BUILTIN; return; }
+				ty_special* s = ty_find(v->builtin);
+				image_put_uint(w,
+					s && v->builtin == s->num ? IMAGE_BUILTIN_NUM :
+					s && v->builtin == s->dec ? IMAGE_BUILTIN_DEC : IMAGE_BUILTIN);
+				image_put_uint(w, b - builtins);
+				image_put_str(w, b->name);
+			} else {
+				image_put_uint(w, IMAGE_LAMBDA);
+				image_put_uint(w, v->memo ? v->memo->capacity : 0);
+				image_put_env(w, v->env);
+				image_put_lval(w, v->formals);
+				image_put_lval(w, v->jit && v->jit->source ? v->jit->source : v->body);
+			}
+			break;
 
-		return expr;
-	} else {
-		/* Create error message using parse error */
-		char* err_msg = mpc_err_string(r.error);
-		mpc_err_delete(r.error);
-		lval* err = lval_err("Could not read: %s", err_msg);
+		case LVAL_SEXPR:
+		case LVAL_QEXPR:
+		case LVAL_RECUR:
+			image_put_uint(w, v->count);
+			for (int i = 0; i < v->count; i++) { image_put_lval(w, v->cell[i]); }
+			break;
 
-		free(err_msg);
-		lval_del(a);
-		return err;
+		/* An open file cannot be written down */
+		case LVAL_FILE: w->err = IMAGE_FILE; return;
+		case LVAL_SEQ: w->err = IMAGE_SEQ; return;
 	}
 }
 
-lval* builtin_show(lenv* e, lval* a) {
-	/* Prints string in unescaped form */
-	TYPE_CHECK(a, 0, LVAL_STR, "show")
-	CHECK_ARG_NUM(a, 1, "show")
+void image_put_env(image_writer* w, lenv* e) {
+	image_put_uint(w, e->count);
+	for (int i = 0; i < e->count; i++) {
+		image_put_str(w, e->syms[i]);
+		image_put_lval(w, e->vals[i]);
+	}
+}
 
-	lval* v = lval_take(a, 0);
-	v->type = LVAL_USTR;
+int image_open(image_writer* w, char* path, char* magic) {
+	/* Start writing a file at path, returning 0 if it cannot be created */
+	w->f = fopen(path, "wb");
+	if (!w->f) { return 0; }
+	w->err = IMAGE_OK;
+	w->count = 0;
+	w->size = 64;
+	w->strs = malloc(sizeof(char*) * w->size);
+	w->slots = calloc(w->size, sizeof(int));
+	fwrite(magic, 1, strlen(magic), w->f);
+	image_put_uint(w, IMAGE_VERSION);
+	return 1;
+}
 
-	lval_print(v);
-	putchar('\n');
+int image_close(image_writer* w, char* path) {
+	/* Finish writing, removing the file again if that failed */
+	for (int i = 0; i < w->count; i++) { free(w->strs[i]); }
+	free(w->strs);
+	free(w->slots);
+	if (ferror(w->f)) { w->err = IMAGE_WRITE_FAILED; }
+	if (fclose(w->f) != 0) { w->err = IMAGE_WRITE_FAILED; }
+	if (w->err) { remove(path); }
+	return w->err;
+}
 
-	lval_del(v);
+lval* image_save(lenv* e, char* path) {
+	/* Write the global environment e to an image at path */
+	image_writer w;
+	if (!image_open(&w, path, IMAGE_MAGIC)) {
+		return lval_err("Could not open image %s for writing", path);
+	}
+	image_put_env(&w, e);
+	switch (image_close(&w, path)) {
+		case IMAGE_UNKNOWN_BUILTIN:
+			return lval_err("Could not save image %s, it holds an unknown builtin", path);
+		case IMAGE_FILE:
+			return lval_err("Could not save image %s, it holds a file", path);
+		case IMAGE_SEQ:
+			return lval_err("Could not save image %s, it holds a sequence", path);
+		case IMAGE_WRITE_FAILED:
+			return lval_err("Could not write image %s", path);
+	}
 	return lval_ok();
 }
 
-lval* builtin_lambda(lenv* e, lval* a) {
-	/* Create lambda function */
-	CHECK_ARG_NUM(a, 2, "\\")
-	TYPE_CHECK(a, 0, LVAL_QEXPR, "\\")
-	TYPE_CHECK(a, 1, LVAL_QEXPR, "\\")
+typedef struct {
+	const unsigned char* p;
+	const unsigned char* end;
+	int err;
+
+	/* Strings read so far, pointing into the image */
+	const unsigned char** strs;
+	size_t* lens;
+	int count;
+	int size;
+} image_reader;
+
+unsigned long long image_get_uint(image_reader* r) {
+	unsigned long long x = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (r->p == r->end) { break; }
+		unsigned char b = *r->p++;
+		x |= (unsigned long long)(b & 0x7f) << shift;
+		if (!(b & 0x80)) { return x; }
+	}
+	r->err = 1;
+	return 0;
+}
 
-	/* Check first Q-expression contains only Symbols */
-	for (int i = 0; i < a->cell[0]->count; i++) {
-		LASSERT(a, (a->cell[0]->cell[i]->type == LVAL_SYM),
-				"Cannot define non-symbol. Got %s, Expected %s.",
-				ltype_name(a->cell[0]->cell[i]->type), ltype_name(LVAL_SYM));
+char* image_get_str(image_reader* r) {
+	/* Read a string, returning a copy of it */
+	unsigned long long i = image_get_uint(r);
+	const unsigned char* s;
+	size_t len;
+	if (i == 0) {
+		len = image_get_uint(r);
+		if (r->err || len > (size_t)(r->end - r->p)) { r->err = 1; return NULL; }
+		s = r->p;
+		r->p += len;
+		if (r->count == r->size) {
+			r->size *= 2;
+			r->strs = realloc(r->strs, sizeof(char*) * r->size);
+			r->lens = realloc(r->lens, sizeof(size_t) * r->size);
+		}
+		r->strs[r->count] = s;
+		r->lens[r->count++] = len;
+	} else if (i <= (unsigned long long)r->count) {
+		s = r->strs[i - 1];
+		len = r->lens[i - 1];
+	} else {
+		r->err = 1;
+		return NULL;
 	}
+	char* x = malloc(len + 1);
+	memcpy(x, s, len);
+	x[len] = '\0';
+	return x;
+}
 
-	/* Pop first two arguments and pass them to lval_lambda */
-	lval* formals = lval_pop(a, 0);
-	lval* body = lval_pop(a, 0);
-	lval_del(a);
+lenv* image_get_env(image_reader* r, lenv* e);
 
-	return lval_lambda(formals, body);
-}
+lval* image_get_lval(image_reader* r) {
+	/* Read a value, or return NULL and set err if the image is broken */
+	if (r->p == r->end) { r->err = 1; return NULL; }
+	lval* v = malloc(sizeof(lval));
+	v->type = *r->p++;
+	switch (v->type) {
+		case LVAL_NUM: {
+			unsigned long long x = image_get_uint(r);
+			v->num = (long)(x >> 1) ^ -(long)(x & 1);
+			break;
+		}
+		case LVAL_DEC: {
+			if (r->end - r->p < 8) { r->err = 1; break; }
+			unsigned long long bits = 0;
+			for (int i = 0; i < 8; i++) { bits |= (unsigned long long)*r->p++ << (8 * i); }
+			memcpy(&v->dec, &bits, sizeof(double));
+			break;
+		}
+		case LVAL_BOOL:
+			if (r->p == r->end) { r->err = 1; break; }
+			v->boo = *r->p++;
+			break;
+		case LVAL_OK: break;
+		case LVAL_ERR: v->err = image_get_str(r); break;
+		case LVAL_SYM: v->sym = image_get_str(r); break;
+		case LVAL_STR:
+		case LVAL_USTR: v->str = image_get_str(r); break;
+
+		case LVAL_FUN: {
+			int kind = image_get_uint(r);
+			v->memo = NULL;
+			v->jit = NULL;
+			if (r->err) { break; }
+			if (kind == IMAGE_LAMBDA) {
+				unsigned long long capacity = image_get_uint(r);
+				if (r->err || capacity > MEMO_MAX_CAPACITY) { r->err = 1; break; }
+				v->builtin = NULL;
+				v->env = image_get_env(r, lenv_new());
+				v->formals = v->env ? image_get_lval(r) : NULL;
+				v->body = v->formals ? image_get_lval(r) : NULL;
+				if (!v->body) {
+					if (v->formals) { lval_del(v->formals); }
+					if (v->env) { lenv_del(v->env); }
+					free(v);
+					return NULL;
+				}
+				if (capacity) { v->memo = lmemo_new(capacity); }
+				v->jit = ljit_new();
+				break;
+			}
 
-lval* builtin_var(lenv* e, lval* a, char* func) {
-	/* Assign symbols to values */
-	TYPE_CHECK(a, 0, LVAL_QEXPR, func);
+			/* Builtins are found by their index in builtins, checking the
+			 * name there and looking it up if the table has changed */
+			unsigned long long index = image_get_uint(r);
+			char* name = image_get_str(r);
+			if (!name) { break; }
+			lbuiltin_def* b = builtins;
+			if (index < sizeof(builtins) / sizeof(lbuiltin_def) - 1
+				&& strcmp(builtins[index].name, name) == 0) {
+				b += index;
+			} else {
+				while (b->name && strcmp(b->name, name) != 0) { b++; }
+			}
+			ty_special* s = b->name ? ty_find(b->func) : NULL;
+			if (!b->name || kind > IMAGE_BUILTIN_DEC || (kind != IMAGE_BUILTIN && !s)) {
+				free(name);
+				r->err = 1;
+				break;
+			}
+			v->builtin = kind == IMAGE_BUILTIN_NUM ? s->num
+				: kind == IMAGE_BUILTIN_DEC ? s->dec : b->func;
+			v->fun_name = name;
+			break;
+		}
 
-	lval* syms = a->cell[0];
+		case LVAL_SEXPR:
+		case LVAL_QEXPR:
+		case LVAL_RECUR: {
+			/* Every value takes at least a byte, which bounds the count */
+			unsigned long long count = image_get_uint(r);
+			if (r->err || count > (unsigned long long)(r->end - r->p)) {
+				r->err = 1;
+				v->count = 0;
+				v->cell = NULL;
+				break;
+			}
+			v->count = 0;
+			v->cell = malloc(sizeof(lval*) * count);
+			while (v->count < (int)count) {
+				lval* x = image_get_lval(r);
+				if (!x) { lval_del(v); return NULL; }
+				v->cell[v->count++] = x;
+			}
+			return v;
+		}
 
-	/* Ensure all elements of first list are symbols */
-	for (int i = 0; i < syms->count; i++) {
-		LASSERT(a, syms->cell[i]->type == LVAL_SYM,
-				"Function '%s' cannot define non-symbol"
-				"Got %s, Expected %s. ",
-				func, ltype_name(syms->cell[i]->type),
-			       	ltype_name(LVAL_SYM));
+		default:
+			r->err = 1;
+			free(v);
+			return NULL;
 	}
 
-	/* Check correct number of symbols and values */
-	LASSERT(a, syms->count == a->count-1,
-			"Function '%s' passed too many arguments for symbols "
-			"Got %i symbols and %i values",
-			func, syms->count, a->count-1);
+	if (r->err) {
+		/* Nothing was allocated that is still owned by v */
+		free(v);
+		return NULL;
+	}
+	return v;
+}
 
-	/* Assign copies of values to symbols */
-	for (int i = 0; i < syms->count; i++) {
-		/* If 'def' define in globally. If 'put' define in locally */
-		if (strcmp(func, "def") == 0) {
-			lenv_def(e, syms->cell[i], a->cell[i+1]);
+lenv* image_get_env(image_reader* r, lenv* e) {
+	/* Read bindings into e, which is deleted if the image is broken */
+	unsigned long long count = image_get_uint(r);
+	if (r->err || count > (unsigned long long)(r->end - r->p)) {
+		r->err = 1;
+		lenv_del(e);
+		return NULL;
+	}
+	e->syms = realloc(e->syms, sizeof(char*) * (e->count + count));
+	e->vals = realloc(e->vals, sizeof(lval*) * (e->count + count));
+	for (unsigned long long i = 0; i < count; i++) {
+		char* sym = image_get_str(r);
+		lval* x = sym ? image_get_lval(r) : NULL;
+		if (!x) {
+			free(sym);
+			lenv_del(e);
+			return NULL;
 		}
-
-		if (strcmp(func, "=") == 0) {
-			lenv_put(e, syms->cell[i], a->cell[i+1]);
+		if (!e->global && lwatch_has(sym)) {
+			e->shadows++;
+			lenv_shadows++;
 		}
+		e->syms[e->count] = sym;
+		e->vals[e->count++] = x;
 	}
-
-	lval_del(a);
-	return lval_sexpr();
+	return e;
 }
 
-lval* builtin_def(lenv* e, lval* a) {
-	return builtin_var(e, a, "def");
+void* image_map(char* path, size_t* len, int* mapped) {
+	/* Map the file at path into memory, or read it where that fails,
+	 * returning NULL if it cannot be read at all */
+	FILE* f = fopen(path, "rb");
+	if (!f) { return NULL; }
+	struct stat st;
+	if (fstat(fileno(f), &st) != 0) {
+		fclose(f);
+		return NULL;
+	}
+	*len = st.st_size;
+	*mapped = 0;
+	void* data = NULL;
+#ifndef _WIN32
+	if (*len > 0) {
+		data = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+		if (data == MAP_FAILED) { data = NULL; } else { *mapped = 1; }
+	}
+#endif
+	if (!*mapped) {
+		data = malloc(*len + 1);
+		if (fread(data, 1, *len, f) != *len) {
+			free(data);
+			data = NULL;
+		}
+	}
+	fclose(f);
+	return data;
 }
 
-lval* builtin_fun(lenv* e, lval* a) {
-	lval* fun_name = lval_add(lval_qexpr(), lval_pop(a->cell[0], 0));
-	lval* fun = builtin_lambda(e, a);
+void image_unmap(void* data, size_t len, int mapped) {
+#ifndef _WIN32
+	if (mapped) { munmap(data, len); return; }
+#endif
+	free(data);
+}
 
-	lval* sexpr = lval_add(lval_sexpr(), fun_name);
-	sexpr = lval_add(sexpr, fun);
-	return builtin_def(e, sexpr);
+long image_start(image_reader* r, void* data, size_t len, char* magic) {
+	/* Start reading data, returning the version it was written with, or
+	 * -1 if it was not written as magic */
+	r->p = data;
+	r->end = r->p + len;
+	r->err = 0;
+	r->count = 0;
+	r->size = 64;
+	r->strs = malloc(sizeof(char*) * r->size);
+	r->lens = malloc(sizeof(size_t) * r->size);
+
+	size_t n = strlen(magic);
+	if (len < n || memcmp(r->p, magic, n) != 0) { return -1; }
+	r->p += n;
+	unsigned long long version = image_get_uint(r);
+	return r->err || version > LONG_MAX ? -1 : (long)version;
 }
 
-lval* builtin_put(lenv* e, lval* a) {
-	return builtin_var(e, a, "=");
+void image_end(image_reader* r) {
+	free(r->strs);
+	free(r->lens);
 }
 
-lval* builtin_eval(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 1, "eval")
-	TYPE_CHECK(a, 0, LVAL_QEXPR, "eval")
+lval* image_load(lenv* e, char* path) {
+	/* Read an image at path into the empty global environment e */
+	size_t len;
+	int mapped;
+	void* data = image_map(path, &len, &mapped);
+	if (!data) { return lval_err("Could not read image %s", path); }
+
+	image_reader r;
+	long version = image_start(&r, data, len, IMAGE_MAGIC);
+	lval* result;
+	if (version < 0) {
+		result = lval_err("%s is not an image", path);
+	} else if (version != IMAGE_VERSION) {
+		result = lval_err("Image %s is version %li, expected %i",
+			path, version, IMAGE_VERSION);
+	} else {
+		/* Read the globals into a scratch environment, moving them into e
+		 * only once the whole image was read */
+		lwatch_init();
+		lenv* g = lenv_new();
+		g->global = 1;
+		g = image_get_env(&r, g);
+		if (!g || r.p != r.end) {
+			if (g) { lenv_del(g); }
+			result = lval_err("Image %s is corrupt", path);
+		} else {
+			free(e->syms);
+			free(e->vals);
+			e->count = g->count;
+			e->syms = g->syms;
+			e->vals = g->vals;
+			e->global = 1;
+			free(g);
+
+			/* Images hold bodies as written, so optimise those of the
+			 * functions defined against this environment */
+			for (int i = 0; i < e->count; i++) {
+				lval* f = e->vals[i];
+				if (f->type == LVAL_FUN && !f->builtin && f->env->count == 0) {
+					opt_lambda(e, f);
+				}
+			}
+			result = lval_ok();
+		}
+	}
 
-	lval* x = lval_take(a, 0);
-	x->type = LVAL_SEXPR;
-	return lval_eval(e, x);
+	image_end(&r);
+	image_unmap(data, len, mapped);
+	return result;
 }
 
+/* dump writes a single value to a file in the same encoding as images,
+ * under its own magic, and undump reads it back. Decimals keep every bit,
+ * and strings and symbols repeated through the value are written once. */
 
-lval* builtin_qexpr_join(lenv* e, lval* a) {
-	for (int i = 0; i < a->count; i++) {
-		TYPE_CHECK(a, i, LVAL_QEXPR, "qexpr join");
+#define DUMP_MAGIC "JDLDUMP"
+
+lval* image_dump(lval* v, char* path) {
+	image_writer w;
+	if (!image_open(&w, path, DUMP_MAGIC)) {
+		return lval_err("Could not open %s for writing", path);
 	}
-	lval* x = lval_pop(a, 0);
+	image_put_lval(&w, v);
+	switch (image_close(&w, path)) {
+		case IMAGE_UNKNOWN_BUILTIN:
+			return lval_err("Could not dump to %s, the value holds an unknown builtin", path);
+		case IMAGE_FILE:
+			return lval_err("Could not dump to %s, the value holds a file", path);
+		case IMAGE_SEQ:
+			return lval_err("Could not dump to %s, the value holds a sequence", path);
+		case IMAGE_WRITE_FAILED:
+			return lval_err("Could not write %s", path);
+	}
+	return lval_ok();
+}
 
-	while (a->count) {
-		x = lval_join(x, lval_pop(a, 0));
+lval* image_undump(char* path) {
+	size_t len;
+	int mapped;
+	void* data = image_map(path, &len, &mapped);
+	if (!data) { return lval_err("Could not read %s", path); }
+
+	image_reader r;
+	long version = image_start(&r, data, len, DUMP_MAGIC);
+	lval* result;
+	if (version < 0) {
+		result = lval_err("%s was not written by dump", path);
+	} else if (version != IMAGE_VERSION) {
+		result = lval_err("Dump %s is version %li, expected %i",
+			path, version, IMAGE_VERSION);
+	} else {
+		result = image_get_lval(&r);
+		if (result && r.p != r.end) {
+			lval_del(result);
+			result = NULL;
+		}
+		if (!result) { result = lval_err("Dump %s is corrupt", path); }
 	}
 
-	lval_del(a);
-	return x;
+	image_end(&r);
+	image_unmap(data, len, mapped);
+	return result;
 }
 
-lval* builtin_str_join(lenv* e, lval* a) {
-	for (int i = 0; i< a->count; i++) {
-		TYPE_CHECK(a, i, LVAL_STR, "string join")
+/* Cache of the expressions read from files by load, turned on by --cache.
+ * What each file reads as is written to the cache directory in the same
+ * encoding as images, named by a hash of the reader's version and the
+ * file's contents, so loading those contents again decodes the expressions
+ * without any parsing. Each cache also holds a copy of the source it was
+ * read from, which has to match byte for byte, and ends in a checksum of
+ * all before it, checked before any expression is used, so a cache that
+ * does not match is never more than a miss. Only files which can be read
+ * more than once are cached, as the source is hashed before it is read,
+ * and others such as pipes are streamed as without a cache. The file is
+ * written under a temporary name, unique to the process and load, and
+ * renamed into place, so jobs sharing a cache never see one half
+ * written. */
+
+#define CACHE_MAGIC "JDLFORMS"
+
+/* Bumped whenever the same source reads as different expressions, as when
+ * decimals went from strtof to correctly rounded doubles */
+#define CACHE_VERSION 2
+
+unsigned long long lcache_hash_bytes(unsigned long long h, const void* p, size_t n) {
+	/* Hash of n bytes continuing from h, taken eight at a time so it keeps
+	 * up with reading from the cache. Input split over several calls
+	 * hashes the same as long as every part but the last is a multiple of
+	 * eight bytes long */
+	const unsigned char* b = p;
+	for (; n >= 8; b += 8, n -= 8) {
+		unsigned long long x;
+		memcpy(&x, b, 8);
+		h = (h ^ x) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
 	}
-	lval* x = lval_pop(a, 0);
-
-	while (a->count) {
-		x = lval_str_join(x, lval_pop(a, 0));
+	for (; n > 0; b++, n--) {
+		h = (h ^ *b) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
 	}
+	return h;
+}
 
-	lval_del(a);
-	return x;
+unsigned long long lcache_key(void) {
+	/* Start of the hash of a source, keyed by the versions of the reader
+	 * and of the encoding */
+	char prefix[64];
+	sprintf(prefix, "%s %i %i\n", CACHE_MAGIC, IMAGE_VERSION, CACHE_VERSION);
+	return lcache_hash_bytes(14695981039346656037ULL, prefix, strlen(prefix));
 }
 
+char* lcache_name(unsigned long long hash, size_t n) {
+	/* Name of the cache of a source of n bytes hashed to hash */
+	char* path = malloc(strlen(cache_dir) + 64);
+	sprintf(path, "%s/%016llx%08lx.jdlc", cache_dir, hash, (unsigned long)(n & 0xffffffff));
+	return path;
+}
 
-lval* builtin_join(lenv* e, lval* a) {
-	if (a->cell[0]->type == LVAL_QEXPR){
-		return builtin_qexpr_join(e, a);
-	} else {
-		return builtin_str_join(e, a);
-	}
+char* lcache_path(char* input, size_t n) {
+	/* Name of the cache of input, n bytes long */
+	return lcache_name(lcache_hash_bytes(lcache_key(), input, n), n);
 }
 
-lval* builtin_list_env(lenv* e, lval* a) {
-	TYPE_CHECK(a, 0, LVAL_SEXPR, "list_env")
-	CHECK_ARG_NUM(a, 1, "list_env")
-	LASSERT(a, a->cell[0]->count == 0, "list_env expects empty sexpr as argument, "
-			"received sexpr with %i arguments", a->cell[0]->count)
+struct lcache {
+	int hit;
+	clock_t start;
+	char* filename;
+	char* path;
+
+	/* Expressions decoded from the cache when it was hit */
+	void* data;
+	size_t len;
+	int mapped;
+	image_reader r;
+
+	/* Otherwise read from the source, streamed or all at once by mpc,
+	 * and written out to a temporary file until all have been read */
+	lstream* s;
+	lval* forms;
+	char* err;
+	char* tmp;
+	image_writer w;
+	int writing;
+	int done;
+};
 
+/* Byte ending the expressions in a cache, after which it is complete */
+#define CACHE_END 0xff
 
-	lval_del(a);
+/* Bytes of the checksum after it */
+#define CACHE_CHECK 8
 
-	lval* v = lval_qexpr();
-	/* Iterate over all items in environment */
-	for (int i = 0; i < e->count; i++) {
-		v = lval_add(v, lval_sym(e->syms[i]));
-   	}
-	return v;
+int lcache_check(unsigned char* data, size_t len) {
+	/* Whether a cache of len bytes is complete and its checksum matches */
+	if (len < CACHE_CHECK + 1 || data[len - CACHE_CHECK - 1] != CACHE_END) { return 0; }
+	unsigned long long h = lcache_hash_bytes(lcache_key(), data, len - CACHE_CHECK);
+	for (int i = 0; i < CACHE_CHECK; i++) {
+		if (data[len - CACHE_CHECK + i] != (unsigned char)(h >> (8 * i))) { return 0; }
+	}
+	return 1;
 }
 
-lval* builtin_exit(lenv* e, lval* a) {
-	TYPE_CHECK(a, 0, LVAL_SEXPR, "exit")
-	CHECK_ARG_NUM(a, 1, "exit")
-	LASSERT(a, a->cell[0]->count == 0, "exit expects empty sexpr as argument, "
-			"received sexpr with %i arguments", a->cell[0]->count)
-	e->quit = 1;
-	lval_del(a);
-	return lval_sym("Exiting Prompt");
+int lcache_seal(lcache* c) {
+	/* End the cache being written, then checksum it as written so far */
+	fputc(CACHE_END, c->w.f);
+	if (fflush(c->w.f) != 0) { return 0; }
+	FILE* f = fopen(c->tmp, "rb");
+	if (!f) { return 0; }
+	char* buf = malloc(LSTREAM_CHUNK);
+	unsigned long long h = lcache_key();
+	size_t n;
+	while ((n = fread(buf, 1, LSTREAM_CHUNK, f))) { h = lcache_hash_bytes(h, buf, n); }
+	int ok = !ferror(f);
+	fclose(f);
+	free(buf);
+	for (int i = 0; i < CACHE_CHECK; i++) { fputc((int)(h >> (8 * i)) & 0xff, c->w.f); }
+	return ok;
 }
 
-/* Defined all builtins, now load them into environment */
-void lenv_add_builtin(lenv* e, char* name, lbuiltin func) {
-	lval* k = lval_sym(name);
-	lval* v = lval_fun(func, name);
-	lenv_put(e, k, v);
-	lval_del(k); lval_del(v);
+/* What lcache_source does with each part of a source read through */
+enum { CACHE_HASH, CACHE_SAME, CACHE_COPY };
+
+int lcache_source(lstream* s, int op, void* arg, size_t* n) {
+	/* Hash the source of s into arg, compare it to the bytes at arg or
+	 * copy it to the file arg, in place if mapped and otherwise read
+	 * through once and rewound. Returns 0 if it cannot be read again, or
+	 * differs from arg when comparing */
+	char* buf = s->buf;
+	size_t k = s->len;
+	size_t at = 0;
+	if (!s->mapped) {
+		struct stat st;
+		if (fstat(fileno(s->f), &st) != 0 || !S_ISREG(st.st_mode)) { return 0; }
+		k = fread(buf, 1, s->size, s->f);
+	}
+	for (; k > 0; at += k, k = s->mapped ? 0 : fread(buf, 1, s->size, s->f)) {
+		if (op == CACHE_HASH) {
+			*(unsigned long long*)arg = lcache_hash_bytes(*(unsigned long long*)arg, buf, k);
+		} else if (op == CACHE_SAME) {
+			if (at + k > *n || memcmp((char*)arg + at, buf, k) != 0) { at = *n + 1; break; }
+		} else if (fwrite(buf, 1, k, arg) != k) {
+			return 0;
+		}
+	}
+	if (op == CACHE_HASH) { *n = at; }
+	if (s->mapped) { return op != CACHE_SAME || at == *n; }
+	s->buf[0] = '\0';
+	return !ferror(s->f) && fseek(s->f, 0, SEEK_SET) == 0 && (op != CACHE_SAME || at == *n);
 }
 
-lval* builtin_load(lenv* e, lval* a) {
-	/* Run contents of file */
-	CHECK_ARG_NUM(a, 1, "load")
-	TYPE_CHECK(a, 0, LVAL_STR, "load")
-
-	mpc_result_t r;
-	if (mpc_parse_contents(a->cell[0]->str, Lispy, &r)) {
+lcache* lcache_open(char* filename) {
+	/* Start reading a file through the cache, or return NULL if it
+	 * cannot be opened */
+	clock_t start = clock();
+	lstream* s = lstream_open(filename, 1);
+	if (!s) { return NULL; }
+
+	lcache* c = malloc(sizeof(lcache));
+	c->start = start;
+	c->filename = s->filename;
+	c->path = NULL;
+	c->hit = 0;
+	c->s = s;
+	c->forms = NULL;
+	c->err = NULL;
+	c->tmp = NULL;
+	c->writing = 0;
+	c->done = 0;
+
+	unsigned long long hash = lcache_key();
+	size_t n;
+	int cached = lcache_source(s, CACHE_HASH, &hash, &n);
+
+	/* Decode the expressions if the whole cache is intact and was read
+	 * from the same source */
+	if (cached) {
+		c->path = lcache_name(hash, n);
+		c->data = image_map(c->path, &c->len, &c->mapped);
+	}
+	if (cached && c->data) {
+		if (lcache_check(c->data, c->len)) {
+			image_reader* r = &c->r;
+			if (image_start(r, c->data, c->len, CACHE_MAGIC) == IMAGE_VERSION
+				&& image_get_uint(r) == CACHE_VERSION && image_get_uint(r) == n
+				&& !r->err && (size_t)(r->end - r->p) >= n + CACHE_CHECK
+				&& lcache_source(s, CACHE_SAME, (void*)r->p, &n)) {
+				r->p += n;
+				r->end -= CACHE_CHECK;
+				c->hit = 1;
+				return c;
+			}
+			image_end(r);
+		}
+		image_unmap(c->data, c->len, c->mapped);
+	}
 
-		/* Read contents */
-		lval* expr = lval_read(r.output);
-		mpc_ast_delete(r.output);
+	if (reader_mpc) {
+		while (!s->eof) { lstream_fill(s); }
+		c->forms = lval_read_string(filename, s->buf, &c->err);
+	}
+	if (cached) {
+		c->tmp = malloc(strlen(c->path) + 32);
+		sprintf(c->tmp, "%s.%li.%lx", c->path, (long)getpid(), (unsigned long)(size_t)c);
+		c->writing = image_open(&c->w, c->tmp, CACHE_MAGIC);
+	}
+	if (c->writing) {
+		image_put_uint(&c->w, CACHE_VERSION);
+		image_put_uint(&c->w, n);
+		if (!lcache_source(s, CACHE_COPY, c->w.f, &n)) { c->w.err = IMAGE_WRITE_FAILED; }
+	}
+	return c;
+}
 
-		/* Evalutate each expression */
-		while (expr->count) {
-			lval* x = lval_eval(e, lval_pop(expr, 0));
-			/* If Evaluation leads to error print it */
-			if (x->type == LVAL_ERR) { lval_println(x); }
-			lval_del(x);
+lval* lcache_next(lcache* c, char** err) {
+	/* Read the next top level expression, returning NULL at the end of the
+	 * file, or on a syntax error with err set */
+	*err = NULL;
+	if (c->hit) {
+		image_reader* r = &c->r;
+		if (r->p + 1 == r->end && *r->p == CACHE_END) { return NULL; }
+		lval* x = image_get_lval(r);
+		if (!x) {
+			/* Drop a broken cache so the next load reads the source */
+			remove(c->path);
+			*err = malloc(strlen(c->filename) + strlen(c->path) + 64);
+			sprintf(*err, "%s: error: Corrupt cache %s\n", c->filename, c->path);
 		}
+		return x;
+	}
 
-		/* Delete expressions and arguments */
-		lval_del(expr);
-		lval_del(a);
-
-		/* Return empty list */
-		return lval_sexpr();
+	lval* x;
+	if (!reader_mpc) {
+		x = lstream_next(c->s, err);
+	} else if (c->forms) {
+		x = c->forms->count ? lval_pop(c->forms, 0) : NULL;
 	} else {
-		/* Get parse Error as String */
-		char* err_msg = mpc_err_string(r.error);
-		mpc_err_delete(r.error);
-
-		/* Create new error message using it */
-		lval* err = lval_err("Could not load Library %s", err_msg);
-		free(err_msg);
-		lval_del(a);
-
-		/* Cleanup and return error */
-		return err;
+		*err = c->err;
+		c->err = NULL;
+		x = NULL;
 	}
+	if (x && c->writing) { image_put_lval(&c->w, x); }
+	if (!x && !*err) { c->done = 1; }
+	return x;
 }
 
-lval* builtin_print(lenv* e, lval* a) {
-	for (int i = 0; i < a->count; i++) {
-		lval_print(a->cell[i]); putchar(' ');
+void lcache_close(lcache* c) {
+	/* Finish reading, putting the cache written into place if complete */
+	if (c->hit) {
+		image_end(&c->r);
+		image_unmap(c->data, c->len, c->mapped);
+	} else {
+		if (c->writing) {
+			if (c->done && !lcache_seal(c)) { c->done = 0; }
+			if (image_close(&c->w, c->tmp) != IMAGE_OK || !c->done
+				|| rename(c->tmp, c->path) != 0) {
+				remove(c->tmp);
+			}
+		}
+		if (c->forms) { lval_del(c->forms); }
+		free(c->err);
+		free(c->tmp);
 	}
-
-	/* Print a newline and delete arguments */
-	putchar('\n');
-	lval_del(a);
-	return lval_ok();
+	double t = (double)(clock() - c->start) / CLOCKS_PER_SEC;
+#ifdef READ_THREADS
+	pthread_mutex_lock(&cache_lock);
+#endif
+	if (c->hit) {
+		cache_hits++;
+		cache_hit_time += t;
+	} else {
+		cache_misses++;
+		cache_miss_time += t;
+	}
+#ifdef READ_THREADS
+	pthread_mutex_unlock(&cache_lock);
+#endif
+	lstream_close(c->s);
+	free(c->path);
+	free(c);
 }
 
-lval* builtin_error(lenv* e, lval* a) {
-	CHECK_ARG_NUM(a, 1, "error")
-	TYPE_CHECK(a, 0, LVAL_STR, "error")
-
-	/* Construct Error from first argument */
-	lval* err = lval_err(a->cell[0]->str);
-
-	/* Delete arguments and return */
-	lval_del(a);
-	return err;
+/* Reading of the files given on the command line ahead of evaluating
+ * them, with --jobs. Reading has no side effects, so a pool of threads
+ * reads every file into an S-Expression at once, and the main thread then
+ * evaluates them in order, each as soon as it has been read. The parsers
+ * are only ever read from while parsing, and each thread reads into its
+ * own arena. A file that could not be read is loaded again by the main
+ * thread in its turn, so that its error is reported as usual, after any
+ * expressions before it have run. */
+
+typedef struct lpool lpool;
+
+lval* lpool_read(char* filename) {
+	/* Every expression in a file, or NULL if it could not be read */
+	char* err;
+	if (cache_dir) {
+		lcache* c = lcache_open(filename);
+		if (!c) { return NULL; }
+		lval* v = lval_sexpr();
+		lval* x;
+		while ((x = lcache_next(c, &err))) { lval_add(v, x); }
+		lcache_close(c);
+		if (err) {
+			free(err);
+			lval_del(v);
+			return NULL;
+		}
+		return v;
+	}
+	lval* v = lval_read_file(filename, &err);
+	if (!v) { free(err); }
+	return v;
 }
 
-void lenv_add_builtins(lenv* e) {
-	/* List Functions */
-	lenv_add_builtin(e, "list", builtin_list);
-	lenv_add_builtin(e, "head", builtin_head);
-	lenv_add_builtin(e, "tail", builtin_tail);
-	lenv_add_builtin(e, "eval", builtin_eval);
-	lenv_add_builtin(e, "join", builtin_join);
-	lenv_add_builtin(e, "cons", builtin_cons);
-	lenv_add_builtin(e, "len", builtin_len);
-	lenv_add_builtin(e, "init", builtin_init);
+#ifdef READ_THREADS
+struct lpool {
+	char** files;
+	int count;
+	int next;
 
-	/* Environment and parsing functions */
-	lenv_add_builtin(e, "list_env", builtin_list_env);
-	lenv_add_builtin(e, "exit", builtin_exit);
-	lenv_add_builtin(e, "\\", builtin_lambda);
-	lenv_add_builtin(e, "load", builtin_load);
-	lenv_add_builtin(e, "error", builtin_error);
-	lenv_add_builtin(e, "print", builtin_print);
-	lenv_add_builtin(e, "read", builtin_read);
-	lenv_add_builtin(e, "show", builtin_show);
-
-	lenv_add_builtin(e, "def", builtin_def);
-	lenv_add_builtin(e, "fun", builtin_fun);
-	lenv_add_builtin(e, "=", builtin_put);
+	/* What each file read as, once ready */
+	lval** read;
+	int* ready;
 
-	/* Arithmetic and Comparison Funtions */
-	lenv_add_builtin(e, "+", builtin_add);
-	lenv_add_builtin(e, "-", builtin_sub);
-	lenv_add_builtin(e, "*", builtin_mul);
-	lenv_add_builtin(e, "/", builtin_div);
-	lenv_add_builtin(e, ">", builtin_gt);
-	lenv_add_builtin(e, "<", builtin_lt);
-	lenv_add_builtin(e, ">=", builtin_ge);
-	lenv_add_builtin(e, "<=", builtin_le);
-	lenv_add_builtin(e, "==", builtin_eq);
-	lenv_add_builtin(e, "!=", builtin_ne);
-	lenv_add_builtin(e, "if", builtin_if);
-	lenv_add_builtin(e, "||", builtin_or);
-	lenv_add_builtin(e, "&&", builtin_and);
-	lenv_add_builtin(e, "!", builtin_not);
+	int nthreads;
+	pthread_t* threads;
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+};
 
+void* lpool_worker(void* arg) {
+	lpool* p = arg;
+	reader_arena = mpc_arena_new(READER_ARENA_CHUNK);
+	while (1) {
+		/* Take the next file nobody is reading yet */
+		pthread_mutex_lock(&p->lock);
+		int i = p->next++;
+		pthread_mutex_unlock(&p->lock);
+		if (i >= p->count) { break; }
+
+		lval* x = lpool_read(p->files[i]);
+		pthread_mutex_lock(&p->lock);
+		p->read[i] = x;
+		p->ready[i] = 1;
+		pthread_cond_broadcast(&p->done);
+		pthread_mutex_unlock(&p->lock);
+	}
+	mpc_arena_delete(reader_arena);
+	return NULL;
 }
 
-long count_child(mpc_ast_t* t){
-	/* Function to compute number of child nodes */
-	if (t->children_num == 0){
-			return 1;
+lpool* lpool_start(char** files, int count, int nthreads) {
+	/* Start reading files on up to nthreads threads */
+	lpool* p = malloc(sizeof(lpool));
+	p->files = files;
+	p->count = count;
+	p->next = 0;
+	p->read = calloc(count, sizeof(lval*));
+	p->ready = calloc(count, sizeof(int));
+	pthread_mutex_init(&p->lock, NULL);
+	pthread_cond_init(&p->done, NULL);
+
+	p->threads = malloc(sizeof(pthread_t) * nthreads);
+	p->nthreads = 0;
+	while (p->nthreads < nthreads && p->nthreads < count) {
+		if (pthread_create(&p->threads[p->nthreads], NULL, lpool_worker, p) != 0) { break; }
+		p->nthreads++;
 	}
+	/* Without any thread, files are read when loaded as usual */
+	if (p->nthreads == 0) {
+		p->next = count;
+		for (int i = 0; i < count; i++) { p->ready[i] = 1; }
+	}
+	return p;
+}
 
-	/* if not, then has multiple children, loop through them */
-	int count = 0;
-	int child_num = 0;
-	while(child_num < t->children_num){
-		count += count_child(t->children[child_num]);
-		child_num += 1;
+lval* lpool_take(lpool* p, int i) {
+	/* Wait for file i to be read and take what it read as */
+	pthread_mutex_lock(&p->lock);
+	while (!p->ready[i]) { pthread_cond_wait(&p->done, &p->lock); }
+	lval* x = p->read[i];
+	p->read[i] = NULL;
+	pthread_mutex_unlock(&p->lock);
+	return x;
+}
+
+void lpool_finish(lpool* p) {
+	for (int i = 0; i < p->nthreads; i++) { pthread_join(p->threads[i], NULL); }
+	for (int i = 0; i < p->count; i++) {
+		if (p->read[i]) { lval_del(p->read[i]); }
 	}
-	return count;
+	pthread_mutex_destroy(&p->lock);
+	pthread_cond_destroy(&p->done);
+	free(p->threads);
+	free(p->read);
+	free(p->ready);
+	free(p);
 }
+#else
+/* Without threads every file is read as it is loaded */
+lpool* lpool_start(char** files, int count, int nthreads) { return NULL; }
+lval* lpool_take(lpool* p, int i) { return NULL; }
+void lpool_finish(lpool* p) {}
+#endif
 
-int main(int argc, char** argv){
+/* The grammar read by mpc. It is built from a table of its parsers written
+ * by --emit-grammar to grammar.h, which skips parsing the grammar and its
+ * regexes at startup, as long as the table was made from this same text */
+char* lispy_grammar = "\
+	number		: /-?[0-9]+/ ; \n\
+	decimal		: /-?[0-9]+\\.[0-9]*/ ; \n\
+	boolean		: \"true\" | \"false\" ; \n\
+	symbol		: /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&|]+/ ; \n\
+	string		: /\"(\\\\.|[^\"])*\"/ ; \n\
+	comment		: /;[^\\r\\n]*/ ; \n\
+	sexpr		: '(' <expr>* ')' ; \n\
+	qexpr		: '{' <expr>* '}' ; \n\
+	expr		: <decimal> | <number> | <boolean> | <symbol> \n\
+			| <string> | <comment> | <sexpr> | <qexpr> ; \n\
+	lispy		: /^/ <expr>* /$/ ; \n\
+";
+
+/* Whether lispy_init may build the grammar from its table */
+int grammar_table = 1;
+
+#ifndef JDLISP_GRAMMAR_TEXT
+#include "grammar.h"
+#endif
+
+void lispy_init(void) {
 	/* Define parsers */
 	Number = mpc_new("number");
 	Decimal = mpc_new("decimal");
@@ -1523,31 +6854,128 @@ int main(int argc, char** argv){
 	Expr = mpc_new("expr");
 	Lispy = mpc_new("lispy");
 
-	mpca_lang(MPCA_LANG_DEFAULT,
-		"					\
-		number		: /-?[0-9]+/ ; \
-		decimal		: /-?[0-9]+\\.[0-9]*/ ;		\
-		boolean		: \"true\" | \"false\" ;    \
-		symbol : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&|]+/ ;         \
-		string		: /\"(\\\\.|[^\"])*\"/ ; 	\
-		comment		: /;[^\\r\\n]*/ ;		\
-		sexpr 		: '(' <expr>* ')' ; \
-		qexpr 		: '{' <expr>* '}' ; \
-		expr 		: <decimal> | <number> | <boolean> | <symbol> \
-	       			| <string> | <comment> |  <sexpr> | <qexpr> ; \
-		lispy		: /^/   <expr>*  /$/ ; \
-		",
+	reader_arena = mpc_arena_new(READER_ARENA_CHUNK);
+
+#ifndef JDLISP_GRAMMAR_TEXT
+	if (grammar_table && strcmp(lispy_table_grammar, lispy_grammar) == 0) {
+		mpc_table_load(&lispy_table, 10,
+			Number, Decimal, Boolean, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
+		return;
+	}
+#endif
+
+	mpca_lang(MPCA_LANG_DEFAULT, lispy_grammar,
+		Number, Decimal, Boolean, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
+}
+
+int emit_grammar(char* path) {
+	/* Write the table of the grammar's parsers, built from its text, to path */
+	FILE* f = fopen(path, "w");
+	if (!f) {
+		printf("Could not open %s for writing\n", path);
+		return 1;
+	}
+	mpc_table_print(f, "lispy_table", 10,
 		Number, Decimal, Boolean, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
-	/* Create environment, load builtins and standard library */
+
+	char* text = malloc(strlen(lispy_grammar) + 1);
+	strcpy(text, lispy_grammar);
+	text = mpcf_escape(text);
+	fprintf(f, "\nstatic const char lispy_table_grammar[] = \"%s\";\n", text);
+	free(text);
+	fclose(f);
+	return 0;
+}
+
+void lispy_cleanup(void) {
+	/* Undefine and Delete our Parsers */
+	mpc_cleanup(10, Number, Decimal, Boolean, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
+	mpc_arena_delete(reader_arena);
+}
+
+#ifndef JDLISP_NO_MAIN
+int main(int argc, char** argv){
+	/* Handle command line options, which come before any files */
+	int first = 1;
+	char* emit = NULL;
+	char* emit_table = NULL;
+	char* image = NULL;
+	char* save_image = NULL;
+	int jobs = 1;
+	while (first < argc && strncmp(argv[first], "--", 2) == 0) {
+		if (strcmp(argv[first], "--emit-c") == 0 && first + 1 < argc) {
+			emit = argv[++first];
+		} else if (strcmp(argv[first], "--emit-grammar") == 0 && first + 1 < argc) {
+			emit_table = argv[++first];
+			grammar_table = 0;
+		} else if (strcmp(argv[first], "--image") == 0 && first + 1 < argc) {
+			image = argv[++first];
+		} else if (strcmp(argv[first], "--save-image") == 0 && first + 1 < argc) {
+			save_image = argv[++first];
+		} else if (strcmp(argv[first], "--cache") == 0 && first + 1 < argc) {
+			cache_dir = argv[++first];
+		} else if (strcmp(argv[first], "--jobs") == 0 && first + 1 < argc) {
+			jobs = atoi(argv[++first]);
+		} else if (strcmp(argv[first], "--mpc-reader") == 0) {
+			reader_mpc = 1;
+		} else if (strcmp(argv[first], "--no-opt") == 0) {
+			opt_enabled = 0;
+		} else if (strcmp(argv[first], "--no-jit") == 0) {
+			jit_enabled = 0;
+		} else {
+			printf("Unknown option %s\n", argv[first]);
+			return 1;
+		}
+		first++;
+	}
+
+	lispy_init();
+
+	/* Write out the grammar's table for grammar.h */
+	if (emit_table) {
+		int err = emit_grammar(emit_table);
+		lispy_cleanup();
+		return err;
+	}
+
+	/* Translate standard library and files to C instead of running them */
+	if (emit) {
+		argv[first-1] = "stlib.jdl";
+		int err = emit_c(emit, argv + first - 1, argc - first + 1);
+		lispy_cleanup();
+		return err;
+	}
+
+	/* Create environment, load builtins and standard library, or an image
+	 * of them saved earlier */
 	lenv* e = lenv_new();
-	lenv_add_builtins(e);
-	lval* v = builtin_load(e, lval_add(lval_sexpr(), lval_str("stlib.jdl")));
-	lval_del(v);
+	if (image) {
+		lval* v = image_load(e, image);
+		if (v->type == LVAL_ERR) {
+			lval_println(v);
+			lval_del(v);
+			lenv_del(e);
+			lispy_cleanup();
+			return 1;
+		}
+		lval_del(v);
+	} else {
+		lenv_add_builtins(e);
+		lval* v = builtin_load(e, lval_add(lval_sexpr(), lval_str("stlib.jdl")));
+		lval_del(v);
+	}
+
 
+	/* Supplied with list of files, which may be read ahead on threads */
+	if (argc > first) {
+		lpool* pool = jobs > 1 ? lpool_start(argv + first, argc - first, jobs) : NULL;
+		for (int i = first; i < argc; i++) {
+			lval* expr = pool ? lpool_take(pool, i - first) : NULL;
+			if (expr) {
+				lval_eval_each(e, expr);
+				continue;
+			}
 
-	/* Supplied with list of files */
-	if (argc >= 2) {
-		for (int i = 1; i < argc; i++) {
 			/* Argument list with a single argument, the filename */
 			lval* args = lval_add(lval_sexpr(), lval_str(argv[i]));
 			lval* x = builtin_load(e, args);
@@ -1556,7 +6984,21 @@ int main(int argc, char** argv){
 			if (x->type == LVAL_ERR) { lval_println(x); }
 			lval_del(x);
 		}
-	} else {
+		if (pool) { lpool_finish(pool); }
+	}
+
+	/* Save the environment with any files loaded instead of a prompt */
+	if (save_image) {
+		lval* x = image_save(e, save_image);
+		int err = x->type == LVAL_ERR;
+		if (err) { lval_println(x); }
+		lval_del(x);
+		lenv_del(e);
+		lispy_cleanup();
+		return err;
+	}
+
+	if (argc <= first) {
 		/* Print Version and Exit Information */
 
 		puts("JDlisp Version 1.0");
@@ -1571,16 +7013,16 @@ int main(int argc, char** argv){
 			add_history(input);
 
 			/* Attempt to Parse the user Input */
-			mpc_result_t r;
-			if (mpc_parse("<stdin>", input, Lispy, &r)){
-				lval* x = lval_eval(e, lval_read(r.output));
+			char* err;
+			lval* x = lval_read_string("<stdin>", input, &err);
+			if (x) {
+				x = lval_eval(e, x);
 				lval_println(x);
 				lval_del(x);
-				mpc_ast_delete(r.output);
 			} else {
 				/* Otherwise Print the Error */
-				mpc_err_print(r.error);
-				mpc_err_delete(r.error);
+				printf("%s", err);
+				free(err);
 			}
 
 			/* Free retrieved input */
@@ -1593,9 +7035,8 @@ int main(int argc, char** argv){
 		}
 	}
 	lenv_del(e);
-	/* Undefine and Delete our Parsers */
-	mpc_cleanup(10, Number, Decimal, Boolean, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
+	lispy_cleanup();
 
 	return 0;
 }
-
+#endif
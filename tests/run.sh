@@ -0,0 +1,21 @@
+#!/bin/sh
+# Builds the interpreter from src.c and mpc.c into tests/jdlisp, then runs
+# each tests/*.jdl from the repository root, failing unless what it prints
+# matches the tests/*.out next to it, as is and with --no-opt, --no-jit and
+# --mpc-reader. CC, CFLAGS and LDLIBS change how it is built, for instance
+# LDLIBS=-lm where there is no editline.
+
+set -e
+${CC:-cc} -std=c99 -Wall $CFLAGS src.c mpc.c ${LDLIBS:--ledit -lm} -o tests/jdlisp
+
+failed=0
+for test in tests/*.jdl; do
+	for flag in "" --no-opt --no-jit --mpc-reader; do
+		if ! tests/jdlisp $flag "$test" 2>&1 | diff "${test%.jdl}.out" -; then
+			echo "$test failed ${flag:-as is}"
+			failed=1
+		fi
+	done
+done
+[ $failed = 0 ] && echo ok
+exit $failed